@@ -24,7 +24,7 @@
 
 #include <stdarg.h>
 
-static void akl_ir_exec_branch(struct akl_context *, struct akl_list_entry *);
+static void akl_ir_exec_branch(struct akl_context *, struct akl_lisp_fun *, unsigned int);
 
 static void update_recent_value(struct akl_state *s, struct akl_value *val)
 {
@@ -32,17 +32,25 @@ static void update_recent_value(struct akl_state *s, struct akl_value *val)
     if (!recent_var) {
         recent_var = akl_set_global_variable(s,  AKL_CSTR("$?")
             , AKL_CSTR("Previously returned value"), val);
-        AKL_GC_SET_STATIC(recent_var);
     }
     /* Update '$?' with the recently used value */
+    akl_gc_write_barrier(recent_var);
     recent_var->vr_value = val;
 }
 
 /* ~~~===### Stack handling ###===~~~ */
+/*
+ * The stack is a contiguous array of value pointers (the stack pointer
+ * is the element count of the vector). A frame is just a window of
+ * it: the arguments of the current call from 'cx_frame_base' with the
+ * length of 'cx_frame_len'. Shifting and popping the frame only
+ * narrows this window, the values are removed from the stack, when
+ * the call returns.
+*/
 unsigned int akl_frame_get_count(struct akl_context *ctx)
 {
     assert(ctx);
-    return akl_list_count(ctx->cx_frame);
+    return ctx->cx_frame_len;
 }
 
 bool_t akl_frame_is_empty(struct akl_context *ctx)
@@ -53,7 +61,9 @@ bool_t akl_frame_is_empty(struct akl_context *ctx)
 
 struct akl_value *akl_frame_at(struct akl_context *ctx, unsigned int ind)
 {
-    return akl_list_index_value(ctx->cx_frame, ind);
+    if (ind >= ctx->cx_frame_len)
+        return NULL;
+    return AKL_STACK_AT(ctx->cx_stack, ctx->cx_frame_base + ind);
 }
 
 unsigned int akl_frame_get_pointer(struct akl_context *ctx)
@@ -61,30 +71,36 @@ unsigned int akl_frame_get_pointer(struct akl_context *ctx)
     return akl_frame_get_count(ctx);
 }
 
+/* Remove every value above the given stack pointer */
+void akl_stack_truncate(struct akl_context *ctx, unsigned int sp)
+{
+    if (sp < akl_vector_count(ctx->cx_stack))
+        ctx->cx_stack->av_count = sp;
+}
+
 void akl_stack_clear(struct akl_context *ctx, size_t c)
 {
-#if 0
-    void *ptr;
-    do {
-        ptr = akl_frame_pop(ctx);
-    } while (c-- || ptr != NULL);
-#endif 
-    //akl_vector_truncate_by(ctx->cx_stack, c);
-    // TODO: Evaulate GC on this
-    akl_init_list(ctx->cx_stack);
+    unsigned int sp = akl_vector_count(ctx->cx_stack);
+    unsigned int bottom = ctx->cx_frame_base + ctx->cx_frame_len;
+    /* Never touch the values of the callers */
+    if (c == 0 || sp - bottom < c)
+        c = sp - bottom;
+    akl_stack_truncate(ctx, sp - c);
 }
 
 void akl_frame_destroy(struct akl_context *cx, int argc)
 {
-    while (akl_frame_pop(cx))
-        ;
+    cx->cx_frame_len = 0;
 }
 
-/* Attention: The stack contains pointer to value pointers */
 void akl_stack_push(struct akl_context *ctx, struct akl_value *value)
 {
+    struct akl_vector *stack;
     AKL_ASSERT(ctx && value, AKL_NOTHING);
-    akl_list_append_value(ctx->cx_state, ctx->cx_stack, value);
+    stack = ctx->cx_stack;
+    if (akl_vector_is_grow_need(stack))
+        akl_vector_grow(stack, 0);
+    AKL_STACK_AT(stack, stack->av_count++) = value;
 }
 
 void akl_frame_push(struct akl_context *ctx, struct akl_value *value)
@@ -96,79 +112,84 @@ void akl_frame_push(struct akl_context *ctx, struct akl_value *value)
 
 struct akl_value *akl_frame_shift(struct akl_context *ctx)
 {
-    struct akl_list_entry *ent;
     if (ctx == NULL || akl_frame_get_count(ctx) == 0)
         return NULL;
 
-    ent = akl_list_shift_entry(ctx->cx_frame);
-    akl_list_remove_entry(ctx->cx_stack, ent);
-    return AKL_ENTRY_VALUE(ent);
+    ctx->cx_frame_len--;
+    return AKL_STACK_AT(ctx->cx_stack, ctx->cx_frame_base++);
 }
 
 struct akl_value *akl_frame_head(struct akl_context *ctx)
 {
     if (ctx == NULL)
         return NULL;
-    return akl_list_head(ctx->cx_frame);
+    return akl_frame_at(ctx, 0);
 }
 
 struct akl_value *akl_frame_pop(struct akl_context *ctx)
 {
-    struct akl_list_entry *ent;
     if (ctx == NULL || ctx->cx_state == NULL || akl_frame_get_count(ctx) == 0)
         return NULL;
 
-    ent = akl_list_pop_entry(ctx->cx_frame);
-    akl_list_remove_entry(ctx->cx_stack, ent);
-    return AKL_ENTRY_VALUE(ent);
+    ctx->cx_frame_len--;
+    return AKL_STACK_AT(ctx->cx_stack, ctx->cx_frame_base + ctx->cx_frame_len);
 }
 
 struct akl_value *akl_stack_head(struct akl_state *s)
 {
     AKL_ASSERT(s, NULL);
-    return akl_list_head(&s->ai_stack);
+    if (akl_vector_count(&s->ai_stack) == 0)
+        return NULL;
+    return AKL_STACK_AT(&s->ai_stack, 0);
 }
 
 struct akl_value *akl_stack_top(struct akl_context *ctx)
 {
     AKL_ASSERT(ctx && ctx->cx_state, NULL);
-    return akl_list_last(ctx->cx_stack);
+    if (akl_vector_count(ctx->cx_stack) == 0)
+        return NULL;
+    return AKL_STACK_AT(ctx->cx_stack, ctx->cx_stack->av_count-1);
 }
 
+/* The values under the current frame belong to the callers, these
+  are never popped. */
 struct akl_value *akl_stack_pop(struct akl_context *ctx)
 {
-
-    struct akl_value *v = (struct akl_value *)akl_list_pop(ctx->cx_stack);
-    if (v == NULL && ctx->cx_parent != NULL) {
-        v = (struct akl_value *)akl_list_pop(ctx->cx_parent->cx_stack);
-    }
-    return v;
+    struct akl_vector *stack = ctx->cx_stack;
+    if (stack->av_count <= ctx->cx_frame_base + ctx->cx_frame_len)
+        return NULL;
+    return AKL_STACK_AT(stack, --stack->av_count);
 }
 
 struct akl_value *
 akl_frame_top(struct akl_context *ctx)
 {
     AKL_ASSERT(ctx, NULL);
-    return (struct akl_value *)akl_list_last(ctx->cx_frame);
+    if (akl_frame_get_count(ctx) == 0)
+        return NULL;
+    return akl_frame_at(ctx, ctx->cx_frame_len-1);
 }
 
-/* These functions do not check the type of the stack top */
-double *akl_frame_pop_number(struct akl_context *ctx)
+/* These functions do not check the type of the stack top. The value
+  is removed even if it's not a number, then FALSE is given back. */
+bool_t akl_frame_pop_number(struct akl_context *ctx, double *n)
 {
     struct akl_value *v = akl_frame_pop(ctx);
     if (AKL_CHECK_TYPE(v, AKL_VT_NUMBER)) {
-        return &v->va_value.number;
+        *n = AKL_GET_NUMBER_VALUE(v);
+        return TRUE;
     }
-    return NULL;
+    return FALSE;
 }
 
-double *akl_frame_shift_number(struct akl_context *ctx)
+bool_t akl_frame_shift_number(struct akl_context *ctx, double *n)
 {
     struct akl_value *v = akl_frame_shift(ctx);
     if (AKL_CHECK_TYPE(v, AKL_VT_NUMBER)) {
-        return &v->va_value.number;
+        *n = AKL_GET_NUMBER_VALUE(v);
+        return TRUE;
     }
-    return NULL;
+    return FALSE;
 }
 
 char *akl_frame_pop_string(struct akl_context *ctx)
@@ -200,7 +221,7 @@ akl_frame_shift_list(struct akl_context *ctx)
 enum AKL_VALUE_TYPE akl_stack_top_type(struct akl_context *ctx)
 {
     struct akl_value *v = akl_frame_pop(ctx);
-    return (v) ? v->va_type : AKL_VT_NIL;
+    return (v) ? AKL_TYPE(v) : AKL_VT_NIL;
 }
 
 int akl_get_args(struct akl_context *ctx, int argc, ...)
@@ -248,7 +269,8 @@ int akl_get_args_strict(struct akl_context *ctx, int argc, ...)
 
     struct akl_symbol **sym; struct akl_function **fun; struct akl_userdata **udata;
     struct akl_list **list; double *num; bool_t *b; char **str;
-    struct akl_value **val;
+    struct akl_value **val; struct akl_cons **cons; struct akl_hash **hash;
+    struct akl_fvector **fvec;
     if (argc == 0)
         return -1;
 
@@ -263,15 +285,16 @@ int akl_get_args_strict(struct akl_context *ctx, int argc, ...)
         }
         /* The expected type must be the same with the current type,
             unless if that is a nil or a true or a pseudotype like AKL_VT_ANY */
-        if ((t > AKL_VT_TRUE) && t != vp->va_type) {
+        if ((t > AKL_VT_TRUE) && t != AKL_TYPE(vp)) {
             /* If the next argument is optional, skip it and don't complain */
             if (arg_opt) {
                 val = va_arg(ap, struct akl_value **);
                 arg_opt = FALSE;
             } else {
-                ctx->cx_lex_info = vp->va_lex_info;
+                if (AKL_LEX_INFO(vp) != NULL)
+                    ctx->cx_lex_info = AKL_LEX_INFO(vp);
                 akl_raise_error(ctx, AKL_ERROR, "%s: Expected %s but got %s"
-                    , ctx->cx_func_name, akl_type_name[t], akl_type_name[vp->va_type]);
+                    , ctx->cx_func_name, akl_type_name[t], akl_type_name[AKL_TYPE(vp)]);
             }
             return -1;
         }
@@ -313,6 +336,21 @@ int akl_get_args_strict(struct akl_context *ctx, int argc, ...)
             *udata = akl_get_userdata_value(vp);
             break;
 
+            case AKL_VT_CONS:
+            cons = va_arg(ap, struct akl_cons **);
+            *cons = AKL_GET_CONS_VALUE(vp);
+            break;
+
+            case AKL_VT_HASH:
+            hash = va_arg(ap, struct akl_hash **);
+            *hash = AKL_GET_HASH_VALUE(vp);
+            break;
+
+            case AKL_VT_FVECTOR:
+            fvec = va_arg(ap, struct akl_fvector **);
+            *fvec = AKL_GET_FVECTOR_VALUE(vp);
+            break;
+
             case AKL_VT_NUMBER:
             num = va_arg(ap, double *);
             *num = AKL_GET_NUMBER_VALUE(vp);
@@ -345,19 +383,44 @@ int akl_get_args_strict(struct akl_context *ctx, int argc, ...)
 }
 
 
+/*
+ * The contexts of the called functions are kept on a LIFO stack
+ * owned by the interpreter. A context is only allocated, when the
+ * call depth first reaches a given level, the later calls reuse it.
+*/
+static struct akl_context *
+akl_frame_acquire(struct akl_state *s)
+{
+    struct akl_context **cp;
+    if (s->ai_frame_depth == akl_vector_count(&s->ai_frames)) {
+        cp = (struct akl_context **)akl_vector_reserve(&s->ai_frames);
+        *cp = akl_new_context(s);
+        if (*cp == NULL) {
+            s->ai_frames.av_count--;
+            return NULL;
+        }
+    }
+    cp = (struct akl_context **)akl_vector_at(&s->ai_frames, s->ai_frame_depth);
+    (*cp)->cx_depth = s->ai_frame_depth++;
+    return *cp;
+}
+
+/* Give back the context (and every context above it) to the frame stack */
+void akl_unbound_function(struct akl_context *cx)
+{
+    if (cx == NULL)
+        return;
+    cx->cx_state->ai_frame_depth = cx->cx_depth;
+}
+
 struct akl_context *
 akl_bound_function(struct akl_context *ctx, struct akl_symbol *sym
                    , struct akl_function *fn)
 {
-    struct akl_context *cx = akl_new_context(ctx->cx_state);
+    struct akl_context *cx;
     struct akl_variable *v;
+    unsigned int depth;
 
-    if (cx == NULL) {
-        akl_raise_error(ctx, AKL_ERROR, "Cannot create context");
-        return NULL;
-    }
-
-    *(cx) = *(ctx);
     if (fn == NULL) {
         if (sym == NULL) {
             akl_raise_error(ctx, AKL_ERROR, "Interpreter error: Function and symbol can't be NULL at the same time.");
@@ -375,6 +438,15 @@ akl_bound_function(struct akl_context *ctx, struct akl_symbol *sym
         }
         fn = akl_var_to_function(v);
     }
+
+    cx = akl_frame_acquire(ctx->cx_state);
+    if (cx == NULL) {
+        akl_raise_error(ctx, AKL_ERROR, "Cannot create context");
+        return NULL;
+    }
+    depth = cx->cx_depth;
+    *(cx) = *(ctx);
+    cx->cx_depth = depth;
     cx->cx_func = fn;
     if (sym == NULL) {
         cx->cx_func_name = "lambda";
@@ -392,9 +464,11 @@ struct akl_value *akl_call_function_bound(struct akl_context *cx, int argc)
     struct akl_function *fn;
     struct akl_lisp_fun *ufun;
     struct akl_value *value;
+    unsigned int base;
     fn = cx->cx_func;
 
     akl_init_frame(cx, argc);
+    base = cx->cx_frame_base;
 
     switch (fn->fn_type) {
         case AKL_FUNC_CFUN:
@@ -402,19 +476,18 @@ struct akl_value *akl_call_function_bound(struct akl_context *cx, int argc)
         if (value == NULL) {
             akl_raise_error(cx, AKL_ERROR
                 , "Function '%s' gave back NULL", cx->cx_func_name);
-            akl_frame_destroy(cx, argc);
-            return NULL;
         }
-        akl_stack_push(cx, value);
         break;
 
         case AKL_FUNC_USER:
         ufun = &fn->fn_body.ufun;
         cx->cx_lex_info = ufun->uf_info;
         cx->cx_ir = &ufun->uf_body;
-        akl_ir_exec_branch(cx, AKL_LIST_FIRST(&ufun->uf_body));
-        value = akl_list_last(cx->cx_stack);
-        //akl_stack_push(cx, value);
+        akl_ir_exec_branch(cx, ufun, 0);
+        /* The last value of the body is the return value */
+        /* A tail call may have changed the size of the frame */
+        value = (akl_vector_count(cx->cx_stack) > base + cx->cx_frame_len)
+              ? akl_stack_top(cx) : AKL_NIL;
         break;
 
         /* TODO: */
@@ -423,6 +496,11 @@ struct akl_value *akl_call_function_bound(struct akl_context *cx, int argc)
         break;
     }
     akl_frame_destroy(cx, argc);
+    /* Replace the arguments with the returned value */
+    akl_stack_truncate(cx, base);
+    if (value != NULL) {
+        akl_stack_push(cx, value);
+    }
 
     return value;
 }
@@ -431,16 +509,21 @@ struct akl_value *
 akl_call_symbol(struct akl_context *ctx, struct akl_context *cx
                     , struct akl_symbol *sym, int argc)
 {
+    struct akl_value *value;
     if (ctx == NULL) {
         return NULL;
     }
+    if (cx != NULL) {
+        return akl_call_function_bound(cx, argc);
+    }
+
+    cx = akl_bound_function(ctx, sym, NULL);
     if (cx == NULL) {
-        cx = akl_bound_function(ctx, sym, NULL);
-        if (cx == NULL) {
-            return NULL;
-        }
+        return NULL;
     }
-    return akl_call_function_bound(cx, argc);
+    value = akl_call_function_bound(cx, argc);
+    akl_unbound_function(cx);
+    return value;
 }
 
 struct akl_function *
@@ -448,11 +531,13 @@ akl_call_sform(struct akl_context *ctx, struct akl_symbol *fsym
                , struct akl_function *sform)
 {
     struct akl_context *cx = akl_bound_function(ctx, fsym, sform);
+    struct akl_function *fn = NULL;
     if (cx && cx->cx_func && cx->cx_func->fn_body.scfun) {
-        return cx->cx_func->fn_body.scfun(cx);
+        fn = cx->cx_func->fn_body.scfun(cx);
     }
-    /* ERROR */
-    return NULL;
+    akl_unbound_function(cx);
+    /* ERROR if NULL */
+    return fn;
 }
 
 struct akl_value *
@@ -471,198 +556,409 @@ akl_call_function(struct akl_context *ctx, struct akl_context *cx
     return akl_call_symbol(ctx, cx, sym, argc);
 }
 
-#define MOVE_IP(ip) ((ip) = AKL_LIST_NEXT(ip))
-#define LOOP_WATCHDOG(ent) \
-        if ((ent) == (ent)->le_next) { \
-            fprintf(stderr, "Error, loop in %s()!\n", __func__); \
-            return;\
-        }
 #define OPERAND(ind, name) (in)->in_arg[ind].name
 
+/*
+ * The dispatch loop can be direct-threaded (every handler jumps
+ * to the next one through a table of label addresses, so every handler
+ * has its own indirect jump to predict) or an ordinary portable switch.
+ * The threaded version needs the GCC 'labels as values' extension.
+*/
+#if defined(AKL_THREADED_DISPATCH) && defined(__GNUC__)
+# define USE_THREADED_DISPATCH 1
+#endif
+
+#define FETCH() \
+    if (ip >= count) {  \
+        return;         \
+    }                   \
+    in = &code[ip++]
+
+#ifdef USE_THREADED_DISPATCH
+# define INSTR(op)  L_##op
+# define DISPATCH() FETCH(); goto *dispatch_table[in->in_op]
+# define DISPATCH_BEGIN() DISPATCH();
+# define DISPATCH_END()
+#else
+# define INSTR(op)  case op
+# define DISPATCH() continue
+# define DISPATCH_BEGIN() for (;;) { FETCH(); switch (in->in_op) {
+# define DISPATCH_END() default: goto unknown_instr; } }
+#endif
+
+/*
+ * Safe points: only on calls and backward jumps, every loop has to
+ * execute at least one of them. Every live value is on the stack (or
+ * reachable from the globals and the contexts) here, so the garbage
+ * can be collected.
+*/
+#define SAFE_POINT()                                             \
+    if (s->ai_interrupted) {                                     \
+        akl_raise_error(ctx, AKL_WARNING, "Program interruption."); \
+        return;                                                  \
+    }                                                            \
+    if (s->ai_gc_allocs >= s->ai_gc_threshold) {                 \
+        akl_gc_collect(ctx);                                     \
+    }
+
+#define JUMP_TO(offset)     \
+    if ((offset) < ip) {    \
+        SAFE_POINT();       \
+    }                       \
+    ip = (offset)
+
+/*
+ * Operands of the arithmetic instructions: the last 'n' values of the
+ * stack (the second, or the only one goes to 'y'). The instruction
+ * is only executed in place, when the builtin is still bound to
+ * its name and every operand is a number. Otherwise it's an ordinary
+ * call of the symbol.
+*/
+#define OPERAND_VALUE(n) AKL_STACK_AT(stack, sp - (n))
+#define NUMBER_OPERANDS(n)                                              \
+    var = AKL_IR_CACHED_VAR(s, in, OPERAND(0, symbol));                 \
+    sp  = akl_vector_count(stack);                                      \
+    if (var == NULL || AKL_GET_FUNCTION_VALUE(var->vr_value) != in->in_fun \
+            || sp < ctx->cx_frame_base + ctx->cx_frame_len + (n)        \
+            || !AKL_CHECK_TYPE(OPERAND_VALUE(1), AKL_VT_NUMBER)         \
+            || ((n) == 2                                                \
+                && !AKL_CHECK_TYPE(OPERAND_VALUE(2), AKL_VT_NUMBER))) { \
+        goto generic_call;                                              \
+    }                                                                   \
+    y = AKL_GET_NUMBER_VALUE(OPERAND_VALUE(1));                         \
+    if ((n) == 2)                                                       \
+        x = AKL_GET_NUMBER_VALUE(OPERAND_VALUE(2))
+
+/* Replace the 'n' operands with the result */
+#define OP_RESULT(n, result)                    \
+    OPERAND_VALUE(n) = (result);                \
+    stack->av_count = sp - (n) + 1
+
 static void
-akl_ir_exec_branch(struct akl_context *ctx, struct akl_list_entry *ip)
+akl_ir_exec_branch(struct akl_context *ctx, struct akl_lisp_fun *uf, unsigned int ip)
 {
-    struct akl_list  *ir = ctx->cx_ir;
     struct akl_state *s  = ctx->cx_state;
-
-    struct akl_label *lt = NULL, *ln = NULL;
+    struct akl_ir_instruction *code, *in;
     struct akl_context *cx = NULL;
-    struct akl_ir_instruction *in;
     struct akl_value *v, *lv;
     struct akl_variable *var;
     struct akl_symbol *sym;
-
-    if (ir == NULL || ip == NULL)
+    struct akl_function *fn;
+    struct akl_vector *stack = ctx->cx_stack;
+    unsigned int count, sp, argc;
+    double x, y;
+#ifdef USE_THREADED_DISPATCH
+    /* Must be in the same order as akl_ir_instruction_t */
+    static const void *dispatch_table[AKL_NR_INSTRUCTIONS] = {
+        [0 ... AKL_NR_INSTRUCTIONS-1] = &&unknown_instr,
+        [AKL_IR_NOP]    = &&L_AKL_IR_NOP,
+        [AKL_IR_PUSH]   = &&L_AKL_IR_PUSH,
+        [AKL_IR_LOAD]   = &&L_AKL_IR_LOAD,
+        [AKL_IR_CALL]   = &&L_AKL_IR_CALL,
+        [AKL_IR_GET]    = &&L_AKL_IR_GET,
+        [AKL_IR_SET]    = &&L_AKL_IR_SET,
+        [AKL_IR_BRANCH] = &&L_AKL_IR_BRANCH,
+        [AKL_IR_JMP]    = &&L_AKL_IR_JMP,
+        [AKL_IR_JT]     = &&L_AKL_IR_JT,
+        [AKL_IR_JN]     = &&L_AKL_IR_JN,
+        [AKL_IR_HEAD]   = &&L_AKL_IR_HEAD,
+        [AKL_IR_TAIL]   = &&L_AKL_IR_TAIL,
+        [AKL_IR_RET]    = &&L_AKL_IR_RET,
+        [AKL_IR_TCALL]  = &&L_AKL_IR_TCALL,
+        [AKL_IR_ADD]    = &&L_AKL_IR_ADD,
+        [AKL_IR_SUB]    = &&L_AKL_IR_SUB,
+        [AKL_IR_MUL]    = &&L_AKL_IR_MUL,
+        [AKL_IR_DIV]    = &&L_AKL_IR_DIV,
+        [AKL_IR_INC]    = &&L_AKL_IR_INC,
+        [AKL_IR_DEC]    = &&L_AKL_IR_DEC,
+        [AKL_IR_EQ]     = &&L_AKL_IR_EQ,
+        [AKL_IR_NE]     = &&L_AKL_IR_NE,
+        [AKL_IR_LT]     = &&L_AKL_IR_LT,
+        [AKL_IR_LE]     = &&L_AKL_IR_LE,
+        [AKL_IR_GT]     = &&L_AKL_IR_GT,
+        [AKL_IR_GE]     = &&L_AKL_IR_GE
+    };
+#endif
+
+    if (uf == NULL || s == NULL)
         return;
 
-    while (ip) {
-        if (s && s->ai_interrupted) {
-            akl_raise_error(ctx, AKL_WARNING, "Program interruption.");
-            return;
-        }
-
-        in = (struct akl_ir_instruction *)ip->le_data;
-        LOOP_WATCHDOG(ip);
-        switch (in->in_op) {
-        case AKL_IR_NOP:
-            MOVE_IP(ip);
-        break;
-
-        case AKL_IR_SET:
-            /* Set does not remove the top stack value */
-            v = akl_stack_top(ctx);
-            if (v != NULL) {
-                ctx->cx_lex_info = v->va_lex_info;
-                akl_set_global_var(s, OPERAND(0, symbol), NULL, TRUE, v);
-            }
-            MOVE_IP(ip);
-        break;
-
-        case AKL_IR_GET:
-            sym = OPERAND(0, symbol);
-            var = akl_get_global_var(s, sym);
-            if (!var) {
-                akl_raise_error(ctx, AKL_ERROR, "Variable '%s' is undefined.", sym->sb_name);
-                akl_stack_push(ctx, akl_new_nil_value(s));
+    code  = AKL_IR_CODE(&uf->uf_body);
+    count = akl_vector_count(&uf->uf_body);
+    DISPATCH_BEGIN()
+
+    INSTR(AKL_IR_NOP):
+        DISPATCH();
+
+    INSTR(AKL_IR_SET):
+        /* Set does not remove the top stack value */
+        v = akl_stack_top(ctx);
+        if (v != NULL) {
+            AKL_SET_LEX_INFO(ctx, v);
+            if (in->in_var != NULL) {
+                var = in->in_var;
+                akl_gc_write_barrier(var);
+                var->vr_value    = v;
+                var->vr_desc     = NULL;
+                var->vr_is_cdesc = TRUE;
             } else {
-                ctx->cx_lex_info = var->vr_lex_info;
-                akl_stack_push(ctx, var->vr_value);
+                in->in_var = akl_set_global_var(s, OPERAND(0, symbol), NULL, TRUE, v);
             }
-            MOVE_IP(ip);
-        break;
+        }
+        DISPATCH();
+
+    INSTR(AKL_IR_GET):
+        sym = OPERAND(0, symbol);
+        var = AKL_IR_CACHED_VAR(s, in, sym);
+        if (!var) {
+            akl_raise_error(ctx, AKL_ERROR, "Variable '%s' is undefined.", sym->sb_name);
+            akl_stack_push(ctx, akl_new_nil_value(s));
+        } else {
+            ctx->cx_lex_info = var->vr_lex_info;
+            akl_stack_push(ctx, var->vr_value);
+        }
+        DISPATCH();
 
-        case AKL_IR_PUSH:
-            v = OPERAND(0, value);
-            if (v == NULL) {
-                akl_raise_error(ctx, AKL_WARNING, "Interpreter error: NULL pushed to stack.");
-                return;
-            }
-            ctx->cx_lex_info = v->va_lex_info;
+    INSTR(AKL_IR_PUSH):
+        v = AKL_IR_CONST(uf, OPERAND(0, ui_num));
+        if (v == NULL) {
+            akl_raise_error(ctx, AKL_WARNING, "Interpreter error: NULL pushed to stack.");
+            return;
+        }
+        AKL_SET_LEX_INFO(ctx, v);
+        akl_stack_push(ctx, v);
+        DISPATCH();
+
+    INSTR(AKL_IR_LOAD):
+        /* TODO: Error if ui_num < 0 */
+        v = akl_frame_at(ctx, OPERAND(0, ui_num));
+        if (v) {
+            AKL_SET_LEX_INFO(ctx, v);
             akl_stack_push(ctx, v);
-            MOVE_IP(ip);
-        break;
-
-        case AKL_IR_LOAD:
-            /* TODO: Error if ui_num < 0 */
-            v = akl_frame_at(ctx, OPERAND(0, ui_num));
-            if (v) {
-                ctx->cx_lex_info = v->va_lex_info;
-                akl_stack_push(ctx, v);
-            }
-            MOVE_IP(ip);
-        break;
-
-        case AKL_IR_CALL:
-            ctx->cx_lex_info = in->in_linfo;
-            if (in->in_fun) {
-                cx = akl_bound_function(ctx, OPERAND(0, symbol), in->in_fun);
-                if (cx == NULL) {
-                    MOVE_IP(ip);
-                    continue;
-                }
-                akl_call_function_bound(cx, OPERAND(1, ui_num));
-            } else {
-                akl_call_symbol(ctx, NULL, OPERAND(0, symbol), OPERAND(1, ui_num));
-            }
-            MOVE_IP(ip);
-        break;
-
-        case AKL_IR_HEAD:
-            v = akl_frame_at(ctx, in->in_arg[0].ui_num);
-            if (v) {
-                akl_stack_push(ctx, akl_car(AKL_GET_LIST_VALUE(v)));
-            }
-            MOVE_IP(ip);
-        break;
+        }
+        DISPATCH();
+
+    INSTR(AKL_IR_CALL):
+generic_call:
+        SAFE_POINT();
+        ctx->cx_lex_info = in->in_linfo;
+        sym = OPERAND(0, symbol);
+        /* Always call the currently bound value, so redefinitions
+          take effect. When it's not a function, akl_bound_function()
+          will look it up again and report the error. */
+        var = AKL_IR_CACHED_VAR(s, in, sym);
+        cx = akl_bound_function(ctx, sym, akl_var_is_function(var)
+                                          ? akl_var_to_function(var) : NULL);
+        if (cx != NULL) {
+            akl_call_function_bound(cx, OPERAND(1, ui_num));
+            akl_unbound_function(cx);
+        }
+        DISPATCH();
 
-        case AKL_IR_TAIL:
-            v = akl_frame_at(ctx, OPERAND(0, ui_num));
-            if (v) {
-                lv = akl_new_list_value(ctx->cx_state
-                        , akl_cdr(ctx->cx_state, AKL_GET_LIST_VALUE(v)));
-                akl_stack_push(ctx, lv);
-            }
-            MOVE_IP(ip);
-        break;
+    INSTR(AKL_IR_HEAD):
+        v = akl_frame_at(ctx, in->in_arg[0].ui_num);
+        if (v) {
+            akl_stack_push(ctx, akl_car(AKL_GET_LIST_VALUE(v)));
+        }
+        DISPATCH();
+
+    INSTR(AKL_IR_TAIL):
+        v = akl_frame_at(ctx, OPERAND(0, ui_num));
+        if (v) {
+            lv = akl_new_list_value(ctx->cx_state
+                    , akl_cdr(ctx->cx_state, AKL_GET_LIST_VALUE(v)));
+            akl_stack_push(ctx, lv);
+        }
+        DISPATCH();
 
-        case AKL_IR_JMP:
-            lt = OPERAND(0, label);
-            ir = lt->la_ir;
-            ip = lt->la_branch;
-        break;
+    INSTR(AKL_IR_JMP):
+        JUMP_TO(OPERAND(0, ui_num));
+        DISPATCH();
 
-        case AKL_IR_JT:
-            lt = OPERAND(0, label);
-            v = akl_stack_pop(ctx);
-            /* TODO: Error on other types */
-            if (AKL_IS_TRUE(v)) {
-                ir = lt->la_ir;
-                ip = lt->la_branch;
-            } else {
-                MOVE_IP(ip);
-            }
-        break;
+    INSTR(AKL_IR_JT):
+        v = akl_stack_pop(ctx);
+        /* TODO: Error on other types */
+        if (AKL_IS_TRUE(v)) {
+            JUMP_TO(OPERAND(0, ui_num));
+        }
+        DISPATCH();
 
-        case AKL_IR_JN:
-            ln = OPERAND(0, label);
-            v = akl_stack_pop(ctx);
-            /* TODO: Error on other types */
-            if (AKL_IS_NIL(v)) {
-                ir = ln->la_ir;
-                ip = ln->la_branch;
-            } else {
-                MOVE_IP(ip);
-            }
-        break;
+    INSTR(AKL_IR_JN):
+        v = akl_stack_pop(ctx);
+        /* TODO: Error on other types */
+        if (AKL_IS_NIL(v)) {
+            JUMP_TO(OPERAND(0, ui_num));
+        }
+        DISPATCH();
+
+    INSTR(AKL_IR_BRANCH):
+        v = akl_stack_pop(ctx);
+        /* TODO: Error on other types */
+        if (AKL_IS_NIL(v)) {
+            JUMP_TO(OPERAND(1, ui_num));
+        } else {
+            JUMP_TO(OPERAND(0, ui_num));
+        }
+        DISPATCH();
 
-        case AKL_IR_BRANCH:
-            lt = OPERAND(0, label);
-            ln = OPERAND(0, label);
-            v = akl_stack_pop(ctx);
-            /* TODO: Error on other types */
-            if (AKL_IS_NIL(v)) {
-                ir = ln->la_ir;
-                ip = ln->la_branch;
-            } else {
-                ir = lt->la_ir;
-                ip = lt->la_branch;
-            }
-        break;
+    INSTR(AKL_IR_RET):
+        /* The return value is on the top of the stack */
+        return;
 
-        case AKL_IR_RET:
-            /* TODO */
-            MOVE_IP(ip);
-        break;
+    INSTR(AKL_IR_TCALL):
+        var = AKL_IR_CACHED_VAR(s, in, OPERAND(0, symbol));
+        fn  = akl_var_is_function(var) ? akl_var_to_function(var) : NULL;
+        /* Only user functions can reuse the frame, the others
+          (and the errors) are handled by an ordinary call */
+        if (fn == NULL || fn->fn_type != AKL_FUNC_USER)
+            goto generic_call;
+
+        SAFE_POINT();
+        /* Replace the current frame with the new arguments */
+        argc = OPERAND(1, ui_num);
+        sp   = akl_vector_count(stack);
+        if (sp - ctx->cx_frame_base < argc)
+            goto generic_call;
+        memmove(&AKL_STACK_AT(stack, ctx->cx_frame_base)
+                , &AKL_STACK_AT(stack, sp - argc)
+                , argc * sizeof(struct akl_value *));
+        stack->av_count    = ctx->cx_frame_base + argc;
+        ctx->cx_frame_len  = argc;
+        ctx->cx_func       = fn;
+        ctx->cx_func_name  = OPERAND(0, symbol)->sb_name;
+        ctx->cx_lex_info   = in->in_linfo;
+        /* ...and start the function from the beginning */
+        uf          = &fn->fn_body.ufun;
+        ctx->cx_ir  = &uf->uf_body;
+        code        = AKL_IR_CODE(&uf->uf_body);
+        count       = akl_vector_count(&uf->uf_body);
+        ip          = 0;
+        DISPATCH();
+
+    INSTR(AKL_IR_ADD):
+        NUMBER_OPERANDS(2);
+        OP_RESULT(2, akl_new_number_value(s, x + y));
+        DISPATCH();
+
+    INSTR(AKL_IR_SUB):
+        NUMBER_OPERANDS(2);
+        OP_RESULT(2, akl_new_number_value(s, x - y));
+        DISPATCH();
+
+    INSTR(AKL_IR_MUL):
+        NUMBER_OPERANDS(2);
+        OP_RESULT(2, akl_new_number_value(s, x * y));
+        DISPATCH();
+
+    INSTR(AKL_IR_DIV):
+        NUMBER_OPERANDS(2);
+        /* Let the builtin complain */
+        if (y == 0.0)
+            goto generic_call;
+        OP_RESULT(2, akl_new_number_value(s, x / y));
+        DISPATCH();
+
+    INSTR(AKL_IR_INC):
+        NUMBER_OPERANDS(1);
+        OP_RESULT(1, akl_new_number_value(s, y + 1));
+        DISPATCH();
+
+    INSTR(AKL_IR_DEC):
+        NUMBER_OPERANDS(1);
+        OP_RESULT(1, akl_new_number_value(s, y - 1));
+        DISPATCH();
+
+    INSTR(AKL_IR_EQ):
+        NUMBER_OPERANDS(2);
+        OP_RESULT(2, (x == y) ? AKL_TRUE : AKL_NIL);
+        DISPATCH();
+
+    INSTR(AKL_IR_NE):
+        NUMBER_OPERANDS(2);
+        OP_RESULT(2, (x != y) ? AKL_TRUE : AKL_NIL);
+        DISPATCH();
+
+    INSTR(AKL_IR_LT):
+        NUMBER_OPERANDS(2);
+        OP_RESULT(2, (x < y) ? AKL_TRUE : AKL_NIL);
+        DISPATCH();
+
+    INSTR(AKL_IR_LE):
+        NUMBER_OPERANDS(2);
+        OP_RESULT(2, (x <= y) ? AKL_TRUE : AKL_NIL);
+        DISPATCH();
+
+    INSTR(AKL_IR_GT):
+        NUMBER_OPERANDS(2);
+        OP_RESULT(2, (x > y) ? AKL_TRUE : AKL_NIL);
+        DISPATCH();
+
+    INSTR(AKL_IR_GE):
+        NUMBER_OPERANDS(2);
+        OP_RESULT(2, (x >= y) ? AKL_TRUE : AKL_NIL);
+        DISPATCH();
+
+    DISPATCH_END()
+
+unknown_instr:
+    akl_raise_error(ctx, AKL_ERROR, "Unkown instruction '%#x'", in->in_op);
+}
 
-        default:
-            akl_raise_error(ctx, AKL_ERROR, "Unkown instruction '%#x'", in->in_op);
-        return;
-        }
+/* Find the label of an instruction offset (if any) */
+static struct akl_label *
+label_at(struct akl_lisp_fun *uf, unsigned int offset)
+{
+    unsigned int i;
+    struct akl_label *l;
+    AKL_VECTOR_FOREACH(i, l, &uf->uf_labels) {
+        if (l->la_offset == offset)
+            return l;
     }
+    return NULL;
+}
+
+static int
+label_ind(struct akl_lisp_fun *uf, unsigned int offset)
+{
+    struct akl_label *l = label_at(uf, offset);
+    return (l != NULL) ? (int)l->la_ind : -1;
 }
 
 static void
-dump_jmp(struct akl_state *s, const char *jname, struct akl_ir_instruction *in)
+dump_jmp(struct akl_state *s, struct akl_lisp_fun *uf
+         , const char *jname, struct akl_ir_instruction *in)
 {
     if (AKL_IS_FEATURE_ON(s, AKL_CFG_USE_COLORS)) {
         printf("%s%s %s.L%d%s", AKL_BLUE, jname, AKL_YELLOW
-        ,OPERAND(0, label)->la_ind, AKL_END_COLOR_MARK);
+        , label_ind(uf, OPERAND(0, ui_num)), AKL_END_COLOR_MARK);
     } else {
-        printf("%s .L%d", jname, OPERAND(0, label)->la_ind);
+        printf("%s .L%d", jname, label_ind(uf, OPERAND(0, ui_num)));
+    }
+}
+
+static void
+dump_labels(struct akl_state *s, struct akl_lisp_fun *uf, unsigned int offset)
+{
+    unsigned int i;
+    struct akl_label *l;
+    /* Print every label which points to this instruction */
+    AKL_VECTOR_FOREACH(i, l, &uf->uf_labels) {
+        if (l->la_offset == offset) {
+            printf("%s.L%d:%s\n", AKL_COLORFUL(s, AKL_YELLOW)
+                                , l->la_ind, AKL_END_COLORFUL(s));
+        }
     }
 }
 
 void akl_dump_ir(struct akl_context *ctx, struct akl_function *fun)
 {
     assert(ctx);
-    struct akl_list *ir;
-    struct akl_list_entry *ent, *lit;
+    struct akl_vector *ir;
     struct akl_ir_instruction *in;
-    struct akl_label *l = NULL;
     struct akl_lisp_fun *uf = NULL;
     struct akl_symbol *sym;
     struct akl_state *s = ctx->cx_state;
-    int lind = 0;
+    unsigned int ip;
 
     if (fun->fn_type == AKL_FUNC_CFUN 
      || fun->fn_type == AKL_FUNC_SPECIAL) {
@@ -670,26 +966,10 @@ void akl_dump_ir(struct akl_context *ctx, struct akl_function *fun)
         return;
     }
     uf = &fun->fn_body.ufun;
-    l = (struct akl_label *)akl_list_head(&uf->uf_labels);
-
     ir = &uf->uf_body;
-    AKL_LIST_FOREACH(ent, ir) {
-       in = (struct akl_ir_instruction *)ent->le_data;
-       if (in == NULL)
-           break;
-
-       LOOP_WATCHDOG(ent);
+    AKL_VECTOR_FOREACH(ip, in, ir) {
        /* If this instruction is labeled, print that label first */
-       lit = akl_list_it_begin(&uf->uf_labels);
-       /* Itarate through the label's list, to find a label with
-          the same address. */
-       while ((l = akl_list_it_next(&lit)) != NULL) {
-           if (l && l->la_branch == ent) {
-               printf("%s.L%d:%s\n", AKL_COLORFUL(s, AKL_YELLOW)
-                                   , l->la_ind, AKL_END_COLORFUL(s));
-               lind++;
-           }
-       }
+       dump_labels(s, uf, ip);
 
        printf("\t");
        switch (in->in_op) {
@@ -697,37 +977,39 @@ void akl_dump_ir(struct akl_context *ctx, struct akl_function *fun)
             printf("%snop%s", AKL_COLORFUL(s, AKL_BLUE), AKL_END_COLORFUL(s));
             break;
 
-            case AKL_IR_CALL:
+            case AKL_IR_CALL: case AKL_IR_TCALL:
             sym = OPERAND(0, symbol);
             if (sym == NULL || sym->sb_name == NULL)
                 break;
 
             if (AKL_IS_FEATURE_ON(s, AKL_CFG_USE_COLORS)) {
-                printf("%scall %s%s%s, %s%d%s", AKL_BLUE, AKL_PURPLE, sym->sb_name
-                       , AKL_END_COLOR_MARK, AKL_YELLOW, OPERAND(1, ui_num), AKL_END_COLOR_MARK);
+                printf("%s%s %s%s%s, %s%d%s", AKL_BLUE, akl_ir_instruction_set[in->in_op]
+                       , AKL_PURPLE, sym->sb_name, AKL_END_COLOR_MARK
+                       , AKL_YELLOW, OPERAND(1, ui_num), AKL_END_COLOR_MARK);
             } else {
-                printf("call %s, %d", sym->sb_name, OPERAND(1, ui_num));
+                printf("%s %s, %d", akl_ir_instruction_set[in->in_op]
+                       , sym->sb_name, OPERAND(1, ui_num));
             }
             break;
 
             case AKL_IR_JMP:
-            dump_jmp(s, "jmp", in);
+            dump_jmp(s, uf, "jmp", in);
             break;
 
             case AKL_IR_JN:
-            dump_jmp(s, "jn", in);
+            dump_jmp(s, uf, "jn", in);
             break;
 
             case AKL_IR_JT:
-            dump_jmp(s, "jt", in);
+            dump_jmp(s, uf, "jt", in);
             break;
 
             case AKL_IR_BRANCH:
             if (AKL_IS_FEATURE_ON(s, AKL_CFG_USE_COLORS)) {
-                printf("%sbr %s.L%d%s, %s.L%d%s", AKL_BLUE, AKL_YELLOW, OPERAND(0, label)->la_ind
-                           , AKL_END_COLOR_MARK, AKL_YELLOW, OPERAND(1, label)->la_ind, AKL_END_COLOR_MARK);
+                printf("%sbr %s.L%d%s, %s.L%d%s", AKL_BLUE, AKL_YELLOW, label_ind(uf, OPERAND(0, ui_num))
+                           , AKL_END_COLOR_MARK, AKL_YELLOW, label_ind(uf, OPERAND(1, ui_num)), AKL_END_COLOR_MARK);
             } else {
-                printf("br .L%d, .L%d", OPERAND(0, label)->la_ind, OPERAND(1, label)->la_ind);
+                printf("br .L%d, .L%d", label_ind(uf, OPERAND(0, ui_num)), label_ind(uf, OPERAND(1, ui_num)));
             }
             break;
 
@@ -764,7 +1046,7 @@ void akl_dump_ir(struct akl_context *ctx, struct akl_function *fun)
             } else {
                 printf("push ");
             }
-            akl_print_value(ctx->cx_state, OPERAND(0, value));
+            akl_print_value(ctx->cx_state, AKL_IR_CONST(uf, OPERAND(0, ui_num)));
             break;
 
             case AKL_IR_HEAD:
@@ -779,12 +1061,26 @@ void akl_dump_ir(struct akl_context *ctx, struct akl_function *fun)
             printf("ret");
             break;
 
+            case AKL_IR_ADD: case AKL_IR_SUB: case AKL_IR_MUL:
+            case AKL_IR_DIV: case AKL_IR_INC: case AKL_IR_DEC:
+            case AKL_IR_EQ:  case AKL_IR_NE:  case AKL_IR_LT:
+            case AKL_IR_LE:  case AKL_IR_GT:  case AKL_IR_GE:
+            if (AKL_IS_FEATURE_ON(s, AKL_CFG_USE_COLORS)) {
+                printf("%s%s%s", AKL_BLUE, akl_ir_instruction_set[in->in_op]
+                       , AKL_END_COLOR_MARK);
+            } else {
+                printf("%s", akl_ir_instruction_set[in->in_op]);
+            }
+            break;
+
             default:
             akl_raise_error(ctx, AKL_ERROR, "Unknown instruction '%x'", in->in_op);
             break;
        }
        printf("\n");
     }
+    /* Labels at the very end of the function */
+    dump_labels(s, uf, ip);
 }
 
 void akl_clear_ir(struct akl_context *ctx)
@@ -792,24 +1088,20 @@ void akl_clear_ir(struct akl_context *ctx)
     if (!ctx || !ctx->cx_ir)
         return;
 
-    while (akl_list_count(ctx->cx_ir) != 0)
-        akl_list_pop(ctx->cx_ir);
+    akl_vector_truncate_by(ctx->cx_ir, akl_vector_count(ctx->cx_ir));
 }
 
 void akl_dump_stack(struct akl_context *ctx)
 {
-    struct akl_list *stack = ctx->cx_stack;
-    struct akl_value *value = NULL;
-    struct akl_list_entry *ent = akl_list_it_end(stack);
+    struct akl_vector *stack = ctx->cx_stack;
+    unsigned int sp = akl_vector_count(stack);
     int i = 0;
 
     printf("--- Stack Dump ---\n");
-    while (ent) {
+    while (sp--) {
        printf("\t%s%%%d%s - ", AKL_COLORFUL(ctx->cx_state, AKL_BRIGHT_YELLOW)
                            , i, AKL_END_COLORFUL(ctx->cx_state));
-       value = AKL_ENTRY_VALUE(ent);
-       akl_print_value(ctx->cx_state, value);
-       akl_list_it_prev(&ent);
+       akl_print_value(ctx->cx_state, AKL_STACK_AT(stack, sp));
        printf("\n");
        i++;
     }
@@ -817,7 +1109,8 @@ void akl_dump_stack(struct akl_context *ctx)
 
 void akl_execute_ir(struct akl_context *ctx)
 {
-    akl_ir_exec_branch(ctx, AKL_LIST_FIRST(ctx->cx_ir));
+    AKL_ASSERT(ctx && ctx->cx_comp_func, AKL_NOTHING);
+    akl_ir_exec_branch(ctx, &ctx->cx_comp_func->fn_body.ufun, 0);
 }
 
 void akl_execute(struct akl_context *ctx)
@@ -825,12 +1118,25 @@ void akl_execute(struct akl_context *ctx)
     AKL_ASSERT(ctx && ctx->cx_state && ctx->cx_fn_main, AKL_NOTHING);
     struct akl_function *mf = ctx->cx_fn_main;
     struct akl_lisp_fun *mfir = &mf->fn_body.ufun;
+    struct akl_value *v;
+    unsigned int base;
     ctx->cx_state->ai_interrupted = FALSE;
     //struct akl_value *v = akl_get_global_value(ctx->cx_state, "*args*");
-    //ctx->cx_stack = &ctx->cx_state->ai_stack;
     //akl_frame_push(ctx,  AKL_NULLER(v));
-    ctx->cx_stack = akl_new_list(ctx->cx_state);
-    akl_ir_exec_branch(ctx, AKL_LIST_FIRST(&mfir->uf_body));
+    if (ctx->cx_stack == NULL) {
+        ctx->cx_stack = &ctx->cx_state->ai_stack;
+    }
+    /* The program runs on the top of the (possibly already used) stack */
+    base = akl_vector_count(ctx->cx_stack);
+    ctx->cx_frame_base = base;
+    ctx->cx_frame_len  = 0;
+    akl_ir_exec_branch(ctx, mfir, 0);
+    /* Only leave the last value for the caller */
+    if (akl_vector_count(ctx->cx_stack) > base) {
+        v = akl_stack_top(ctx);
+        akl_stack_truncate(ctx, base);
+        akl_stack_push(ctx, v);
+    }
 }
 
 struct akl_value *
@@ -839,10 +1145,10 @@ akl_exec_eval(struct akl_state *s)
     struct akl_context *ctx = akl_compile(s, s->ai_device);
     akl_execute(ctx);
     akl_print_errors(s);
-    return akl_stack_pop(&s->ai_context);
+    return akl_stack_pop(ctx);
 }
 
-static int compare_numbers(long n1, long n2)
+static int compare_numbers(double n1, double n2)
 {
     if (n1 == n2)
         return 0;
@@ -860,11 +1166,12 @@ int akl_compare_values(void *c1, void *c2)
     struct akl_value *v1 = (struct akl_value *)c1;
     struct akl_value *v2 = (struct akl_value *)c2;
     struct akl_list *l1, *l2;
-    struct akl_list_entry *e1, *e2;
+    struct akl_list_iter e1, e2;
+    struct akl_fvector *fv1, *fv2;
     long l1c, l2c, r;
 
-    if (v1->va_type == v2->va_type) {
-        switch (v1->va_type) {
+    if (AKL_TYPE(v1) == AKL_TYPE(v2)) {
+        switch (AKL_TYPE(v1)) {
             case AKL_VT_NUMBER:
             return compare_numbers(AKL_GET_NUMBER_VALUE(v1)
                                    , AKL_GET_NUMBER_VALUE(v2));
@@ -876,10 +1183,15 @@ int akl_compare_values(void *c1, void *c2)
                 return -1;
             return strcmp(a, b);
 
+            case AKL_VT_HASH:
+            /* Hash tables are only equal to themselves */
+            return compare_numbers((uintptr_t)v1->va_value.hash
+                                   , (uintptr_t)v2->va_value.hash);
+
             case AKL_VT_SYMBOL:
             /* Symbols only differ by their pointers */
-            return compare_numbers((long)v1->va_value.symbol
-                                   , (long)v2->va_value.symbol);
+            return compare_numbers((uintptr_t)v1->va_value.symbol
+                                   , (uintptr_t)v2->va_value.symbol);
 
             case AKL_VT_USERDATA:
             /* TODO: userdata compare function */
@@ -897,23 +1209,49 @@ int akl_compare_values(void *c1, void *c2)
             l2 = AKL_GET_LIST_VALUE(v2);
             l1c = akl_list_count(l1); 
             l2c = akl_list_count(l2); 
-            e1 = akl_list_it_begin(l1);
-            e2 = akl_list_it_begin(l2);
-            v1 = v2 = NULL;
-
-            while (1) {
-                if (akl_list_it_has_next(e1)) {
-                    v1 = akl_list_it_next(&e1); 
-                }
-                if (akl_list_it_has_next(e2)) {
-                    v2 = akl_list_it_next(&e1); 
-                }
+            akl_list_iter_init(&e1, l1);
+            akl_list_iter_init(&e2, l2);
+            /* Compare element-wise, the shorter list is the lesser */
+            while ((v1 = akl_list_iter_next(&e1)) != NULL
+                   && (v2 = akl_list_iter_next(&e2)) != NULL) {
                 r = akl_compare_values(v1, v2);
                 if (r != 0) {
-                    break;
+                    return r;
                 }
             }
-            return r;
+            return compare_numbers(l1c, l2c);
+
+            case AKL_VT_CONS:
+            /* Walk the pairs, the different ends are compared at last */
+            while (AKL_CHECK_TYPE(v1, AKL_VT_CONS) && AKL_CHECK_TYPE(v2, AKL_VT_CONS)) {
+                r = akl_compare_values(v1->va_value.cons->cs_car
+                                      , v2->va_value.cons->cs_car);
+                if (r != 0) {
+                    return r;
+                }
+                v1 = v1->va_value.cons->cs_cdr;
+                v2 = v2->va_value.cons->cs_cdr;
+            }
+            /* The shorter one is the lesser */
+            if (AKL_IS_NIL(v1) && AKL_IS_NIL(v2))
+                return 0;
+            if (AKL_IS_NIL(v1))
+                return -1;
+            if (AKL_IS_NIL(v2))
+                return 1;
+            return akl_compare_values(v1, v2);
+
+            case AKL_VT_FVECTOR:
+            fv1 = AKL_GET_FVECTOR_VALUE(v1);
+            fv2 = AKL_GET_FVECTOR_VALUE(v2);
+            l1c = AKL_FVECTOR_COUNT(fv1);
+            l2c = AKL_FVECTOR_COUNT(fv2);
+            for (r = 0; r < l1c && r < l2c; r++) {
+                if (AKL_FVECTOR_DATA(fv1)[r] != AKL_FVECTOR_DATA(fv2)[r])
+                    return compare_numbers(AKL_FVECTOR_DATA(fv1)[r]
+                                           , AKL_FVECTOR_DATA(fv2)[r]);
+            }
+            return compare_numbers(l1c, l2c);
 
             default:
             break;
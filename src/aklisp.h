@@ -30,6 +30,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <math.h>
 #include "akl_tree.h"
 
 #ifndef AKL_MALLOC
@@ -44,8 +46,32 @@
 # define AKL_STRDUP(str) strdup(str)
 #endif // AKL_STRDUP
 
-#define AKL_CHECK_TYPE(v1, type) (((v1) && (v1)->va_type == (type)) ? TRUE : FALSE)
-#define AKL_TYPE(value) (value->va_type)
+/*
+ * Immediate values: integral numbers, which fit into a (tagged)
+ * pointer, are not allocated at all. Their lowest bit is set, which
+ * is never the case for a real 'struct akl_value *'. Nil and true
+ * are singletons (AKL_NIL and AKL_TRUE). Immediates have no lexical
+ * information and must not be modified, so only access the values
+ * through these macros.
+*/
+#define AKL_FIXNUM_TAG        ((uintptr_t)1)
+#define AKL_FIXNUM_MAX        ((intptr_t)1 << (sizeof(intptr_t)*8 - 3))
+#define AKL_IS_FIXNUM(val)    (((uintptr_t)(val)) & AKL_FIXNUM_TAG)
+/* -0.0 stays boxed, a fixnum would lose its sign */
+#define AKL_FIXNUM_FITS(num)  ((num) > -AKL_FIXNUM_MAX && (num) < AKL_FIXNUM_MAX \
+                               && (double)(intptr_t)(num) == (num)          \
+                               && !((num) == 0 && signbit(num)))
+#define AKL_MAKE_FIXNUM(num)  ((struct akl_value *) \
+                               (((uintptr_t)(intptr_t)(num) << 1) | AKL_FIXNUM_TAG))
+#define AKL_FIXNUM_VALUE(val) ((intptr_t)(val) >> 1)
+#define AKL_IS_IMMEDIATE(val) (AKL_IS_FIXNUM(val) || (val) == AKL_NIL || (val) == AKL_TRUE)
+
+#define AKL_TYPE(value) (AKL_IS_FIXNUM(value) ? AKL_VT_NUMBER : (value)->va_type)
+#define AKL_CHECK_TYPE(v1, type) (((v1) && AKL_TYPE(v1) == (type)) ? TRUE : FALSE)
+#define AKL_LEX_INFO(value) (AKL_IS_FIXNUM(value) ? NULL : (value)->va_lex_info)
+/* Immediates have no position, the context keeps the last known one */
+#define AKL_SET_LEX_INFO(ctx, value) \
+    do { if (!AKL_IS_IMMEDIATE(value)) (ctx)->cx_lex_info = (value)->va_lex_info; } while (0)
 #define AKL_GET_VALUE_MEMBER_PTR(val, type, member) \
                             ((AKL_CHECK_TYPE(val, type) \
                             ? (val)->va_value.member : NULL))
@@ -54,10 +80,17 @@
                             ((AKL_CHECK_TYPE(val, type) \
                             ? (val)->va_value.member : 0))
 
-#define AKL_GET_NUMBER_VALUE(val) (AKL_GET_VALUE_MEMBER(val, AKL_VT_NUMBER, number))
+#define AKL_GET_NUMBER_VALUE(val) (AKL_IS_FIXNUM(val) ? (double)AKL_FIXNUM_VALUE(val) \
+                                  : AKL_GET_VALUE_MEMBER(val, AKL_VT_NUMBER, number))
 #define AKL_GET_STRING_VALUE(val) (AKL_GET_VALUE_MEMBER_PTR(val, AKL_VT_STRING, string))
 #define AKL_GET_LIST_VALUE(val) (AKL_GET_VALUE_MEMBER_PTR(val, AKL_VT_LIST, list))
+#define AKL_GET_SYMBOL_VALUE(val) (AKL_GET_VALUE_MEMBER_PTR(val, AKL_VT_SYMBOL, symbol))
+#define AKL_GET_FUNCTION_VALUE(val) (AKL_GET_VALUE_MEMBER_PTR(val, AKL_VT_FUNCTION, func))
+#define AKL_GET_CONS_VALUE(val) (AKL_GET_VALUE_MEMBER_PTR(val, AKL_VT_CONS, cons))
+#define AKL_GET_HASH_VALUE(val) (AKL_GET_VALUE_MEMBER_PTR(val, AKL_VT_HASH, hash))
+#define AKL_GET_FVECTOR_VALUE(val) (AKL_GET_VALUE_MEMBER_PTR(val, AKL_VT_FVECTOR, fvector))
 #define AKL_STACK_SIZE 32
+#define AKL_SYMTAB_SIZE 256 /* Initial size of the symbol table (power of two) */
 #define AKL_SET_FEATURE(state, feature) ((state)->ai_config |= (feature))
 #define AKL_UNSET_FEATURE(state, feature) ((state)->ai_config &= ~(feature))
 #define AKL_IS_FEATURE_ON(state, feature) ((state) && ((state)->ai_config & (feature)))
@@ -83,6 +116,7 @@ struct akl_value;
 struct akl_io_device;
 struct akl_state;
 struct akl_vector;
+struct akl_fvector;
 struct akl_function;
 struct akl_context;
 
@@ -96,7 +130,10 @@ enum AKL_VALUE_TYPE {
     AKL_VT_STRING,
     AKL_VT_LIST,
     AKL_VT_FUNCTION,
-    AKL_VT_USERDATA
+    AKL_VT_USERDATA,
+    AKL_VT_CONS,
+    AKL_VT_HASH,
+    AKL_VT_FVECTOR
 };
 
 /* Used in type specifiers */
@@ -118,7 +155,7 @@ typedef enum {
     tQUOTE
 } akl_token_t;
 
-extern const char *akl_type_name[10];
+extern const char *akl_type_name[13];
 
 typedef enum { FALSE, TRUE } bool_t;
 typedef enum { DEVICE_FILE, DEVICE_STRING } device_type_t;
@@ -129,29 +166,50 @@ typedef struct akl_function *(*akl_sfun_t)(struct akl_context *);
 typedef unsigned int akl_utype_t;
 typedef unsigned char akl_byte_t;
 typedef int (*akl_cmp_fn_t)(void *, void *);
+/* Sort order: TRUE, when the first value must be before the second */
+typedef bool_t (*akl_less_fn_t)(void *, struct akl_value *, struct akl_value *);
 
 #ifndef __unused
 #define __unused __attribute__((unused))
 #endif // __unused
 
-#define AKL_IS_NIL(type)    ((type) == NULL || (type)->is_nil)
-#define AKL_IS_QUOTED(type) ((type)->is_quoted)
+#define AKL_IS_NIL(type)    ((type) == NULL || (!AKL_IS_FIXNUM(type) && (type)->is_nil))
+#define AKL_IS_QUOTED(type) (!AKL_IS_FIXNUM(type) && (type)->is_quoted)
 #define AKL_IS_TRUE(type)   (!AKL_IS_NIL(type))
 /*
  * This section contains the most important data structures
  * for the mark-and-sweep garbage collector.
  */
-/* Size of the GC pools, must be the power of 2 */
-#define AKL_GC_POOL_SIZE 64
+/* Size (and alignment) of the GC pools in bytes, must be the power of 2
+  and a multiple of the page size */
+#ifndef AKL_GC_POOL_BYTES
+#define AKL_GC_POOL_BYTES 65536
+#endif
+/* Maximal number of objects in a pool (size of the bitmaps) */
+#define AKL_GC_POOL_MAX_OBJS 4096
+#define AKL_GC_BITMAP_WORDS (AKL_GC_POOL_MAX_OBJS/64)
+/* Default heap growth policy: collect, when the allocated bytes
+  reach AKL_GC_GROWTH percent of the bytes survived the last
+  collection, but not before AKL_GC_MIN_HEAP bytes were allocated */
+#define AKL_GC_GROWTH   100
+#define AKL_GC_MIN_HEAP (256*1024)
+/* Bytes allocated between two minor collections (0 disables them) */
+#define AKL_GC_NURSERY  (1024*1024)
+/* Incremental marking: a step is done after every AKL_GC_STEP_BYTES
+  allocated bytes, it marks AKL_GC_MARK_RATE percent of them */
+#define AKL_GC_STEP_BYTES (64*1024)
+#define AKL_GC_MARK_RATE  200
+/* Pause time histogram: a pause of T microseconds is counted in the
+  bucket log2(T), the last bucket counts every longer pause */
+#define AKL_GC_PAUSE_BUCKETS 20
 #define AKL_GC_DEFINE_OBJ       struct akl_gc_object gc_obj
-#define AKL_GC_SET_MARK(obj, m) ((obj)->gc_obj.gc_mark = m)
 #define AKL_GC_SET_VALUE_LIST(obj) ((obj)->gc_obj.gc_le_is_obj = TRUE)
 #define AKL_GC_TYPE_ID(obj)     ((obj)->gc_obj.gc_type_id)
-#define AKL_GC_IS_MARKED(obj)   ((obj)->gc_obj.gc_mark == TRUE)
+/* For objects, which are not allocated by the GC (embedded or static) */
 #define AKL_GC_SET_STATIC(obj)  ((obj)->gc_obj.gc_static = TRUE)
 #define AKL_GC_INIT_OBJ(obj, id) \
     (obj)->gc_obj.gc_type_id = id; (obj)->gc_obj.gc_static = FALSE; \
-    (obj)->gc_obj.gc_mark = FALSE ; (obj)->gc_obj.gc_le_is_obj = FALSE;
+    (obj)->gc_obj.gc_le_is_obj = FALSE;
 
 /* GC'd object's finalizer */
 typedef void (*akl_gc_destructor_t)(struct akl_state *, void *obj);
@@ -164,10 +222,10 @@ typedef void (*akl_gc_marker_t)(struct akl_state *, void *, bool_t);
 typedef unsigned int akl_gc_type_t;
 struct akl_gc_object {
     akl_gc_type_t       gc_type_id;
-    bool_t              gc_mark      : 1;
     /* Are the le_data field points to a GC-managed object? (Mostly used
      * for akl_list_entry structures) */
     bool_t              gc_le_is_obj : 1;
+    /* Not in a GC pool, never freed (the mark bits are in the pools) */
     bool_t              gc_static    : 1;
 };
 
@@ -188,6 +246,10 @@ struct akl_list {
     struct akl_list_entry *li_head;
     struct akl_list_entry *li_last;
     struct akl_list       *li_parent; /* Parent (container) list */
+    /* A packed (data) list holds its values in an array, without
+      entries (see akl_new_data_list() and list.c) */
+    struct akl_value     **li_elems;
+    unsigned int           li_cap;    /* Size of li_elems */
     unsigned int           li_count;
     bool_t                 is_quoted : 1;
 /* Yep element count == 0 can simply mean NIL, but
@@ -195,7 +257,37 @@ struct akl_list {
     bool_t                 is_nil    : 1;
 };
 
+/*
+ * An immutable pair. The cons lists are chains of them, ending with
+ * nil (their cdr is the value of the next pair). The tails are shared,
+ * so walking a cons list with cdr allocates nothing.
+*/
+struct akl_cons {
+    AKL_GC_DEFINE_OBJ;
+    struct akl_value *cs_car;
+    struct akl_value *cs_cdr;
+};
+
+/* A slot of a hash table, it is empty when hs_key is NULL */
+struct akl_hash_slot {
+    struct akl_value *hs_key;
+    struct akl_value *hs_value;
+    unsigned int      hs_hash;  /* Hash of the key */
+};
+
+/*
+ * Hash table with value keys and open addressing (see hash.c).
+ * The slots are not GC objects, they are freed with the table.
+*/
+struct akl_hash {
+    AKL_GC_DEFINE_OBJ;
+    struct akl_hash_slot *ht_slots;
+    unsigned int          ht_cap;   /* Number of slots (a power of two) */
+    unsigned int          ht_count; /* Number of the used slots */
+};
+
 struct akl_userdata {
+    AKL_GC_DEFINE_OBJ;
     unsigned int ud_id;      /* Exact user type identifer */
     void        *ud_private; /* Arbitrary userdata */
 };
@@ -217,6 +309,9 @@ extern struct akl_value {
         struct akl_function *func;
         struct akl_userdata *udata;
 		struct akl_list     *list;
+        struct akl_cons     *cons;
+        struct akl_hash     *hash;
+        struct akl_fvector  *fvector;
     } va_value;
 
     bool_t                   is_quoted : 1;
@@ -232,13 +327,21 @@ struct akl_symbol {
      * You can simply compare two symbols by their pointers.
      */
     RB_ENTRY(akl_symbol)    sb_entry;
+    unsigned int            sb_id;     /* Dense index, the slot of the global variable */
+    unsigned int            sb_hash;   /* Hash of the (case folded) name */
     /* We must know the the constness of the name. */
     bool_t                  sb_is_cdef : 1;
 };
 
+/* Symbol names are case insensitive, so is their (FNV-1a) hash */
+#define AKL_HASH_INIT 2166136261U
+#define AKL_HASH_STEP(h, ch) (((h) ^ (unsigned char)tolower(ch)) * 16777619U)
+unsigned int akl_hash_name(const char *);
+
 struct akl_symbol *akl_new_symbol(struct akl_state *, char *, bool_t);
 struct akl_symbol *akl_get_symbol(struct akl_state *s, char *name);
 struct akl_symbol *akl_get_or_create_symbol(struct akl_state *s, char *name);
+struct akl_symbol *akl_get_or_create_symbol_hash(struct akl_state *s, char *name, unsigned int hash);
 
 struct akl_variable {
     AKL_GC_DEFINE_OBJ;
@@ -268,6 +371,7 @@ struct akl_io_device {
     unsigned int      iod_char_count;
     unsigned int      iod_line_count;
     unsigned int      iod_column;
+    unsigned int      iod_hash;    /* Hash of the last atom in the buffer */
     akl_token_t       iod_backlog; /* akl_lex_putback() will put the token to here */
 };
 
@@ -282,12 +386,13 @@ void akl_init_frame(struct akl_context *, int argc);
 struct akl_context {
     /* Current context for different entities */
     struct akl_state        *cx_state;     /* Current state */
-    struct akl_list         *cx_stack;     /* Pointer to the current stack (probably '&cx_state->ai_stack') */
-    struct akl_list         *cx_ir;        /* The current Internal Representation */
+    struct akl_vector       *cx_stack;     /* Pointer to the current stack (probably '&cx_state->ai_stack') */
+    struct akl_vector       *cx_ir;        /* The current Internal Representation */
     struct akl_function     *cx_func;      /* The called function's descriptor */
     struct akl_context      *cx_parent;    /* Parent context pointer */
-    struct akl_list         *cx_frame;     /* Frame info used by executor (push) */
-    unsigned int             cx_frame_len; /* Length of the frame */
+    unsigned int             cx_frame_base; /* Stack index of the first argument */
+    unsigned int             cx_frame_len;  /* Length of the frame */
+    unsigned int             cx_depth;      /* Position on the frame stack */
 
     const char           *cx_func_name; /* The called function's name */
     struct akl_function  *cx_comp_func; /* The function under compilation */
@@ -309,6 +414,10 @@ struct akl_utype {
     const char         *ut_name;   /* Name of this utype */
     akl_utype_t         ut_id;     /* ID of this utype */
     akl_gc_destructor_t ut_de_fun; /* Destructor function, called by the GC on finialization */
+    /* Marks the Lisp values referenced by the private data (can be NULL).
+      It can be called from the marker threads of the GC, so it must
+      only call akl_gc_mark_object(). */
+    akl_gc_marker_t     ut_mark_fun;
 };
 
 enum AKL_FUNCTION_TYPE {
@@ -385,6 +494,17 @@ struct akl_vector {
     struct akl_state *av_state; /* Need for memory management */
 };
 
+/*
+ * Packed vector of numbers (see fvector.c), the elements are doubles
+ * in the vector, so they are not GC objects.
+*/
+struct akl_fvector {
+    AKL_GC_DEFINE_OBJ;
+    struct akl_vector fv_vec;
+};
+#define AKL_FVECTOR_DATA(fv)  ((double *)(fv)->fv_vec.av_vector)
+#define AKL_FVECTOR_COUNT(fv) ((fv)->fv_vec.av_count)
+
 unsigned int akl_vector_size(struct akl_vector *);
 unsigned int akl_vector_count(struct akl_vector *);
 struct akl_vector *
@@ -416,14 +536,19 @@ struct akl_lisp_fun {
     struct akl_vector    uf_args;
     /* Name of the local variables */
     /* TODO: struct akl_vector   uf_locals; */
-    /* List of the instructions,
-        (li_parent is the full IR) */
-    struct akl_list      uf_body;
-    /* Start of the function */
-    struct akl_list      uf_labels;
+    /* Contiguous array of the instructions
+        (struct akl_ir_instruction) */
+    struct akl_vector    uf_body;
+    /* Constant pool, the operands of the push
+        instructions are indexes to here (struct akl_value *) */
+    struct akl_vector    uf_consts;
+    /* Labels of the function (struct akl_label) */
+    struct akl_vector    uf_labels;
     struct akl_lex_info *uf_info;
 };
 
+void akl_init_lisp_fun(struct akl_state *, struct akl_lisp_fun *);
+
 struct akl_function {
     AKL_GC_DEFINE_OBJ;
     enum AKL_FUNCTION_TYPE fn_type;
@@ -450,24 +575,66 @@ struct akl_value *
 akl_call_symbol(struct akl_context *, struct akl_context *, struct akl_symbol *, int);
 struct akl_value *
 akl_call_function(struct akl_context *, struct akl_context *, const char *, int);
+/* Bound contexts live on the frame stack, they must be given back
+  with akl_unbound_function() in LIFO order. */
 struct akl_context *
 akl_bound_function(struct akl_context *, struct akl_symbol *, struct akl_function *);
+void akl_unbound_function(struct akl_context *);
 
+/*
+ * Pools are aligned to their size (AKL_GC_POOL_BYTES), so the pool
+ * of an object is found by masking its address. The objects
+ * follow this header.
+*/
+typedef uint64_t akl_gc_bitmap_t;
 struct akl_gc_pool {
-    struct akl_vector    gp_pool;
     struct akl_gc_pool  *gp_next;
-    /* Bitmap of the free slots */
-    unsigned int         gp_freemap[AKL_GC_POOL_SIZE/(sizeof(unsigned int)*8)];
+    /* The next one on the list of the pools with free slots */
+    struct akl_gc_pool  *gp_next_free;
+    void                *gp_mem;      /* The allocated memory (the pool is aligned in it) */
+    akl_gc_type_t        gp_type_id;
+    unsigned int         gp_obj_size;
+    unsigned int         gp_cap;      /* Number of slots (set at creation) */
+    unsigned int         gp_words;    /* Number of the used bitmap words */
+    unsigned int         gp_count;    /* Number of used slots */
+    unsigned int         gp_hint;     /* The bitmap words below this are full */
+    bool_t               gp_dirty;    /* Is any bit set in gp_dirtymap? */
+    struct akl_state    *gp_state;    /* For the write barrier */
+    /* Bitmap of the used slots (slots over the capacity are always used) */
+    akl_gc_bitmap_t      gp_usemap[AKL_GC_BITMAP_WORDS];
+    /* Bitmap of the reachable objects (set by the mark phase). The
+      marks are only cleared by a major collection, so they are also
+      the old generation. */
+    akl_gc_bitmap_t      gp_markmap[AKL_GC_BITMAP_WORDS];
+    /* Old objects, which were modified since the last collection
+      (set by the write barrier) */
+    akl_gc_bitmap_t      gp_dirtymap[AKL_GC_BITMAP_WORDS];
 };
 
 struct akl_gc_type {
     akl_gc_type_t       gt_type_id;
     size_t              gt_type_size;
     akl_gc_marker_t     gt_marker_fn;
+    /* Called for the dead objects by the sweep (can be NULL) */
+    akl_gc_destructor_t gt_free_fn;
+    /* Are the pools swept right after the collection? (Otherwise
+      lazily, then gt_free_fn can only free memory.) */
+    bool_t              gt_sweep_now;
+    unsigned int        gt_pool_cap;   /* Number of objects in a new pool */
+    /* Are the new objects young? Otherwise they are allocated in the
+      old generation. A type with a nursery must use the barrier. */
+    bool_t              gt_nursery;
+    /* Are the references stored into the objects through the write
+      barrier? Then a minor collection only scans the modified old
+      objects, otherwise every old one. */
+    bool_t              gt_barrier;
+    size_t              gt_allocs;     /* Allocated objects since the start */
 
-    struct akl_gc_pool *gt_pool_last;
     unsigned int        gt_pool_count;
     struct akl_gc_pool *gt_pool_head;
+    /* The swept pools with free slots, objects are allocated from the first */
+    struct akl_gc_pool *gt_pool_free;
+    struct akl_gc_pool *gt_pool_sweep; /* The next pool to sweep (lazy sweeping) */
 };
 
 /*
@@ -495,8 +662,8 @@ int akl_get_args(struct akl_context *, int, ...);
 */
 int akl_get_args_strict(struct akl_context *, int argc, ...);
 struct akl_value *akl_frame_pop(struct akl_context *);
-double *akl_frame_pop_number(struct akl_context *);
-double *akl_frame_shift_number(struct akl_context *);
+bool_t akl_frame_pop_number(struct akl_context *, double *);
+bool_t akl_frame_shift_number(struct akl_context *, double *);
 char   *akl_frame_pop_string(struct akl_context *);
 char   *akl_frame_shift_string(struct akl_context *);
 struct akl_list *akl_frame_pop_list(struct akl_context *);
@@ -507,9 +674,14 @@ struct akl_value *akl_frame_top(struct akl_context *);
 struct akl_value *akl_frame_shift(struct akl_context *);
 struct akl_value *akl_frame_head(struct akl_context *);
 
+/* The stack is a vector of value pointers */
+#define AKL_STACK_AT(stack, ind) (((struct akl_value **)(stack)->av_vector)[ind])
 void   akl_stack_push(struct akl_context *, struct akl_value *);
 void   akl_frame_push(struct akl_context *, struct akl_value *);
 struct akl_value *akl_stack_pop(struct akl_context *);
+struct akl_value *akl_stack_top(struct akl_context *);
+void   akl_stack_truncate(struct akl_context *, unsigned int);
+void   akl_stack_clear(struct akl_context *, size_t);
 
 typedef enum {
     AKL_NM_TERMINATE, AKL_NM_TRYAGAIN, AKL_NM_RETNULL
@@ -517,34 +689,109 @@ typedef enum {
 
 akl_nomem_action_t akl_def_nomem_handler(struct akl_state *);
 
-#define AKL_GC_NR_BASE_TYPES 6
+#define AKL_GC_NR_BASE_TYPES 9
 typedef enum {
        AKL_GC_VALUE = 0,
        AKL_GC_VARIABLE,
        AKL_GC_LIST,
        AKL_GC_LIST_ENTRY,
        AKL_GC_FUNCTION,
-       AKL_GC_UDATA
+       AKL_GC_UDATA,
+       AKL_GC_CONS,
+       AKL_GC_HASH,
+       AKL_GC_FVECTOR
 } akl_gc_base_type_t;
 
+/*
+ * Memory management functions of an interpreter. Their first
+ * argument is always mc_context (e.g. an arena), the sizes of the
+ * freed and reallocated memory are given too (the old size first).
+*/
 struct akl_mem_callbacks {
-    void *(*mc_malloc_fn) (size_t);
-    void *(*mc_calloc_fn) (size_t, size_t);
-    void  (*mc_free_fn)   (void *);
-    void *(*mc_realloc_fn)(void *, size_t);
+    void *(*mc_malloc_fn) (void *, size_t);
+    void *(*mc_calloc_fn) (void *, size_t, size_t);
+    void  (*mc_free_fn)   (void *, void *, size_t);
+    void *(*mc_realloc_fn)(void *, void *, size_t, size_t);
     akl_nomem_action_t (*mc_nomem_fn)(struct akl_state *);
+    void  *mc_context;
 };
 
 extern struct akl_mem_callbacks akl_mem_std_callbacks;
+
+/* Counters of the collector (see akl_gc_get_stats()) */
+struct akl_gc_stats {
+    unsigned long       gs_minor;        /* Number of minor collections */
+    unsigned long       gs_major;        /* Number of major collections */
+    unsigned long       gs_steps;        /* Number of incremental steps */
+    unsigned long       gs_last_pause;   /* The last pause (usec) */
+    unsigned long       gs_max_pause;    /* The longest pause (usec) */
+    unsigned long long  gs_total_time;   /* Time spent in the collector (usec) */
+    unsigned long long  gs_sweep_time;   /* ... in lazy sweeping (not a pause) */
+    unsigned long       gs_pauses[AKL_GC_PAUSE_BUCKETS]; /* Pause histogram */
+    /* These are only filled by akl_gc_get_stats() */
+    size_t              gs_malloc_bytes; /* Totally malloc()'d bytes */
+    size_t              gs_heap_bytes;   /* Bytes of the GC pools */
+    unsigned int        gs_live;         /* Objects survived the last collection */
+    size_t              gs_live_bytes;   /* Bytes survived the last collection */
+};
+
+/* Counters of a GC type (see akl_gc_get_type_stats()) */
+struct akl_gc_type_stats {
+    size_t              ts_allocs;       /* Allocated objects since the start */
+    size_t              ts_used;         /* Used slots (live or not swept yet) */
+    size_t              ts_live;         /* Marked (live or old) objects */
+    size_t              ts_live_bytes;
+    unsigned int        ts_pools;        /* Number of pools */
+    size_t              ts_bytes;        /* Bytes of the pools */
+};
 void   akl_set_mem_callbacks(struct akl_state *, const struct akl_mem_callbacks *);
 
+/*
+ * Region allocator: the memory is taken from big blocks and it is
+ * only given back by akl_arena_reset() at once (in O(1), the blocks
+ * are kept for the next use). An interpreter created with its
+ * callbacks can be thrown away without a collection:
+ *   s = akl_new_state(akl_arena_callbacks(arena));
+ *   ... evaluate ...
+ *   akl_free_state(s);
+ *   akl_arena_reset(arena);
+*/
+#define AKL_ARENA_BLOCK_SIZE (512*1024)
+struct akl_arena;
+struct akl_arena *akl_arena_new(size_t);
+void   akl_arena_reset(struct akl_arena *);
+void   akl_arena_free(struct akl_arena *);
+size_t akl_arena_used(struct akl_arena *);
+const struct akl_mem_callbacks *akl_arena_callbacks(struct akl_arena *);
+
 /* An instance of the interpreter */
 struct akl_state {
     const struct akl_mem_callbacks *ai_mem_fn;
     struct akl_io_device           *ai_device;
-    RB_HEAD(SYM_TREE, akl_symbol)   ai_symbols;
-    RB_HEAD(VAR_TREE, akl_variable) ai_global_vars;
-    unsigned int                    ai_gc_malloc_size; /* Totally malloc()'d bytes */
+    RB_HEAD(SYM_TREE, akl_symbol)   ai_symbols;   /* Only for ordered traversal */
+    struct akl_symbol             **ai_symtab;    /* Symbol hash table (open addressing) */
+    unsigned int                    ai_symtab_size; /* Always a power of two */
+    RB_HEAD(VAR_TREE, akl_variable) ai_global_vars; /* Only for ordered traversal */
+    struct akl_vector               ai_global_slots; /* Global variables indexed by symbol id */
+    unsigned int                    ai_symbol_count; /* The id of the next new symbol */
+    size_t                          ai_gc_malloc_size; /* Totally malloc()'d bytes */
+    size_t                          ai_gc_allocs;      /* Bytes allocated since the last collection */
+    size_t                          ai_gc_threshold;   /* Collect after this many allocated bytes */
+    unsigned int                    ai_gc_live;        /* Objects survived the last collection */
+    size_t                          ai_gc_live_bytes;  /* Bytes survived the last collection */
+    unsigned int                    ai_gc_growth;      /* Heap growth between collections (percent) */
+    size_t                          ai_gc_min_heap;    /* Minimal bytes allocated between collections */
+    size_t                          ai_gc_nursery;     /* Bytes allocated between minor collections */
+    size_t                          ai_gc_promoted;    /* Bytes got old since the last major collection */
+    size_t                          ai_gc_major_threshold; /* Major collection after this many promoted bytes */
+    struct akl_vector               ai_gc_gray;        /* Marked objects, which children are not */
+    bool_t                          ai_gc_marking;     /* Is an incremental mark phase running? */
+    size_t                          ai_gc_step_allocs; /* ai_gc_allocs at the last incremental step */
+    unsigned int                    ai_gc_mark_rate;   /* Marked bytes per allocated bytes (percent) */
+    unsigned long                   ai_gc_max_pause;   /* Time limit of an incremental step (usec) */
+    unsigned int                    ai_gc_mark_threads; /* Threads marking in a major collection */
+    struct akl_gc_markers          *ai_gc_markers;     /* The helper threads (see gc.c) */
+    struct akl_gc_stats             ai_gc_stats;
     struct akl_vector               ai_gc_types;
 
     /* Loaded user-defined types */
@@ -552,15 +799,17 @@ struct akl_state {
     /* Currently loaded modules */
     struct akl_list                 ai_modules;
     struct akl_context              ai_context;   /* The main context  */
-    struct akl_list                 ai_stack;     /* The main stack list */
+    struct akl_vector               ai_stack;     /* The main value stack */
+    struct akl_vector               ai_frames;    /* Contexts of the called functions (reused) */
+    unsigned int                    ai_frame_depth; /* Number of used contexts in 'ai_frames' */
     struct akl_list                *ai_errors;    /* Collection of the errors (if any, default NULL) */
     #define AKL_CFG_USE_COLORS      0x0001
     #define AKL_CFG_USE_GC          0x0002
     #define AKL_CFG_INTERACTIVE     0x0004               /* Interactive interpreter */
     #define AKL_DEBUG_INSTR         0x0008
     #define AKL_DEBUG_STACK         0x0010
+    #define AKL_CFG_GC_INCREMENTAL  0x0020               /* Incremental major collections */
     unsigned long                   ai_config; /* Bit configuration */
-    bool_t                          ai_gc_last_was_mark : 1;
     bool_t                          ai_interrupted :1;  /* The program is stopped by an interrupt  */
 };
 
@@ -568,12 +817,14 @@ bool_t akl_set_feature(struct akl_state *, const char *);
 bool_t akl_set_feature_to(struct akl_state *, const char *, bool_t);
 
 struct akl_label *akl_new_branches(struct akl_state *, struct akl_context *);
-struct akl_list  *akl_new_labels(struct akl_context *, int *, int);
-struct akl_label *akl_new_label(struct akl_context *);
+struct akl_vector *akl_new_labels(struct akl_context *, int *, int);
+struct akl_label  *akl_new_label(struct akl_context *);
 
+/* Offset of a label, which is not placed yet */
+#define AKL_LABEL_UNRESOLVED ((unsigned int)-1)
 struct akl_label {
-    struct akl_list       *la_ir;
-    struct akl_list_entry *la_branch;
+    unsigned int           la_offset; /* Offset of the labeled instruction */
+    int                    la_patch;  /* Chain of the jumps waiting for this label (-1 if none) */
     unsigned               la_ind;
     char                  *la_name; // Only used when assembling
 };
@@ -591,10 +842,24 @@ typedef enum {
     AKL_IR_JN,     /* Jump if false, (not true, nil) */
     AKL_IR_HEAD,
     AKL_IR_TAIL,
-    AKL_IR_RET
+    AKL_IR_RET,
+    AKL_IR_TCALL, /* Call in tail position, reuses the caller's frame */
+    /* Builtin arithmetic and comparison (see akl_build_call()) */
+    AKL_IR_ADD,
+    AKL_IR_SUB,
+    AKL_IR_MUL,
+    AKL_IR_DIV,
+    AKL_IR_INC,
+    AKL_IR_DEC,
+    AKL_IR_EQ,
+    AKL_IR_NE,
+    AKL_IR_LT,
+    AKL_IR_LE,
+    AKL_IR_GT,
+    AKL_IR_GE
 } akl_ir_instruction_t;
 
-#define AKL_NR_INSTRUCTIONS 14
+#define AKL_NR_INSTRUCTIONS 27
 extern const char *akl_ir_instruction_set[AKL_NR_INSTRUCTIONS];
 
 typedef enum {
@@ -603,31 +868,49 @@ typedef enum {
     AKL_JMP_FALSE = AKL_IR_JN
 } akl_jump_t;
 
+/*
+ * Every instruction has the same width, a compiled function body is
+ * just a contiguous array of these. Constant operands live in the
+ * function's constant pool (uf_consts) and jumps hold the offset of
+ * the target instruction.
+*/
 struct akl_ir_instruction {
     akl_ir_instruction_t     in_op;  /* Operation */
-    /* Optional (used if the function already resolved) */
-    struct akl_function     *in_fun;
     union {
-        struct akl_value    *value;  /* Generic value (mostly used by push) */
         struct akl_symbol   *symbol; /* Name of the variable of function    */
-        struct akl_label    *label;  /* Label for the next instruction      */
-        unsigned int         ui_num; /* Stack pointer or argument count     */
+        unsigned int         ui_num; /* Argument count, jump offset, constant index
+                                        or frame offset */
     } in_arg[2];
+    /* Optional (used if the function already resolved) */
+    struct akl_function     *in_fun;
+    /* Inline cache of GET, SET and CALL: the global variable of the
+      operand symbol. Variables are never removed and rebinding
+      changes only their value, so it cannot go stale. */
+    struct akl_variable     *in_var;
     struct akl_lex_info     *in_linfo; /* Lexical information of this instruction */
 };
 
+/* Resolve (and remember) the global variable of an instruction */
+#define AKL_IR_CACHED_VAR(s, in, sym) \
+    ((in)->in_var != NULL ? (in)->in_var \
+                          : ((in)->in_var = akl_get_global_var((s), (sym))))
+
+#define AKL_IR_CODE(ir)   ((struct akl_ir_instruction *)(ir)->av_vector)
+#define AKL_IR_CONST(uf, ind) (((struct akl_value **)(uf)->uf_consts.av_vector)[ind])
+
 struct akl_function *akl_compile_list(struct akl_context *);
-void akl_build_branch(struct akl_context *, struct akl_list *, int, int);
-void akl_build_jump(struct akl_context *, akl_jump_t, struct akl_list *, int);
+void akl_build_branch(struct akl_context *, struct akl_vector *, int, int);
+void akl_build_jump(struct akl_context *, akl_jump_t, struct akl_vector *, int);
 /* Call by symbol or function */
 void akl_build_call(struct akl_context *, struct akl_symbol *, struct akl_function *, int);
-void akl_build_label(struct akl_context *, struct akl_list *, int);
+void akl_build_label(struct akl_context *, struct akl_vector *, int);
 void akl_build_set(struct akl_context *, struct akl_symbol *);
 void akl_build_get(struct akl_context *, struct akl_symbol *);
 void akl_build_load(struct akl_context *, struct akl_symbol *);
 void akl_build_push(struct akl_context *, struct akl_value *);
 void akl_build_nop(struct akl_context *);
 void akl_build_ret(struct akl_context *);
+void akl_build_tail_calls(struct akl_context *);
 /* Helper functions for the Red-Black trees */
 
 /* Order symbols by name.
@@ -674,8 +957,10 @@ bool_t akl_var_is_function(struct akl_variable *);
 struct akl_function *
 akl_var_to_function(struct akl_variable *);
 
-#define AKL_LIST_FIRST(list) ((list != NULL) ? (list)->li_head : NULL)
-#define AKL_LIST_LAST(list) ((list != NULL) ? (list)->li_last : NULL)
+/* The entries of a packed list are created, when they are needed */
+#define AKL_LIST_IS_PACKED(list) ((list)->li_elems != NULL)
+#define AKL_LIST_FIRST(list) ((list != NULL) ? akl_list_linked(list)->li_head : NULL)
+#define AKL_LIST_LAST(list) ((list != NULL) ? akl_list_linked(list)->li_last : NULL)
 #define AKL_LIST_NEXT(ent) ((ent)->le_next)
 #define AKL_LIST_PREV(ent) ((ent)->le_prev)
 #define AKL_LIST_SECOND(list) (AKL_LIST_NEXT(AKL_LIST_FIRST(list)))
@@ -692,12 +977,12 @@ akl_var_to_function(struct akl_variable *);
  * }
 */
 #define AKL_LIST_FOREACH(elem, list)   \
-    for ((elem) = (list)->li_head \
+    for ((elem) = AKL_LIST_FIRST(list) \
        ; (elem)                        \
        ; (elem) = AKL_LIST_NEXT(elem))
 
 #define AKL_LIST_FOREACH_BACK(elem, list) \
-    for ((elem) = (list)->li_last     \
+    for ((elem) = AKL_LIST_LAST(list) \
        ; (elem)                           \
        ; (elem) = AKL_LIST_PREV(elem))
 
@@ -722,6 +1007,19 @@ akl_var_to_function(struct akl_variable *);
 
 #define AKL_ENTRY_VALUE(elem) (struct akl_value *)((elem) ? (elem)->le_data : NULL)
 
+/* Iterates the values of both kind of lists (and does not create
+  the entries of a packed list), usage:
+ *   struct akl_list_iter it;
+ *   akl_list_iter_init(&it, list);
+ *   while ((v = akl_list_iter_next(&it)) != NULL) ...
+*/
+struct akl_list_iter {
+    struct akl_list       *it_list;
+    struct akl_list_entry *it_ent;    /* The next entry (linked lists) */
+    unsigned int           it_ind;    /* Index of the next value */
+    bool_t                 it_packed; /* Was the list packed so far? */
+};
+
 typedef enum {
     tASM_EOF,
     tASM_WORD=tATOM,
@@ -736,7 +1034,7 @@ typedef enum {
 
 void *akl_alloc(struct akl_state *, size_t);
 void *akl_calloc(struct akl_state *, size_t, size_t);
-void *akl_realloc(struct akl_state *, void *, size_t);
+void *akl_realloc(struct akl_state *, void *, size_t, size_t);
 /* The third parameter of akl_free() is not mandatory. */
 void akl_free(struct akl_state *, void *, size_t);
 
@@ -770,7 +1068,38 @@ struct akl_list  *akl_parse(struct akl_state *);
 struct akl_value *akl_car(struct akl_list *);
 struct akl_list  *akl_cdr(struct akl_state *, struct akl_list *);
 struct akl_list  *akl_list_tail(struct akl_state *, struct akl_list *);
+struct akl_value *akl_list_to_cons(struct akl_state *, struct akl_list *);
+unsigned int      akl_cons_count(struct akl_value *);
+struct akl_value *akl_cons_index(struct akl_value *, int);
 struct akl_list_entry *akl_list_it_begin(struct akl_list *);
+
+/* Hash tables (hash.c) */
+unsigned int      akl_hash_value(struct akl_value *);
+struct akl_hash  *akl_new_hash(struct akl_state *, unsigned int);
+struct akl_value *akl_hash_get(struct akl_hash *, struct akl_value *);
+void              akl_hash_set(struct akl_state *, struct akl_hash *, struct akl_value *, struct akl_value *);
+bool_t            akl_hash_del(struct akl_state *, struct akl_hash *, struct akl_value *);
+unsigned int      akl_hash_count(struct akl_hash *);
+bool_t            akl_hash_next(struct akl_hash *, unsigned int *, struct akl_value **, struct akl_value **);
+struct akl_hash  *akl_hash_duplicate(struct akl_state *, struct akl_hash *);
+
+/* Number vectors (fvector.c) */
+void                akl_fvector_init(void);
+const char         *akl_fvector_kernels(void);
+struct akl_fvector *akl_new_fvector(struct akl_state *, unsigned int);
+struct akl_fvector *akl_fvector_from(struct akl_state *, struct akl_value *);
+double akl_fvector_sum(struct akl_fvector *);
+double akl_fvector_dot(struct akl_fvector *, struct akl_fvector *);
+bool_t akl_fvector_min(struct akl_fvector *, double *);
+bool_t akl_fvector_max(struct akl_fvector *, double *);
+void   akl_fvector_add(struct akl_fvector *, struct akl_fvector *, struct akl_fvector *);
+void   akl_fvector_mul(struct akl_fvector *, struct akl_fvector *, struct akl_fvector *);
+void   akl_fvector_scale(struct akl_fvector *, struct akl_fvector *, double);
+void   akl_fvector_less(struct akl_fvector *, struct akl_fvector *, double);
+void   akl_fvector_greater(struct akl_fvector *, struct akl_fvector *, double);
+void   akl_fvector_prefix_sum(struct akl_fvector *, struct akl_fvector *);
+void   akl_fvector_sort(struct akl_fvector *, bool_t);
+
 struct akl_list_entry *akl_list_it_end(struct akl_list *);
 bool_t akl_list_it_has_next(struct akl_list_entry *);
 bool_t akl_list_it_has_prev(struct akl_list_entry *);
@@ -784,10 +1113,12 @@ void akl_asm_parse_decl(struct akl_context *);
 /* If the memory callbacks are NULL, the standard allocation functions will be used */
 void                   akl_init_state(struct akl_state *, const struct akl_mem_callbacks *);
 struct akl_state      *akl_new_state(const struct akl_mem_callbacks *);
+void                   akl_free_state(struct akl_state *);
 struct akl_function   *akl_new_function(struct akl_state *);
 struct akl_value      *akl_new_function_value(struct akl_state *, struct akl_function *);
 void                   akl_init_list(struct akl_list *);
 struct akl_list       *akl_new_list(struct akl_state *);
+struct akl_list       *akl_new_data_list(struct akl_state *, unsigned int);
 struct akl_variable   *akl_new_variable(struct akl_state *, char *, bool_t);
 struct akl_variable   *akl_new_var(struct akl_state *, struct akl_symbol *);
 struct akl_list_entry *akl_new_list_entry(struct akl_state *);
@@ -801,6 +1132,9 @@ struct akl_value      *akl_new_symbol_value(struct akl_state *, char *, bool_t);
 struct akl_value      *akl_new_sym_value(struct akl_state *, struct akl_symbol *);
 struct akl_value      *akl_new_variable_value(struct akl_state *, char *, bool_t);
 struct akl_value      *akl_new_user_value(struct akl_state *, akl_utype_t, void *);
+struct akl_value      *akl_new_cons_value(struct akl_state *, struct akl_value *, struct akl_value *);
+struct akl_value      *akl_new_hash_value(struct akl_state *, struct akl_hash *);
+struct akl_value      *akl_new_fvector_value(struct akl_state *, struct akl_fvector *);
 struct akl_lex_info   *akl_new_lex_info(struct akl_state *, struct akl_io_device *);
 
 /* Aliases for value creation (with just the context) */
@@ -816,11 +1150,24 @@ akl_gc_type_t akl_gc_register_type(struct akl_state *, akl_gc_marker_t, size_t);
 struct akl_gc_type *akl_gc_get_type(struct akl_state *, akl_gc_type_t);
 
 void   akl_gc_mark(struct akl_state *);
+void   akl_gc_collect(struct akl_context *);
 void   akl_gc_mark_object(struct akl_state *, void *, bool_t);
-void   akl_gc_sweep_pool(struct akl_state *, struct akl_gc_pool *, akl_gc_marker_t);
+bool_t akl_gc_sweep_pool(struct akl_state *, struct akl_gc_pool *);
 void   akl_gc_sweep(struct akl_state *);
 void   akl_gc_enable(struct akl_state *);
 void   akl_gc_disable(struct akl_state *);
+void   akl_gc_set_growth(struct akl_state *, unsigned int);
+void   akl_gc_set_min_heap(struct akl_state *, size_t);
+void   akl_gc_set_nursery(struct akl_state *, size_t);
+void   akl_gc_set_mark_rate(struct akl_state *, unsigned int);
+void   akl_gc_set_max_pause(struct akl_state *, unsigned long);
+void   akl_gc_set_mark_threads(struct akl_state *, unsigned int);
+/* Call it before an object gets a new reference to another object */
+void   akl_gc_write_barrier(void *);
+struct akl_state *akl_gc_state_of(void *);
+bool_t akl_gc_set_pool_size(struct akl_state *, akl_gc_type_t, unsigned int);
+void   akl_gc_get_stats(struct akl_state *, struct akl_gc_stats *);
+bool_t akl_gc_get_type_stats(struct akl_state *, akl_gc_type_t, struct akl_gc_type_stats *);
 struct akl_gc_pool *akl_gc_pool_create(struct akl_state *, struct akl_gc_type *);
 bool_t akl_gc_pool_is_empty(struct akl_gc_pool *);
 bool_t akl_gc_tryfree(struct akl_state *);
@@ -839,6 +1186,9 @@ struct      akl_userdata *akl_get_userdata_value(struct akl_value *);
 bool_t      akl_check_user_type(struct akl_value *, akl_utype_t);
 struct akl_module *akl_get_module_descriptor(struct akl_state *, struct akl_value *);
 
+struct akl_list *akl_list_linked(struct akl_list *);
+void   akl_list_iter_init(struct akl_list_iter *, struct akl_list *);
+struct akl_value *akl_list_iter_next(struct akl_list_iter *);
 struct akl_list_entry *
     akl_list_append(struct akl_state *, struct akl_list *, void *);
 struct akl_list_entry *
@@ -868,6 +1218,7 @@ struct akl_list_entry *
        akl_list_remove(struct akl_list *, akl_cmp_fn_t, void *);
 struct akl_value *akl_duplicate_value(struct akl_state *, struct akl_value *);
 struct akl_list *akl_list_duplicate(struct akl_state *, struct akl_list *);
+void   akl_list_sort(struct akl_state *, struct akl_list *, akl_less_fn_t, void *);
 struct akl_list_entry *
        akl_list_pop_entry(struct akl_list *);
 void  *akl_list_pop(struct akl_list *);
@@ -882,6 +1233,9 @@ void   akl_eval_program(struct akl_state *);
 
 void   akl_print_value(struct akl_state *, struct akl_value *);
 void   akl_print_list(struct akl_state *, struct akl_list *);
+void   akl_print_cons(struct akl_state *, struct akl_value *);
+void   akl_print_hash(struct akl_state *, struct akl_hash *);
+void   akl_print_fvector(struct akl_state *, struct akl_fvector *);
 int    akl_compare_values(void *, void *);
 int    akl_get_typeid(struct akl_state *, const char *);
 
@@ -900,9 +1254,11 @@ void akl_clear_errors(struct akl_state *);
 void akl_print_errors(struct akl_state *);
 
 /* Create a new user type and register it for the interpreter. The returned
-  integer will identify this new type. */
+  integer will identify this new type. The destructor gets the private
+  data of the dead userdata objects, the marker gets the private data of
+  the live ones (both can be NULL). */
 unsigned int
-akl_register_type(struct akl_state *, const char *, akl_gc_destructor_t);
+akl_register_type(struct akl_state *, const char *, akl_gc_destructor_t, akl_gc_marker_t);
 void
 akl_deregister_type(struct akl_state *, unsigned int);
 
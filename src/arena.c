@@ -0,0 +1,218 @@
+/************************************************************************
+ *   Copyright (c) 2012 Ákos Kovács - AkLisp Lisp dialect
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ************************************************************************/
+#include "aklisp.h"
+
+/*
+ * Region (arena) allocator for the interpreters. The memory is
+ * given out from the current block by bumping a pointer, freeing
+ * is only possible for the last allocation. The blocks are chained
+ * and kept by akl_arena_reset(), so a reset only rewinds the first
+ * block, the others are rewound when they become current again.
+*/
+
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1))
+
+struct akl_arena_block {
+    struct akl_arena_block *ab_next;
+    size_t                  ab_size;   /* Usable bytes after the header */
+    size_t                  ab_used;
+};
+
+#define BLOCK_HEADER_SIZE ARENA_ROUND(sizeof(struct akl_arena_block))
+#define BLOCK_DATA(b)     ((char *)(b) + BLOCK_HEADER_SIZE)
+
+struct akl_arena {
+    struct akl_mem_callbacks ar_callbacks; /* Their context is the arena */
+    struct akl_arena_block  *ar_first;
+    struct akl_arena_block  *ar_cur;       /* Allocate from this block */
+    size_t                   ar_block_size;
+    size_t                   ar_used;      /* Bytes given out since the reset */
+    void                    *ar_last;      /* The last allocation (in ar_cur) */
+};
+
+static struct akl_arena_block *
+arena_new_block(size_t size)
+{
+    struct akl_arena_block *b = (struct akl_arena_block *)
+                                malloc(BLOCK_HEADER_SIZE + size);
+    if (b == NULL)
+        return NULL;
+    b->ab_next = NULL;
+    b->ab_size = size;
+    b->ab_used = 0;
+    return b;
+}
+
+static void *
+arena_malloc(void *ctx, size_t size)
+{
+    struct akl_arena *ar = (struct akl_arena *)ctx;
+    struct akl_arena_block *b = ar->ar_cur;
+    struct akl_arena_block *nb;
+
+    size = ARENA_ROUND(size ? size : 1);
+    while (b->ab_used + size > b->ab_size) {
+        /* The kept blocks are reused, but the too small ones
+          are skipped by putting a new block before them */
+        nb = b->ab_next;
+        if (nb == NULL || nb->ab_size < size) {
+            nb = arena_new_block(size > ar->ar_block_size
+                                 ? size : ar->ar_block_size);
+            if (nb == NULL)
+                return NULL;
+            nb->ab_next = b->ab_next;
+            b->ab_next  = nb;
+        }
+        nb->ab_used = 0;
+        ar->ar_cur = b = nb;
+    }
+    ar->ar_last  = BLOCK_DATA(b) + b->ab_used;
+    b->ab_used  += size;
+    ar->ar_used += size;
+    return ar->ar_last;
+}
+
+static void *
+arena_calloc(void *ctx, size_t nmemb, size_t size)
+{
+    /* The kept blocks are not cleared by the reset */
+    void *ptr = arena_malloc(ctx, nmemb * size);
+    if (ptr != NULL)
+        memset(ptr, 0, nmemb * size);
+    return ptr;
+}
+
+/* Only the last allocation can be given back */
+static void
+arena_free(void *ctx, void *ptr, size_t size)
+{
+    struct akl_arena *ar = (struct akl_arena *)ctx;
+    struct akl_arena_block *b = ar->ar_cur;
+    size_t off;
+    if (ptr == NULL || ptr != ar->ar_last)
+        return;
+
+    off = (char *)ptr - BLOCK_DATA(b);
+    ar->ar_used -= b->ab_used - off;
+    b->ab_used   = off;
+    ar->ar_last  = NULL;
+}
+
+/* The last allocation is resized in place, when it fits in its block */
+static void *
+arena_realloc(void *ctx, void *ptr, size_t oldsize, size_t size)
+{
+    struct akl_arena *ar = (struct akl_arena *)ctx;
+    struct akl_arena_block *b = ar->ar_cur;
+    size_t off;
+    void *nptr;
+
+    if (ptr == NULL)
+        return arena_malloc(ctx, size);
+    if (ptr == ar->ar_last) {
+        off = (char *)ptr - BLOCK_DATA(b);
+        if (off + ARENA_ROUND(size) <= b->ab_size) {
+            ar->ar_used += off + ARENA_ROUND(size) - b->ab_used;
+            b->ab_used   = off + ARENA_ROUND(size);
+            return ptr;
+        }
+    } else if (size <= oldsize) {
+        return ptr;
+    }
+    nptr = arena_malloc(ctx, size);
+    if (nptr != NULL)
+        memcpy(nptr, ptr, (oldsize < size) ? oldsize : size);
+    return nptr;
+}
+
+/**
+ * @brief Create a new arena
+ * @param block_size Size of its blocks (0 means AKL_ARENA_BLOCK_SIZE)
+ * The blocks are allocated with malloc(), the bigger allocations
+ * get a block on their own. Gives back NULL, when out of memory.
+*/
+struct akl_arena *akl_arena_new(size_t block_size)
+{
+    struct akl_arena *ar = (struct akl_arena *)malloc(sizeof(struct akl_arena));
+    if (ar == NULL)
+        return NULL;
+    ar->ar_block_size = (block_size != 0)
+                      ? ARENA_ROUND(block_size) : AKL_ARENA_BLOCK_SIZE;
+    ar->ar_first = arena_new_block(ar->ar_block_size);
+    if (ar->ar_first == NULL) {
+        free(ar);
+        return NULL;
+    }
+    ar->ar_cur  = ar->ar_first;
+    ar->ar_used = 0;
+    ar->ar_last = NULL;
+
+    ar->ar_callbacks.mc_malloc_fn  = arena_malloc;
+    ar->ar_callbacks.mc_calloc_fn  = arena_calloc;
+    ar->ar_callbacks.mc_free_fn    = arena_free;
+    ar->ar_callbacks.mc_realloc_fn = arena_realloc;
+    ar->ar_callbacks.mc_nomem_fn   = akl_def_nomem_handler;
+    ar->ar_callbacks.mc_context    = ar;
+    return ar;
+}
+
+/* Memory functions for akl_new_state() or akl_init_state() */
+const struct akl_mem_callbacks *akl_arena_callbacks(struct akl_arena *ar)
+{
+    assert(ar);
+    return &ar->ar_callbacks;
+}
+
+/*
+ * Give back every allocation of the arena at once. Nothing is
+ * finalized, so the interpreters using it must not be used anymore
+ * (akl_free_state() is still needed, to stop the GC threads).
+*/
+void akl_arena_reset(struct akl_arena *ar)
+{
+    assert(ar);
+    ar->ar_cur = ar->ar_first;
+    ar->ar_first->ab_used = 0;
+    ar->ar_used = 0;
+    ar->ar_last = NULL;
+}
+
+/* Bytes given out since the last reset */
+size_t akl_arena_used(struct akl_arena *ar)
+{
+    assert(ar);
+    return ar->ar_used;
+}
+
+void akl_arena_free(struct akl_arena *ar)
+{
+    struct akl_arena_block *b, *nb;
+    if (ar == NULL)
+        return;
+    for (b = ar->ar_first; b != NULL; b = nb) {
+        nb = b->ab_next;
+        free(b);
+    }
+    free(ar);
+}
@@ -28,7 +28,7 @@ akl_ir_set_lex_info(struct akl_context *ctx, struct akl_lex_info *info)
 {
     AKL_ASSERT(ctx && ctx->cx_ir, AKL_NOTHING);
     struct akl_ir_instruction *li =
-            (struct akl_ir_instruction *)akl_list_last(ctx->cx_ir);
+            (struct akl_ir_instruction *)akl_vector_last(ctx->cx_ir);
     if (li && info) {
         li->in_linfo = info;
     }
@@ -37,7 +37,7 @@ akl_ir_set_lex_info(struct akl_context *ctx, struct akl_lex_info *info)
 static int
 compare_symbols(void *f, void *s)
 {
-    return akl_rb_cmp_sym(f, s);
+    return *(struct akl_symbol **)f != (struct akl_symbol *)s;
 }
 
 int
@@ -48,58 +48,38 @@ argument_finder(struct akl_lisp_fun *fn, struct akl_symbol *sym)
     return i;
 }
 
+/* Append a new NOP to the end of the current IR. The caller
+  will modify it accordingly. */
 static struct akl_ir_instruction *
-new_instr(struct akl_context *ctx)
-{
-    struct akl_state *s = ctx->cx_state;
-    struct akl_list *ir = ctx->cx_ir;
-    struct akl_ir_instruction *nop = AKL_MALLOC(s, struct akl_ir_instruction);
-    nop->in_op    = AKL_IR_NOP;
-    nop->in_linfo = NULL;
-    nop->in_fun   = NULL;
-    return nop;
-}
-
-static struct akl_ir_instruction *
-create_or_get_instr(struct akl_context *ctx)
+create_instr(struct akl_context *ctx)
 {
-    struct akl_state *s = ctx->cx_state;
-    struct akl_list *ir = ctx->cx_ir;
-    struct akl_ir_instruction *instr = NULL;
-
-    /* This is the very first instruction. We have to add the this to the IR
-     * and then a NOP also. The next call will modify this operation, so
-     * we will always know the address of the next operation for reference. */
-    if (akl_list_is_empty(ir)) {
-        instr = new_instr(ctx);
-        /* Add the new instruction as the first one. */
-        akl_list_append(s, ir, instr);
-    } else {
-        /* If we already had a NOP, then just modify that accordingly.
-         * This always has to be the last one.
-        */
-        instr = (struct akl_ir_instruction *)akl_list_last(ir);
-    }
+    struct akl_ir_instruction *instr;
+    AKL_ASSERT(ctx && ctx->cx_ir, NULL);
+    instr = (struct akl_ir_instruction *)akl_vector_reserve(ctx->cx_ir);
+    instr->in_op            = AKL_IR_NOP;
+    instr->in_arg[0].ui_num = 0;
+    instr->in_arg[1].ui_num = 0;
+    instr->in_fun           = NULL;
+    instr->in_var           = NULL;
+    instr->in_linfo         = NULL;
     return instr;
 }
 
-static struct akl_ir_instruction *
-create_instr(struct akl_context *ctx)
+/* Put the value to the constant pool of the currently compiled
+  function and give back its index. */
+static unsigned int
+add_constant(struct akl_context *ctx, struct akl_value *value)
 {
-    struct akl_ir_instruction *instr, *nop;
-    instr = create_or_get_instr(ctx);
-    /* The new NOP will be always the last in the list. The next new_instr()
-     * call will have to use that as the new operation. */
-    nop = new_instr(ctx);
-    akl_list_append(ctx->cx_state, ctx->cx_ir, nop);
-    return instr;
+    struct akl_lisp_fun *uf = &ctx->cx_comp_func->fn_body.ufun;
+    return akl_vector_push(&uf->uf_consts, &value);
 }
 
 void akl_build_push(struct akl_context *ctx, struct akl_value *arg)
 {
+    unsigned int ind = add_constant(ctx, arg);
     struct akl_ir_instruction *push = create_instr(ctx);
-    push->in_op           = AKL_IR_PUSH;
-    push->in_arg[0].value = arg;
+    push->in_op            = AKL_IR_PUSH;
+    push->in_arg[0].ui_num = ind;
 }
 
 void akl_build_set(struct akl_context *ctx, struct akl_symbol *sym)
@@ -139,42 +119,118 @@ void akl_build_load(struct akl_context *ctx, struct akl_symbol *sym)
     }
 }
 
+/* These builtins have their own instructions (with the given arity) */
+extern AKL_DEFINE_FUN(plus, ctx, argc);
+extern AKL_DEFINE_FUN(minus, ctx, argc);
+extern AKL_DEFINE_FUN(mul, ctx, argc);
+extern AKL_DEFINE_FUN(ddiv, ctx, argc);
+extern AKL_DEFINE_FUN(inc, ctx, argc);
+extern AKL_DEFINE_FUN(dec, ctx, argc);
+extern AKL_DEFINE_FUN(eq, ctx, argc);
+extern AKL_DEFINE_FUN(neq, ctx, argc);
+extern AKL_DEFINE_FUN(lt, ctx, argc);
+extern AKL_DEFINE_FUN(lteq, ctx, argc);
+extern AKL_DEFINE_FUN(gt, ctx, argc);
+extern AKL_DEFINE_FUN(gteq, ctx, argc);
+
+static const struct {
+    akl_cfun_t           bo_cfun;
+    int                  bo_argc;
+    akl_ir_instruction_t bo_op;
+} builtin_ops[] = {
+    { AKL_CAT(AKL_CFUN_PREFIX, plus),  2, AKL_IR_ADD },
+    { AKL_CAT(AKL_CFUN_PREFIX, minus), 2, AKL_IR_SUB },
+    { AKL_CAT(AKL_CFUN_PREFIX, mul),   2, AKL_IR_MUL },
+    { AKL_CAT(AKL_CFUN_PREFIX, ddiv),  2, AKL_IR_DIV },
+    { AKL_CAT(AKL_CFUN_PREFIX, inc),   1, AKL_IR_INC },
+    { AKL_CAT(AKL_CFUN_PREFIX, dec),   1, AKL_IR_DEC },
+    { AKL_CAT(AKL_CFUN_PREFIX, eq),    2, AKL_IR_EQ  },
+    { AKL_CAT(AKL_CFUN_PREFIX, neq),   2, AKL_IR_NE  },
+    { AKL_CAT(AKL_CFUN_PREFIX, lt),    2, AKL_IR_LT  },
+    { AKL_CAT(AKL_CFUN_PREFIX, lteq),  2, AKL_IR_LE  },
+    { AKL_CAT(AKL_CFUN_PREFIX, gt),    2, AKL_IR_GT  },
+    { AKL_CAT(AKL_CFUN_PREFIX, gteq),  2, AKL_IR_GE  },
+};
+
+static akl_ir_instruction_t
+builtin_op(struct akl_function *fn, int argc)
+{
+    unsigned int i;
+    if (fn == NULL || fn->fn_type != AKL_FUNC_CFUN)
+        return AKL_IR_CALL;
+
+    for (i = 0; i < sizeof(builtin_ops)/sizeof(builtin_ops[0]); i++) {
+        if (builtin_ops[i].bo_cfun == fn->fn_body.cfun
+                && builtin_ops[i].bo_argc == argc)
+            return builtin_ops[i].bo_op;
+    }
+    return AKL_IR_CALL;
+}
+
+/*
+ * Calls of some builtins (with fixed arity) are compiled to their own
+ * instructions. These still remember the function and the symbol, the
+ * executor falls back to an ordinary call, when the name is rebound
+ * or the operands are not numbers.
+*/
 void akl_build_call(struct akl_context *ctx, struct akl_symbol *sym
                     , struct akl_function *fn, int argc)
 {
     struct akl_ir_instruction *call = create_instr(ctx);
-    call->in_op = AKL_IR_CALL;
+    call->in_op = builtin_op(fn, argc);
     call->in_arg[0].symbol = sym;
     /* If function already fetched, this will make things faster. */
     call->in_fun           = fn;
     call->in_arg[1].ui_num = argc;
 }
 
-void akl_build_label(struct akl_context *ctx, struct akl_list *labels, int lc)
+/*
+ * Jumps to labels, which are not placed yet, are chained together
+ * through their operands. Every link is the index of the waiting
+ * instruction and the operand's index (instr*2+operand). When the
+ * label gets its offset, the whole chain is patched.
+*/
+static void
+label_reference(struct akl_context *ctx, struct akl_label *l
+                , struct akl_ir_instruction *in, int op)
+{
+    if (l->la_offset != AKL_LABEL_UNRESOLVED) {
+        in->in_arg[op].ui_num = l->la_offset;
+    } else {
+        in->in_arg[op].ui_num = (unsigned int)l->la_patch;
+        l->la_patch = (akl_vector_count(ctx->cx_ir)-1)*2 + op;
+    }
+}
+
+void akl_build_label(struct akl_context *ctx, struct akl_vector *labels, int lc)
 {
-    struct akl_label *l = (struct akl_label *)akl_list_index(labels, lc);
-    l->la_ir = ctx->cx_ir;
-    /* Always point to the last instruction.
-     * If that doesn't exist, create a NOP as placeholder.
-    */
-    create_or_get_instr(ctx);
-    l->la_branch = AKL_LIST_LAST(ctx->cx_ir);
+    struct akl_label *l = (struct akl_label *)akl_vector_at(labels, lc);
+    struct akl_ir_instruction *code = AKL_IR_CODE(ctx->cx_ir);
+    int next;
+    /* The label always points to the next instruction (it may be
+       the end of the function). */
+    l->la_offset = akl_vector_count(ctx->cx_ir);
+    while (l->la_patch != -1) {
+        next = (int)code[l->la_patch/2].in_arg[l->la_patch%2].ui_num;
+        code[l->la_patch/2].in_arg[l->la_patch%2].ui_num = l->la_offset;
+        l->la_patch = next;
+    }
 }
 
 /* It can also mean 'jmp' if the second (the false branch is NULL) */
-void akl_build_jump(struct akl_context *ctx, akl_jump_t jt, struct akl_list *l, int lc)
+void akl_build_jump(struct akl_context *ctx, akl_jump_t jt, struct akl_vector *l, int lc)
 {
     struct akl_ir_instruction *branch = create_instr(ctx);
     branch->in_op = (akl_ir_instruction_t)jt;
-    branch->in_arg[0].label = (struct akl_label *)akl_list_index(l, lc);
+    label_reference(ctx, (struct akl_label *)akl_vector_at(l, lc), branch, 0);
 }
 
-void akl_build_branch(struct akl_context *ctx, struct akl_list *l, int lt, int lf)
+void akl_build_branch(struct akl_context *ctx, struct akl_vector *l, int lt, int lf)
 {
     struct akl_ir_instruction *branch = create_instr(ctx);
     branch->in_op = AKL_IR_BRANCH;
-    branch->in_arg[0].label = (struct akl_label *)akl_list_index(l, lt);
-    branch->in_arg[1].label = (struct akl_label *)akl_list_index(l, lf);
+    label_reference(ctx, (struct akl_label *)akl_vector_at(l, lt), branch, 0);
+    label_reference(ctx, (struct akl_label *)akl_vector_at(l, lf), branch, 1);
 }
 
 void akl_build_ret(struct akl_context *ctx)
@@ -183,6 +239,51 @@ void akl_build_ret(struct akl_context *ctx)
     ret->in_op = AKL_IR_RET;
 }
 
+/* Does the execution reach the end of the function from 'ip',
+  without doing anything else? */
+static bool_t
+is_returning(struct akl_ir_instruction *code, unsigned int count, unsigned int ip)
+{
+    unsigned int steps = 0;
+    while (ip < count && steps++ < count) {
+        switch (code[ip].in_op) {
+            case AKL_IR_RET:
+            return TRUE;
+
+            case AKL_IR_NOP:
+            ip++;
+            break;
+
+            case AKL_IR_JMP:
+            ip = code[ip].in_arg[0].ui_num;
+            break;
+
+            default:
+            return FALSE;
+        }
+    }
+    return ip >= count;
+}
+
+/*
+ * Turn every call in tail position to a 'tcall'. The value of these
+ * calls is the value of the whole function, so the callee can
+ * take over the frame of the current function. Must be called
+ * after every label of the function is placed.
+*/
+void akl_build_tail_calls(struct akl_context *ctx)
+{
+    struct akl_ir_instruction *code;
+    unsigned int ip, count;
+    AKL_ASSERT(ctx && ctx->cx_ir, AKL_NOTHING);
+    code  = AKL_IR_CODE(ctx->cx_ir);
+    count = akl_vector_count(ctx->cx_ir);
+    for (ip = 0; ip < count; ip++) {
+        if (code[ip].in_op == AKL_IR_CALL && is_returning(code, count, ip+1))
+            code[ip].in_op = AKL_IR_TCALL;
+    }
+}
+
 void akl_build_nop(struct akl_context *ctx)
 {
     struct akl_ir_instruction *nop = create_instr(ctx);
@@ -266,7 +367,7 @@ akl_compile_list(struct akl_context *cx)
         case tATOM:
             v = akl_parse_token(cx, tok, is_quoted);
             if (v) {
-                cx->cx_lex_info = v->va_lex_info;
+                AKL_SET_LEX_INFO(cx, v);
             }
             if (felem) {
                 /* Prepare lexical information for the function call */
@@ -325,15 +426,15 @@ akl_compile_list(struct akl_context *cx)
                 }
             } else {
                 /* We are run out of arguments, it's time for a function call */
-                akl_ir_set_lex_info(cx, call_info);
                 akl_build_call(cx, sym, fun, argc);
+                akl_ir_set_lex_info(cx, call_info);
             }
         return NULL;
 
         /* tNUMBER, tSTRING, tETC... */
         default:
             v = akl_parse_token(cx, tok, TRUE);
-            cx->cx_lex_info = v->va_lex_info;
+            AKL_SET_LEX_INFO(cx, v);
             akl_build_push(cx, v);
             argc++;
             break;
@@ -376,10 +477,9 @@ struct akl_context *akl_compile(struct akl_state *s, struct akl_io_device *dev)
     AKL_ASSERT(s && dev, NULL);
     struct akl_context *cx = akl_new_context(s);
     struct akl_function *f = akl_new_function(s);
-    struct akl_ir_instruction *lip;
     akl_token_t tok;
 
-    akl_init_list(&f->fn_body.ufun.uf_body);
+    akl_init_lisp_fun(s, &f->fn_body.ufun);
     f->fn_type = AKL_FUNC_USER;
     cx->cx_fn_main = f;
 
@@ -390,13 +490,6 @@ struct akl_context *akl_compile(struct akl_state *s, struct akl_io_device *dev)
     do {
         tok = akl_compile_next(cx, NULL);
     } while (tok != tEOF);
-    /* Don't need the last NOP anymore, remove it. */
-    lip = akl_list_pop(cx->cx_ir);
-    if (lip && lip->in_op != AKL_IR_NOP) {
-       /* Something is wrong if it got here. Undo everything
-          and just pretend it will be ok again.˙*/
-        akl_list_append(s, cx->cx_ir, lip);
-    }
     return cx;
 }
 
@@ -407,7 +500,7 @@ akl_asm_compile(struct akl_state *s, struct akl_io_device *dev)
 {
     akl_asm_token_t tok;
     struct akl_context *cx = akl_new_context(s);
-    cx->cx_ir = akl_new_list(s);
+    cx->cx_ir = akl_new_vector(s, 0, sizeof(struct akl_ir_instruction));
     cx->cx_dev = dev;
 
     while ((tok = akl_asm_lex(dev)) != tEOF) {
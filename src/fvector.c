@@ -0,0 +1,667 @@
+/************************************************************************
+ *   Copyright (c) 2012 Ákos Kovács - AkLisp Lisp dialect
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ************************************************************************/
+#include "aklisp.h"
+
+/*
+ * Packed vectors of numbers. The elements are doubles in an akl_vector,
+ * so the loops over them are done by kernels. With AKL_SIMD on x86
+ * the SSE2 kernels are used, or the AVX2 ones when the CPU has them
+ * (checked by akl_init_state()). Otherwise the scalar kernels are used.
+ * NOTE: The vectorized sums add in a different order, so their last
+ * bits can differ from the scalar ones.
+*/
+
+#if defined(AKL_SIMD) && defined(__GNUC__) \
+    && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+# define FV_X86 1
+# include <immintrin.h>
+#endif
+
+struct fv_kernels {
+    const char *k_name;
+    double (*k_sum)(const double *, unsigned int);
+    double (*k_dot)(const double *, const double *, unsigned int);
+    double (*k_min)(const double *, unsigned int);
+    double (*k_max)(const double *, unsigned int);
+    void   (*k_add)(double *, const double *, const double *, unsigned int);
+    void   (*k_mul)(double *, const double *, const double *, unsigned int);
+    void   (*k_scale)(double *, const double *, double, unsigned int);
+    void   (*k_less)(double *, const double *, double, unsigned int);
+    void   (*k_greater)(double *, const double *, double, unsigned int);
+    void   (*k_prefix_sum)(double *, const double *, unsigned int);
+};
+
+/* ~~~===### Scalar kernels ###===~~~ */
+static double scalar_sum(const double *a, unsigned int n)
+{
+    double r = 0;
+    unsigned int i;
+    for (i = 0; i < n; i++)
+        r += a[i];
+    return r;
+}
+
+static double scalar_dot(const double *a, const double *b, unsigned int n)
+{
+    double r = 0;
+    unsigned int i;
+    for (i = 0; i < n; i++)
+        r += a[i] * b[i];
+    return r;
+}
+
+/* The min and max kernels need at least one element */
+static double scalar_min(const double *a, unsigned int n)
+{
+    double r = a[0];
+    unsigned int i;
+    for (i = 1; i < n; i++)
+        if (a[i] < r)
+            r = a[i];
+    return r;
+}
+
+static double scalar_max(const double *a, unsigned int n)
+{
+    double r = a[0];
+    unsigned int i;
+    for (i = 1; i < n; i++)
+        if (a[i] > r)
+            r = a[i];
+    return r;
+}
+
+static void scalar_add(double *d, const double *a, const double *b, unsigned int n)
+{
+    unsigned int i;
+    for (i = 0; i < n; i++)
+        d[i] = a[i] + b[i];
+}
+
+static void scalar_mul(double *d, const double *a, const double *b, unsigned int n)
+{
+    unsigned int i;
+    for (i = 0; i < n; i++)
+        d[i] = a[i] * b[i];
+}
+
+static void scalar_scale(double *d, const double *a, double k, unsigned int n)
+{
+    unsigned int i;
+    for (i = 0; i < n; i++)
+        d[i] = a[i] * k;
+}
+
+/* The masks are 1.0 (true) or 0.0 (false), so they can be summed */
+static void scalar_less(double *d, const double *a, double x, unsigned int n)
+{
+    unsigned int i;
+    for (i = 0; i < n; i++)
+        d[i] = (a[i] < x) ? 1.0 : 0.0;
+}
+
+static void scalar_greater(double *d, const double *a, double x, unsigned int n)
+{
+    unsigned int i;
+    for (i = 0; i < n; i++)
+        d[i] = (a[i] > x) ? 1.0 : 0.0;
+}
+
+#ifndef FV_X86
+/* The SIMD kernels use the others for the tails, but not this one */
+static void scalar_prefix_sum(double *d, const double *a, unsigned int n)
+{
+    double r = 0;
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        r += a[i];
+        d[i] = r;
+    }
+}
+
+static const struct fv_kernels scalar_kernels = {
+    "scalar", scalar_sum, scalar_dot, scalar_min, scalar_max, scalar_add
+  , scalar_mul, scalar_scale, scalar_less, scalar_greater, scalar_prefix_sum
+};
+#endif
+
+#ifdef FV_X86
+/* ~~~===### SSE2 kernels (two lanes) ###===~~~ */
+static double sse2_hsum(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static double sse2_sum(const double *a, unsigned int n)
+{
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+    }
+    return sse2_hsum(_mm_add_pd(s0, s1)) + scalar_sum(a + i, n - i);
+}
+
+static double sse2_dot(const double *a, const double *b, unsigned int n)
+{
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    return sse2_hsum(_mm_add_pd(s0, s1)) + scalar_dot(a + i, b + i, n - i);
+}
+
+static double sse2_min(const double *a, unsigned int n)
+{
+    __m128d m;
+    unsigned int i = 2;
+    double r;
+    if (n < 2)
+        return scalar_min(a, n);
+    m = _mm_loadu_pd(a);
+    for (; i + 2 <= n; i += 2)
+        m = _mm_min_pd(m, _mm_loadu_pd(a + i));
+    m = _mm_min_sd(m, _mm_unpackhi_pd(m, m));
+    r = _mm_cvtsd_f64(m);
+    return (i < n && a[i] < r) ? a[i] : r;
+}
+
+static double sse2_max(const double *a, unsigned int n)
+{
+    __m128d m;
+    unsigned int i = 2;
+    double r;
+    if (n < 2)
+        return scalar_max(a, n);
+    m = _mm_loadu_pd(a);
+    for (; i + 2 <= n; i += 2)
+        m = _mm_max_pd(m, _mm_loadu_pd(a + i));
+    m = _mm_max_sd(m, _mm_unpackhi_pd(m, m));
+    r = _mm_cvtsd_f64(m);
+    return (i < n && a[i] > r) ? a[i] : r;
+}
+
+static void sse2_add(double *d, const double *a, const double *b, unsigned int n)
+{
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(d + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    scalar_add(d + i, a + i, b + i, n - i);
+}
+
+static void sse2_mul(double *d, const double *a, const double *b, unsigned int n)
+{
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(d + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    scalar_mul(d + i, a + i, b + i, n - i);
+}
+
+static void sse2_scale(double *d, const double *a, double k, unsigned int n)
+{
+    __m128d kv = _mm_set1_pd(k);
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(d + i, _mm_mul_pd(_mm_loadu_pd(a + i), kv));
+    scalar_scale(d + i, a + i, k, n - i);
+}
+
+/* The comparison gives all bits set, it selects the bits of 1.0 */
+static void sse2_less(double *d, const double *a, double x, unsigned int n)
+{
+    __m128d xv = _mm_set1_pd(x), one = _mm_set1_pd(1.0);
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(d + i, _mm_and_pd(_mm_cmplt_pd(_mm_loadu_pd(a + i), xv), one));
+    scalar_less(d + i, a + i, x, n - i);
+}
+
+static void sse2_greater(double *d, const double *a, double x, unsigned int n)
+{
+    __m128d xv = _mm_set1_pd(x), one = _mm_set1_pd(1.0);
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(d + i, _mm_and_pd(_mm_cmpgt_pd(_mm_loadu_pd(a + i), xv), one));
+    scalar_greater(d + i, a + i, x, n - i);
+}
+
+/* Scan of two lanes: [a0, a0+a1] plus the running sum */
+static void sse2_prefix_sum(double *d, const double *a, unsigned int n)
+{
+    __m128d run = _mm_setzero_pd(), v;
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        v = _mm_loadu_pd(a + i);
+        v = _mm_add_pd(v, _mm_unpacklo_pd(_mm_setzero_pd(), v));
+        v = _mm_add_pd(v, run);
+        _mm_storeu_pd(d + i, v);
+        run = _mm_unpackhi_pd(v, v);
+    }
+    if (i < n)
+        d[i] = a[i] + _mm_cvtsd_f64(run);
+}
+
+static const struct fv_kernels sse2_kernels = {
+    "sse2", sse2_sum, sse2_dot, sse2_min, sse2_max, sse2_add
+  , sse2_mul, sse2_scale, sse2_less, sse2_greater, sse2_prefix_sum
+};
+
+/* ~~~===### AVX2 kernels (four lanes) ###===~~~ */
+#define FV_AVX2 __attribute__((target("avx2")))
+
+FV_AVX2 static double avx2_hsum(__m256d v)
+{
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    return sse2_hsum(_mm_add_pd(lo, hi));
+}
+
+FV_AVX2 static double avx2_sum(const double *a, unsigned int n)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+    }
+    return avx2_hsum(_mm256_add_pd(s0, s1)) + sse2_sum(a + i, n - i);
+}
+
+FV_AVX2 static double avx2_dot(const double *a, const double *b, unsigned int n)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i)
+                                            , _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4)
+                                            , _mm256_loadu_pd(b + i + 4)));
+    }
+    return avx2_hsum(_mm256_add_pd(s0, s1)) + sse2_dot(a + i, b + i, n - i);
+}
+
+FV_AVX2 static double avx2_min(const double *a, unsigned int n)
+{
+    __m256d m;
+    __m128d h;
+    unsigned int i = 4;
+    double r;
+    if (n < 4)
+        return sse2_min(a, n);
+    m = _mm256_loadu_pd(a);
+    for (; i + 4 <= n; i += 4)
+        m = _mm256_min_pd(m, _mm256_loadu_pd(a + i));
+    h = _mm_min_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+    r = _mm_cvtsd_f64(_mm_min_sd(h, _mm_unpackhi_pd(h, h)));
+    for (; i < n; i++)
+        if (a[i] < r)
+            r = a[i];
+    return r;
+}
+
+FV_AVX2 static double avx2_max(const double *a, unsigned int n)
+{
+    __m256d m;
+    __m128d h;
+    unsigned int i = 4;
+    double r;
+    if (n < 4)
+        return sse2_max(a, n);
+    m = _mm256_loadu_pd(a);
+    for (; i + 4 <= n; i += 4)
+        m = _mm256_max_pd(m, _mm256_loadu_pd(a + i));
+    h = _mm_max_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+    r = _mm_cvtsd_f64(_mm_max_sd(h, _mm_unpackhi_pd(h, h)));
+    for (; i < n; i++)
+        if (a[i] > r)
+            r = a[i];
+    return r;
+}
+
+FV_AVX2 static void avx2_add(double *d, const double *a, const double *b, unsigned int n)
+{
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(d + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    scalar_add(d + i, a + i, b + i, n - i);
+}
+
+FV_AVX2 static void avx2_mul(double *d, const double *a, const double *b, unsigned int n)
+{
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(d + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    scalar_mul(d + i, a + i, b + i, n - i);
+}
+
+FV_AVX2 static void avx2_scale(double *d, const double *a, double k, unsigned int n)
+{
+    __m256d kv = _mm256_set1_pd(k);
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(d + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), kv));
+    scalar_scale(d + i, a + i, k, n - i);
+}
+
+FV_AVX2 static void avx2_less(double *d, const double *a, double x, unsigned int n)
+{
+    __m256d xv = _mm256_set1_pd(x), one = _mm256_set1_pd(1.0);
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(d + i, _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i)
+                                              , xv, _CMP_LT_OQ), one));
+    scalar_less(d + i, a + i, x, n - i);
+}
+
+FV_AVX2 static void avx2_greater(double *d, const double *a, double x, unsigned int n)
+{
+    __m256d xv = _mm256_set1_pd(x), one = _mm256_set1_pd(1.0);
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(d + i, _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i)
+                                              , xv, _CMP_GT_OQ), one));
+    scalar_greater(d + i, a + i, x, n - i);
+}
+
+/* The scan is bound by its dependency chain, the SSE2 one is used */
+static const struct fv_kernels avx2_kernels = {
+    "avx2", avx2_sum, avx2_dot, avx2_min, avx2_max, avx2_add
+  , avx2_mul, avx2_scale, avx2_less, avx2_greater, sse2_prefix_sum
+};
+#endif /* FV_X86 */
+
+/* Chosen by akl_init_state(), it is only accessed atomically, since
+  the interpreters of other threads store it too (the same value) */
+static const struct fv_kernels *fv_kernels = NULL;
+
+static const struct fv_kernels *fv_get_kernels(void)
+{
+    const struct fv_kernels *k = __atomic_load_n(&fv_kernels, __ATOMIC_RELAXED);
+    assert(k != NULL);
+    return k;
+}
+
+/* Choose the kernels for this CPU */
+void akl_fvector_init(void)
+{
+    const struct fv_kernels *k;
+#ifdef FV_X86
+    __builtin_cpu_init();
+    k = __builtin_cpu_supports("avx2") ? &avx2_kernels : &sse2_kernels;
+#else
+    k = &scalar_kernels;
+#endif
+    __atomic_store_n(&fv_kernels, k, __ATOMIC_RELAXED);
+}
+
+/* Name of the used kernels: "avx2", "sse2" or "scalar" (after
+  the first akl_init_state()) */
+const char *akl_fvector_kernels(void)
+{
+    return fv_get_kernels()->k_name;
+}
+
+/**
+ * @brief Create a number vector
+ * @param s An instance of the interpreter
+ * @param count Number of the elements (all of them are zero)
+*/
+struct akl_fvector *akl_new_fvector(struct akl_state *s, unsigned int count)
+{
+    struct akl_fvector *fv = (struct akl_fvector *)akl_gc_malloc(s, AKL_GC_FVECTOR);
+    AKL_GC_INIT_OBJ(fv, AKL_GC_FVECTOR);
+    akl_init_vector(s, &fv->fv_vec, count, sizeof(double));
+    fv->fv_vec.av_count = count;
+    /* Big vectors must bring the next collection closer */
+    s->ai_gc_allocs += fv->fv_vec.av_size * sizeof(double);
+    return fv;
+}
+
+/* A vector from the numbers of a list or a cons list (or NULL, if
+  there is an other value in it) */
+struct akl_fvector *akl_fvector_from(struct akl_state *s, struct akl_value *v)
+{
+    struct akl_fvector *fv;
+    struct akl_list_iter it;
+    struct akl_value *ev;
+    double *d;
+    unsigned int i = 0;
+
+    if (AKL_CHECK_TYPE(v, AKL_VT_CONS)) {
+        fv = akl_new_fvector(s, akl_cons_count(v));
+        d = AKL_FVECTOR_DATA(fv);
+        for (; AKL_CHECK_TYPE(v, AKL_VT_CONS); v = v->va_value.cons->cs_cdr) {
+            ev = v->va_value.cons->cs_car;
+            if (!AKL_CHECK_TYPE(ev, AKL_VT_NUMBER))
+                return NULL;
+            d[i++] = AKL_GET_NUMBER_VALUE(ev);
+        }
+        return fv;
+    }
+    fv = akl_new_fvector(s, akl_list_count(AKL_GET_LIST_VALUE(v)));
+    d = AKL_FVECTOR_DATA(fv);
+    akl_list_iter_init(&it, AKL_GET_LIST_VALUE(v));
+    while ((ev = akl_list_iter_next(&it)) != NULL) {
+        if (!AKL_CHECK_TYPE(ev, AKL_VT_NUMBER))
+            return NULL;
+        d[i++] = AKL_GET_NUMBER_VALUE(ev);
+    }
+    return fv;
+}
+
+double akl_fvector_sum(struct akl_fvector *fv)
+{
+    return fv_get_kernels()->k_sum(AKL_FVECTOR_DATA(fv), AKL_FVECTOR_COUNT(fv));
+}
+
+/* The vectors must have the same size */
+double akl_fvector_dot(struct akl_fvector *a, struct akl_fvector *b)
+{
+    assert(AKL_FVECTOR_COUNT(a) == AKL_FVECTOR_COUNT(b));
+    return fv_get_kernels()->k_dot(AKL_FVECTOR_DATA(a), AKL_FVECTOR_DATA(b)
+                                   , AKL_FVECTOR_COUNT(a));
+}
+
+/* Gives back FALSE for an empty vector */
+bool_t akl_fvector_min(struct akl_fvector *fv, double *res)
+{
+    if (AKL_FVECTOR_COUNT(fv) == 0)
+        return FALSE;
+    *res = fv_get_kernels()->k_min(AKL_FVECTOR_DATA(fv), AKL_FVECTOR_COUNT(fv));
+    return TRUE;
+}
+
+bool_t akl_fvector_max(struct akl_fvector *fv, double *res)
+{
+    if (AKL_FVECTOR_COUNT(fv) == 0)
+        return FALSE;
+    *res = fv_get_kernels()->k_max(AKL_FVECTOR_DATA(fv), AKL_FVECTOR_COUNT(fv));
+    return TRUE;
+}
+
+/*
+ * The element-wise operations write a vector with the size of the
+ * result (dst), it can be one of the operands too.
+*/
+void akl_fvector_add(struct akl_fvector *dst, struct akl_fvector *a, struct akl_fvector *b)
+{
+    fv_get_kernels()->k_add(AKL_FVECTOR_DATA(dst), AKL_FVECTOR_DATA(a)
+                            , AKL_FVECTOR_DATA(b), AKL_FVECTOR_COUNT(dst));
+}
+
+void akl_fvector_mul(struct akl_fvector *dst, struct akl_fvector *a, struct akl_fvector *b)
+{
+    fv_get_kernels()->k_mul(AKL_FVECTOR_DATA(dst), AKL_FVECTOR_DATA(a)
+                            , AKL_FVECTOR_DATA(b), AKL_FVECTOR_COUNT(dst));
+}
+
+void akl_fvector_scale(struct akl_fvector *dst, struct akl_fvector *a, double k)
+{
+    fv_get_kernels()->k_scale(AKL_FVECTOR_DATA(dst), AKL_FVECTOR_DATA(a)
+                              , k, AKL_FVECTOR_COUNT(dst));
+}
+
+void akl_fvector_less(struct akl_fvector *dst, struct akl_fvector *a, double x)
+{
+    fv_get_kernels()->k_less(AKL_FVECTOR_DATA(dst), AKL_FVECTOR_DATA(a)
+                             , x, AKL_FVECTOR_COUNT(dst));
+}
+
+void akl_fvector_greater(struct akl_fvector *dst, struct akl_fvector *a, double x)
+{
+    fv_get_kernels()->k_greater(AKL_FVECTOR_DATA(dst), AKL_FVECTOR_DATA(a)
+                                , x, AKL_FVECTOR_COUNT(dst));
+}
+
+void akl_fvector_prefix_sum(struct akl_fvector *dst, struct akl_fvector *a)
+{
+    fv_get_kernels()->k_prefix_sum(AKL_FVECTOR_DATA(dst), AKL_FVECTOR_DATA(a)
+                                   , AKL_FVECTOR_COUNT(dst));
+}
+
+/* ~~~===### Sorting ###===~~~ */
+/* Shorter ranges are sorted by insertion */
+#define FV_SORT_INSERTION 16
+
+static void fv_insertion_sort(double *a, unsigned int n)
+{
+    unsigned int i, j;
+    double v;
+    for (i = 1; i < n; i++) {
+        v = a[i];
+        for (j = i; j > 0 && v < a[j-1]; j--)
+            a[j] = a[j-1];
+        a[j] = v;
+    }
+}
+
+static void fv_sift_down(double *a, unsigned int root, unsigned int n)
+{
+    unsigned int child;
+    double v = a[root];
+    while ((child = 2 * root + 1) < n) {
+        if (child + 1 < n && a[child] < a[child + 1])
+            child++;
+        if (!(v < a[child]))
+            break;
+        a[root] = a[child];
+        root = child;
+    }
+    a[root] = v;
+}
+
+static void fv_heap_sort(double *a, unsigned int n)
+{
+    unsigned int i;
+    double t;
+    for (i = n / 2; i > 0; i--)
+        fv_sift_down(a, i - 1, n);
+    for (i = n - 1; i > 0; i--) {
+        t = a[0]; a[0] = a[i]; a[i] = t;
+        fv_sift_down(a, 0, i);
+    }
+}
+
+#define FV_SWAP(x, y) do { double t_ = (x); (x) = (y); (y) = t_; } while (0)
+
+/*
+ * Quicksort with a median of three pivot and Hoare partitioning. When
+ * the recursion gets too deep (bad pivots), the range is heap sorted,
+ * so the worst case is O(n log n) too.
+*/
+static void fv_introsort(double *a, unsigned int n, unsigned int depth)
+{
+    unsigned int mid;
+    int i, j;
+    double p;
+    while (n > FV_SORT_INSERTION) {
+        if (depth-- == 0) {
+            fv_heap_sort(a, n);
+            return;
+        }
+        mid = (n - 1) / 2;
+        if (a[mid] < a[0])
+            FV_SWAP(a[mid], a[0]);
+        if (a[n-1] < a[mid]) {
+            FV_SWAP(a[n-1], a[mid]);
+            if (a[mid] < a[0])
+                FV_SWAP(a[mid], a[0]);
+        }
+        p = a[mid];
+        /* The scans stop at the pivot, j ends in [0, n-2] */
+        i = -1;
+        j = n;
+        for (;;) {
+            do i++; while (a[i] < p);
+            do j--; while (p < a[j]);
+            if (i >= j)
+                break;
+            FV_SWAP(a[i], a[j]);
+        }
+        /* Recurse into the smaller part, loop on the bigger one */
+        if (j + 1 < n - (j + 1)) {
+            fv_introsort(a, j + 1, depth);
+            a += j + 1;
+            n -= j + 1;
+        } else {
+            fv_introsort(a + j + 1, n - (j + 1), depth);
+            n = j + 1;
+        }
+    }
+    fv_insertion_sort(a, n);
+}
+
+/**
+ * @brief Sort a number vector in place
+ * @param fv The vector
+ * @param descending Sort from the greatest to the least
+ * The sort is not stable, but equal numbers cannot be distinguished.
+*/
+void akl_fvector_sort(struct akl_fvector *fv, bool_t descending)
+{
+    double *a = AKL_FVECTOR_DATA(fv);
+    unsigned int n = AKL_FVECTOR_COUNT(fv), i, depth = 0;
+    for (i = n; i > 1; i >>= 1)
+        depth += 2;
+    fv_introsort(a, n, depth);
+    if (descending) {
+        for (i = 0; i < n / 2; i++)
+            FV_SWAP(a[i], a[n - 1 - i]);
+    }
+}
+
+void akl_print_fvector(struct akl_state *s, struct akl_fvector *fv)
+{
+    unsigned int i;
+    printf("<FVECTOR");
+    for (i = 0; i < AKL_FVECTOR_COUNT(fv); i++) {
+        printf(" ");
+        AKL_START_COLOR(s, AKL_YELLOW);
+        printf("%g", AKL_FVECTOR_DATA(fv)[i]);
+        AKL_END_COLOR(s);
+    }
+    printf(">");
+}
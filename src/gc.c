@@ -22,23 +22,84 @@
  ************************************************************************/
 #include <stdlib.h>
 #include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef AKL_GC_PARALLEL
+#include <pthread.h>
+#endif
 #include "aklisp.h"
 
-#define BITS_IN_UINT (sizeof(unsigned int)*8)
-#define BIT_INDEX(ptr, ind) ((ptr)[(ind)/BITS_IN_UINT])
+#define BITS_IN_WORD (sizeof(akl_gc_bitmap_t)*8)
+#define WORD_INDEX(N) ((N)/BITS_IN_WORD)
+
+#define BIT_MASK(N) ((akl_gc_bitmap_t)1 << ((N) % BITS_IN_WORD))
+#define SET_BIT(map, N) ((map)[WORD_INDEX(N)] |= BIT_MASK(N))
+#define CLEAR_BIT(map, N) ((map)[WORD_INDEX(N)] &= ~BIT_MASK(N))
+#define TEST_BIT(map, N) ((map)[WORD_INDEX(N)] & BIT_MASK(N))
+
+/* The bitmaps are processed a word at a time */
+#if defined(__GNUC__)
+# define BITMAP_CTZ(w)      __builtin_ctzll(w)
+# define BITMAP_POPCOUNT(w) __builtin_popcountll(w)
+#else
+static unsigned int BITMAP_CTZ(akl_gc_bitmap_t w)
+{
+    unsigned int n = 0;
+    while (!(w & 1)) {
+        w >>= 1;
+        n++;
+    }
+    return n;
+}
+
+static unsigned int BITMAP_POPCOUNT(akl_gc_bitmap_t w)
+{
+    unsigned int n = 0;
+    for (; w != 0; w &= w - 1)
+        n++;
+    return n;
+}
+#endif
 
-#define SET_BIT(V, N) ((V) |= (1 << (N)))
-#define CLEAR_BIT(V, N) ((V) &= ~(1 << (N)))
-#define TEST_BIT(V, N) ((V) & (1 << (N)))
-#define IS_BIT_SET(V, N) TEST_BIT(V, N)
-#define IS_BIT_NOT_SET(V, N) (!TEST_BIT(V, N))
+/* The objects follow the (aligned) header of the pool */
+#define POOL_HEADER_SIZE ((sizeof(struct akl_gc_pool) + 15) & ~(size_t)15)
+#define POOL_OBJECTS(p)  ((char *)(p) + POOL_HEADER_SIZE)
+#define POOL_SLOT(p, ind) (POOL_OBJECTS(p) + (size_t)(ind) * (p)->gp_obj_size)
+#define POOL_INDEX(p, obj) (((char *)(obj) - POOL_OBJECTS(p)) / (p)->gp_obj_size)
+#define POOL_OF(obj) \
+    ((struct akl_gc_pool *)((uintptr_t)(obj) & ~(uintptr_t)(AKL_GC_POOL_BYTES-1)))
+/* Maximal number of objects with the given size in a pool */
+#define POOL_MAX_CAP(size) \
+    (((AKL_GC_POOL_BYTES - POOL_HEADER_SIZE) / (size) > AKL_GC_POOL_MAX_OBJS) \
+     ? AKL_GC_POOL_MAX_OBJS : (AKL_GC_POOL_BYTES - POOL_HEADER_SIZE) / (size))
+
+static void *std_malloc(void *ctx, size_t size)
+{
+    return malloc(size);
+}
+
+static void *std_calloc(void *ctx, size_t nmemb, size_t size)
+{
+    return calloc(nmemb, size);
+}
+
+static void std_free(void *ctx, void *ptr, size_t size)
+{
+    free(ptr);
+}
+
+static void *std_realloc(void *ctx, void *ptr, size_t oldsize, size_t size)
+{
+    return realloc(ptr, size);
+}
 
 struct akl_mem_callbacks akl_mem_std_callbacks = {
-    .mc_malloc_fn  = malloc,
-    .mc_calloc_fn  = calloc,
-    .mc_free_fn    = free,
-    .mc_realloc_fn = realloc,
-    .mc_nomem_fn   = akl_def_nomem_handler
+    .mc_malloc_fn  = std_malloc,
+    .mc_calloc_fn  = std_calloc,
+    .mc_free_fn    = std_free,
+    .mc_realloc_fn = std_realloc,
+    .mc_nomem_fn   = akl_def_nomem_handler,
+    .mc_context    = NULL
 };
 
 void *akl_alloc(struct akl_state *s, size_t size)
@@ -50,7 +111,7 @@ void *akl_alloc(struct akl_state *s, size_t size)
             || s->ai_mem_fn->mc_malloc_fn == NULL) {
         return NULL;
     }
-    ptr = s->ai_mem_fn->mc_malloc_fn(size);
+    ptr = s->ai_mem_fn->mc_malloc_fn(s->ai_mem_fn->mc_context, size);
     s->ai_gc_malloc_size += size;
     if (ptr == NULL) {
         switch (s->ai_mem_fn->mc_nomem_fn(s)) {
@@ -75,7 +136,7 @@ void *akl_calloc(struct akl_state *s, size_t nmemb, size_t size)
             || s->ai_mem_fn->mc_calloc_fn == NULL) {
         return NULL;
     }
-    ptr = s->ai_mem_fn->mc_calloc_fn(nmemb, size);
+    ptr = s->ai_mem_fn->mc_calloc_fn(s->ai_mem_fn->mc_context, nmemb, size);
     s->ai_gc_malloc_size += size * nmemb;
     if (ptr == NULL) {
         switch (s->ai_mem_fn->mc_nomem_fn(s)) {
@@ -92,7 +153,9 @@ void *akl_calloc(struct akl_state *s, size_t nmemb, size_t size)
     return ptr;
 }
 
-void *akl_realloc(struct akl_state *s, void *ptr, size_t size)
+/* The old size of the memory is needed for the accounting
+  (like at akl_free()), only the difference is allocated */
+void *akl_realloc(struct akl_state *s, void *ptr, size_t oldsize, size_t size)
 {
     void *p;
     assert(s);
@@ -101,12 +164,11 @@ void *akl_realloc(struct akl_state *s, void *ptr, size_t size)
             || s->ai_mem_fn->mc_realloc_fn == NULL) {
         return NULL;
     }
-    p = s->ai_mem_fn->mc_realloc_fn(ptr, size);
-    s->ai_gc_malloc_size += size;
-    if (p == NULL) {
+    p = s->ai_mem_fn->mc_realloc_fn(s->ai_mem_fn->mc_context, ptr, oldsize, size);
+    if (p == NULL && size != 0) {
         switch (s->ai_mem_fn->mc_nomem_fn(s)) {
             case AKL_NM_TRYAGAIN:
-            return akl_realloc(s, ptr, size);
+            return akl_realloc(s, ptr, oldsize, size);
 
             case AKL_NM_TERMINATE:
             exit(1); // FALLTHROUGH
@@ -115,13 +177,14 @@ void *akl_realloc(struct akl_state *s, void *ptr, size_t size)
             return NULL;
         }
     }
+    s->ai_gc_malloc_size += size - oldsize;
     return p;
 }
 
 void akl_free(struct akl_state *s, void *ptr, size_t size)
 {
     if (s && s->ai_mem_fn && s->ai_mem_fn->mc_free_fn) {
-        s->ai_mem_fn->mc_free_fn(ptr);
+        s->ai_mem_fn->mc_free_fn(s->ai_mem_fn->mc_context, ptr, size);
         s->ai_gc_malloc_size -= size;
     }
 }
@@ -141,15 +204,88 @@ akl_gc_type_t akl_gc_register_type(struct akl_state *s, akl_gc_marker_t marker,
 {
     assert(s);
     struct akl_gc_type *t = (struct akl_gc_type *)akl_vector_reserve(&s->ai_gc_types);
+    assert(objsize >= sizeof(struct akl_gc_generic_object));
     t->gt_marker_fn  = marker;
+    t->gt_free_fn    = NULL;
+    t->gt_sweep_now  = FALSE;
     t->gt_pool_count = 0;
-    t->gt_pool_last  = NULL;
     t->gt_pool_head  = NULL;
+    t->gt_pool_free  = NULL;
+    t->gt_pool_sweep = NULL;
     t->gt_type_id    = s->ai_gc_types.av_count-1;
     t->gt_type_size  = objsize;
+    t->gt_pool_cap   = POOL_MAX_CAP(objsize);
+    t->gt_nursery    = FALSE;
+    t->gt_barrier    = FALSE;
+    t->gt_allocs     = 0;
     return t->gt_type_id;
 }
 
+#ifdef AKL_GC_PARALLEL
+/*
+ * Parallel marking: the gray objects are shared by the marker
+ * threads (the collecting thread and the helpers). Every marker has
+ * a private stack, which needs no locking. When it is full, or
+ * another marker is waiting for work, a part of it is moved to the
+ * shared stack (ai_gc_gray), where the idle markers take their work
+ * from. The marking ends, when every marker is idle and the shared
+ * stack is empty.
+*/
+#define GC_LOCAL_STACK 1024 /* Size of the private stacks */
+#define GC_SHARE_CHUNK 64   /* Objects taken at once from the shared stack */
+#define GC_SHARE_MIN   16   /* Smaller private stacks are not shared */
+
+struct akl_gc_worker {
+    struct akl_gc_markers *w_markers;
+    pthread_t     w_thread;
+    unsigned int  w_count;
+    unsigned int  w_live;
+    size_t        w_live_bytes;
+    void         *w_stack[GC_LOCAL_STACK];
+};
+
+struct akl_gc_markers {
+    struct akl_state *gm_state;
+    pthread_mutex_t   gm_lock;
+    pthread_cond_t    gm_start;   /* A new marking started (or quit) */
+    pthread_cond_t    gm_work;    /* New shared work (or the end) */
+    pthread_cond_t    gm_done;    /* Every helper stopped marking */
+    unsigned long     gm_phase;   /* Number of the started markings */
+    unsigned int      gm_running; /* Helpers in the current marking */
+    unsigned int      gm_idle;    /* Markers waiting for work */
+    bool_t            gm_finished;
+    bool_t            gm_quit;
+    unsigned int      gm_nthreads; /* Number of the allocated markers */
+    unsigned int      gm_nworkers; /* The first one is the collecting thread */
+    struct akl_gc_worker *gm_workers;
+};
+
+/* The marker of the current thread (only set while marking in parallel) */
+static __thread struct akl_gc_worker *gc_worker;
+
+static void gc_worker_share(struct akl_gc_worker *, unsigned int);
+static void akl_gc_stop_markers(struct akl_state *);
+
+static bool_t
+gc_worker_set_mark(struct akl_gc_worker *w, struct akl_gc_pool *p, unsigned int ind)
+{
+    akl_gc_bitmap_t mask = BIT_MASK(ind);
+    if (__atomic_fetch_or(&p->gp_markmap[WORD_INDEX(ind)], mask, __ATOMIC_RELAXED) & mask)
+        return FALSE;
+    w->w_live++;
+    w->w_live_bytes += p->gp_obj_size;
+    return TRUE;
+}
+
+static inline void
+gc_worker_push(struct akl_gc_worker *w, void *obj)
+{
+    if (w->w_count == GC_LOCAL_STACK)
+        gc_worker_share(w, GC_LOCAL_STACK/2);
+    w->w_stack[w->w_count++] = obj;
+}
+#endif
+
 void akl_free_state(struct akl_state *in)
 {
     struct akl_atom *t1, *t2;
@@ -163,24 +299,70 @@ void akl_free_state(struct akl_state *in)
 #endif
     akl_clear_errors(in);
     //akl_free_list(in, in->ai_errors);
+#ifdef AKL_GC_PARALLEL
+    akl_gc_stop_markers(in);
+#endif
 }
 
-void akl_gc_mark_object(struct akl_state *s, void *obj, bool_t m)
+/* Set the mark bit of an object in its pool. Gives back FALSE, if
+  it was already marked (or it is old in a minor collection). */
+static bool_t
+akl_gc_set_mark(struct akl_state *s, void *obj)
 {
-    struct akl_gc_generic_object *gobj = (struct akl_gc_generic_object *)obj;
-    struct akl_gc_type *t = akl_gc_get_type(s, AKL_GC_TYPE_ID(gobj));
-    if (t && t->gt_marker_fn) {
-        t->gt_marker_fn(s, obj, m);
+    struct akl_gc_pool *p = POOL_OF(obj);
+    unsigned int ind = POOL_INDEX(p, obj);
+#ifdef AKL_GC_PARALLEL
+    if (gc_worker != NULL)
+        return gc_worker_set_mark(gc_worker, p, ind);
+#endif
+    if (TEST_BIT(p->gp_markmap, ind))
+        return FALSE;
+    SET_BIT(p->gp_markmap, ind);
+    s->ai_gc_live++;
+    s->ai_gc_live_bytes += p->gp_obj_size;
+    return TRUE;
+}
+
+/*
+ * Tri-color marking: the white objects are not marked, the gray
+ * ones are marked and waiting on the gray stack, the black ones are
+ * marked and their children are already gray (or black). The markers
+ * of the types make an object black, by graying its children.
+*/
+static inline void
+akl_gc_gray(struct akl_state *s, void *obj)
+{
+    struct akl_gc_generic_object *go = (struct akl_gc_generic_object *)obj;
+    /* Immediates are not allocated */
+    if (obj == NULL || AKL_IS_IMMEDIATE((struct akl_value *)obj))
+        return;
+
+    /* Not in a pool, but the referenced objects must be marked */
+    if (go->gc_obj.gc_static) {
+        akl_gc_get_type(s, AKL_GC_TYPE_ID(go))->gt_marker_fn(s, obj, TRUE);
+        return;
+    }
+    if (!akl_gc_set_mark(s, obj))
+        return;
+#ifdef AKL_GC_PARALLEL
+    if (gc_worker != NULL) {
+        gc_worker_push(gc_worker, obj);
+        return;
     }
+#endif
+    *(void **)akl_vector_reserve(&s->ai_gc_gray) = obj;
 }
 
+void akl_gc_mark_object(struct akl_state *s, void *obj, bool_t m)
+{
+    akl_gc_gray(s, obj);
+}
+
+#define MARK(s, obj) akl_gc_gray(s, obj)
+
 static void akl_gc_mark_value(struct akl_state *s, void *obj, bool_t m)
 {
-    assert(obj);
     struct akl_value *v = (struct akl_value *)obj;
-    if (v == &NIL_VALUE || v == &TRUE_VALUE)
-        return;
-
     switch (v->va_type) {
         case AKL_VT_SYMBOL:
         /* Symbols are not GC'd */
@@ -191,220 +373,837 @@ static void akl_gc_mark_value(struct akl_state *s, void *obj, bool_t m)
         break;
 
         case AKL_VT_LIST:
-        if (v->va_value.list)
-            AKL_GC_SET_MARK(v->va_value.list, m);
+        MARK(s, v->va_value.list);
+        break;
+
+        case AKL_VT_FUNCTION:
+        MARK(s, v->va_value.func);
+        break;
+
+        case AKL_VT_USERDATA:
+        MARK(s, v->va_value.udata);
+        break;
+
+        case AKL_VT_CONS:
+        MARK(s, v->va_value.cons);
+        break;
+
+        case AKL_VT_HASH:
+        MARK(s, v->va_value.hash);
+        break;
+
+        case AKL_VT_FVECTOR:
+        MARK(s, v->va_value.fvector);
         break;
 
         default:
         break;
     }
-    AKL_GC_SET_MARK(v, m);
 }
 
+/* Entries marked in a row by the marker of a list entry, the rest
+  of a long chain is left on the gray stack for the next ones */
+#define GC_CHAIN_RUN 256
+
+/* The next entries are also marked, so the whole chain is marked
+  after a list (until an already marked entry) */
 static void akl_gc_mark_list_entry(struct akl_state *s, void *obj, bool_t m)
 {
-    assert(obj);
-    struct akl_value *v;
     struct akl_list_entry *le = (struct akl_list_entry *)obj;
-    AKL_GC_SET_MARK(le, m);
-    if (le->gc_obj.gc_le_is_obj) {
-        v = (struct akl_value *)le->le_data;
-        if (v)
-            akl_gc_mark_object(s, v, m);
+    unsigned int run = 0;
+    for (;;) {
+        if (le->gc_obj.gc_le_is_obj)
+            MARK(s, le->le_data);
+        le = le->le_next;
+        if (le == NULL || ++run == GC_CHAIN_RUN)
+            break;
+        if (!akl_gc_set_mark(s, le))
+            return;
     }
+    MARK(s, le);
+}
+
+/* Like the entries, a run of the next pairs is marked at once */
+static void akl_gc_mark_cons(struct akl_state *s, void *obj, bool_t m)
+{
+    struct akl_cons *cons = (struct akl_cons *)obj;
+    struct akl_value *cdr;
+    unsigned int run = 0;
+    for (;;) {
+        MARK(s, cons->cs_car);
+        cdr = cons->cs_cdr;
+        if (AKL_IS_IMMEDIATE(cdr) || cdr->va_type != AKL_VT_CONS
+            || cdr->gc_obj.gc_static || ++run == GC_CHAIN_RUN)
+            break;
+        /* Both of them are already marked */
+        if (!akl_gc_set_mark(s, cdr))
+            return;
+        cons = cdr->va_value.cons;
+        if (!akl_gc_set_mark(s, cons))
+            return;
+    }
+    MARK(s, cdr);
 }
 
 static void
 akl_gc_mark_variable(struct akl_state *s, void *obj, bool_t m)
 {
     struct akl_variable *var = (struct akl_variable *)obj;
-    AKL_GC_SET_MARK(var, m);
-    if (var->vr_value) {
-        akl_gc_mark_value(s, var->vr_value, m);
-    }
+    MARK(s, var->vr_value);
 }
 
+/* User functions hold their constants and the cached
+  functions and variables of their instructions */
 static void
 akl_gc_mark_function(struct akl_state *s, void *obj, bool_t m)
 {
+    struct akl_function *fn = (struct akl_function *)obj;
+    struct akl_lisp_fun *uf;
+    struct akl_ir_instruction *in;
+    struct akl_value **vp;
+    unsigned int i;
+    if (fn->fn_type != AKL_FUNC_USER && fn->fn_type != AKL_FUNC_LAMBDA)
+        return;
+
+    uf = &fn->fn_body.ufun;
+    AKL_VECTOR_FOREACH(i, vp, &uf->uf_consts) {
+        MARK(s, *vp);
+    }
+    AKL_VECTOR_FOREACH(i, in, &uf->uf_body) {
+        MARK(s, in->in_fun);
+        MARK(s, in->in_var);
+    }
 }
 
+/* The private data is marked by its user type */
 static void
 akl_gc_mark_udata(struct akl_state *s, void *obj, bool_t m)
 {
+    struct akl_userdata *ud = (struct akl_userdata *)obj;
+    struct akl_utype *ut;
+    if (ud->ud_id >= akl_vector_count(&s->ai_utypes))
+        return;
+
+    ut = (struct akl_utype *)akl_vector_at(&s->ai_utypes, ud->ud_id);
+    if (ut->ut_mark_fun != NULL && ud->ud_private != NULL)
+        ut->ut_mark_fun(s, ud->ud_private, m);
+}
+
+/* Finalize a dead userdata with the destructor of its type */
+static void
+akl_gc_free_udata(struct akl_state *s, void *obj)
+{
+    struct akl_userdata *ud = (struct akl_userdata *)obj;
+    struct akl_utype *ut;
+    if (ud->ud_id >= akl_vector_count(&s->ai_utypes))
+        return;
+
+    ut = (struct akl_utype *)akl_vector_at(&s->ai_utypes, ud->ud_id);
+    if (ut->ut_de_fun != NULL && ud->ud_private != NULL)
+        ut->ut_de_fun(s, ud->ud_private);
+    ud->ud_private = NULL;
 }
 
 /* NOTE: Only call with value lists! */
 static void akl_gc_mark_list(struct akl_state *s, void *obj, bool_t m)
 {
     struct akl_list *list = (struct akl_list *)obj;
-    struct akl_list_entry *ent;
-    AKL_LIST_FOREACH(ent, list) {
-        if (ent)
-            akl_gc_mark_object(s, ent, m);
+    unsigned int i;
+    if (AKL_LIST_IS_PACKED(list)) {
+        for (i = 0; i < list->li_count; i++)
+            MARK(s, list->li_elems[i]);
+        return;
     }
-    AKL_GC_SET_MARK(list, m);
+    MARK(s, list->li_head);
 }
 
-void akl_gc_mark(struct akl_state *s)
+/* The array of a dead packed list */
+static void
+akl_gc_free_list(struct akl_state *s, void *obj)
 {
-    /* Walk around the IR and the variables */
+    struct akl_list *list = (struct akl_list *)obj;
+    if (AKL_LIST_IS_PACKED(list)) {
+        akl_free(s, list->li_elems, list->li_cap * sizeof(struct akl_value *));
+        list->li_elems = NULL;
+    }
 }
 
-void akl_gc_mark_all(struct akl_state *s)
+static void akl_gc_mark_hash(struct akl_state *s, void *obj, bool_t m)
 {
-    struct akl_atom *atom;
-    if (!AKL_IS_FEATURE_ON(s, AKL_CFG_USE_GC))
-        return;
-#if 0
-    RB_FOREACH(atom, ATOM_TREE, &s->ai_atom_head) {
-        akl_gc_mark_atom(atom, TRUE);
+    struct akl_hash *h = (struct akl_hash *)obj;
+    unsigned int i;
+    for (i = 0; i < h->ht_cap; i++) {
+        if (h->ht_slots[i].hs_key != NULL) {
+            MARK(s, h->ht_slots[i].hs_key);
+            MARK(s, h->ht_slots[i].hs_value);
+        }
+    }
+}
+
+/* The slots of a dead hash table */
+static void
+akl_gc_free_hash(struct akl_state *s, void *obj)
+{
+    struct akl_hash *h = (struct akl_hash *)obj;
+    if (h->ht_slots != NULL) {
+        akl_free(s, h->ht_slots, h->ht_cap * sizeof(struct akl_hash_slot));
+        h->ht_slots = NULL;
+    }
+}
+
+/* Only numbers are in it, nothing to mark */
+static void akl_gc_mark_fvector(struct akl_state *s, void *obj, bool_t m)
+{
+}
+
+static void
+akl_gc_free_fvector(struct akl_state *s, void *obj)
+{
+    struct akl_fvector *fv = (struct akl_fvector *)obj;
+    if (fv->fv_vec.av_vector != NULL) {
+        akl_vector_destroy(s, &fv->fv_vec);
+        fv->fv_vec.av_vector = NULL;
     }
+}
+
+static void
+akl_gc_mark_stack(struct akl_state *s, struct akl_vector *stack)
+{
+    unsigned int i;
+    for (i = 0; i < akl_vector_count(stack); i++) {
+        MARK(s, AKL_STACK_AT(stack, i));
+    }
+}
+
+/* The functions (and the stack) used by a context */
+static void
+akl_gc_mark_context(struct akl_state *s, struct akl_context *ctx)
+{
+    MARK(s, ctx->cx_func);
+    MARK(s, ctx->cx_fn_main);
+    MARK(s, ctx->cx_comp_func);
+    if (ctx->cx_stack && ctx->cx_stack != &s->ai_stack)
+        akl_gc_mark_stack(s, ctx->cx_stack);
+}
+
+/*
+ * Mark everything, which is reachable from the roots of the
+ * interpreter: the global variables, the value stack, the contexts
+ * on the frame stack and the lists of the interpreter. Symbols are
+ * not collected, so the symbol table has nothing to mark.
+ * The marked objects are only gray, see akl_gc_drain().
+*/
+void akl_gc_mark(struct akl_state *s)
+{
+    struct akl_variable **vp;
+    struct akl_context **cp;
+    unsigned int i;
+
+    AKL_VECTOR_FOREACH(i, vp, &s->ai_global_slots) {
+        MARK(s, *vp);
+    }
+
+    akl_gc_mark_stack(s, &s->ai_stack);
+    akl_gc_mark_context(s, &s->ai_context);
+    for (i = 0; i < s->ai_frame_depth; i++) {
+        cp = (struct akl_context **)akl_vector_at(&s->ai_frames, i);
+        akl_gc_mark_context(s, *cp);
+    }
+
+    /* Only the entries are collectable here */
+    MARK(s, &s->ai_modules);
+    MARK(s, s->ai_errors);
+}
+
+/* Microseconds from an arbitrary point (only for differences) */
+static unsigned long
+gc_clock_usec(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+#else
+    return (unsigned long)clock() / (CLOCKS_PER_SEC / 1000000UL);
 #endif
+}
 
+/* Count a pause of the program (a collection or a step) */
+static void
+gc_count_pause(struct akl_state *s, unsigned long usec)
+{
+    struct akl_gc_stats *st = &s->ai_gc_stats;
+    unsigned int b = 0;
+    while (b < AKL_GC_PAUSE_BUCKETS-1 && (usec >> (b+1)) != 0)
+        b++;
+    st->gs_pauses[b]++;
+    st->gs_last_pause  = usec;
+    st->gs_total_time += usec;
+    if (usec > st->gs_max_pause)
+        st->gs_max_pause = usec;
 }
 
-void akl_gc_unmark_all(struct akl_state *s)
+/* The time is not checked after every object */
+#define GC_DRAIN_CLOCK_EVERY 64
+
+/**
+ * @brief Make the gray objects black
+ * @param s An instance of the interpreter
+ * @param budget Bytes of objects to mark (0 means unlimited)
+ * @param max_pause Stop after this many microseconds (0 means unlimited)
+ * Gives back TRUE, when the gray stack is empty.
+*/
+static bool_t
+akl_gc_drain(struct akl_state *s, size_t budget, unsigned long max_pause)
 {
-    if (!AKL_IS_FEATURE_ON(s, AKL_CFG_USE_GC))
-        return;
+    struct akl_vector *gray = &s->ai_gc_gray;
+    struct akl_gc_type *types = (struct akl_gc_type *)s->ai_gc_types.av_vector;
+    void *obj;
+    /* The work is measured in the newly marked bytes */
+    size_t limit = s->ai_gc_live_bytes + budget;
+    unsigned int cnt = 0;
+    unsigned long start = (max_pause != 0) ? gc_clock_usec() : 0;
+
+    while (gray->av_count != 0) {
+        obj = ((void **)gray->av_vector)[--gray->av_count];
+        types[AKL_GC_TYPE_ID((struct akl_gc_generic_object *)obj)]
+            .gt_marker_fn(s, obj, TRUE);
+        if (budget != 0 && s->ai_gc_live_bytes >= limit)
+            break;
+        if (max_pause != 0 && ++cnt % GC_DRAIN_CLOCK_EVERY == 0
+                && gc_clock_usec() - start >= max_pause)
+            break;
+    }
+    return gray->av_count == 0;
 }
 
-#define ASSERT_INDEX(ind) \
-    assert(ind < AKL_GC_POOL_SIZE*(sizeof(unsigned int)*8))
+#ifdef AKL_GC_PARALLEL
+/* Move the bottom (the oldest) 'n' objects of a private
+  stack to the shared one and wake up the idle markers */
+static void
+gc_worker_share(struct akl_gc_worker *w, unsigned int n)
+{
+    struct akl_gc_markers *gm = w->w_markers;
+    struct akl_vector *gray = &gm->gm_state->ai_gc_gray;
+    unsigned int i;
+    pthread_mutex_lock(&gm->gm_lock);
+    for (i = 0; i < n; i++) {
+        *(void **)akl_vector_reserve(gray) = w->w_stack[i];
+    }
+    pthread_cond_broadcast(&gm->gm_work);
+    pthread_mutex_unlock(&gm->gm_lock);
+    memmove(w->w_stack, w->w_stack + n, (w->w_count - n) * sizeof(void *));
+    w->w_count -= n;
+}
 
-bool_t akl_gc_pool_in_use(struct akl_gc_pool *p, unsigned int ind)
+/* Wait for shared work. Gives back FALSE, when the marking is over. */
+static bool_t
+gc_worker_take(struct akl_gc_worker *w)
 {
-    assert(p);
-    ASSERT_INDEX(ind);
-//    int i = ind/BITS_IN_UINT;
-    return IS_BIT_SET(BIT_INDEX(p->gp_freemap, ind), ind);
+    struct akl_gc_markers *gm = w->w_markers;
+    struct akl_vector *gray = &gm->gm_state->ai_gc_gray;
+    bool_t ret = FALSE;
+    pthread_mutex_lock(&gm->gm_lock);
+    for (;;) {
+        if (gray->av_count != 0) {
+            while (gray->av_count != 0 && w->w_count < GC_SHARE_CHUNK
+                   && w->w_count < GC_LOCAL_STACK) {
+                w->w_stack[w->w_count++] = ((void **)gray->av_vector)[--gray->av_count];
+            }
+            ret = TRUE;
+            break;
+        }
+        if (gm->gm_finished)
+            break;
+        /* Everybody else is waiting, nothing left to mark */
+        if (gm->gm_idle + 1 == gm->gm_nworkers) {
+            gm->gm_finished = TRUE;
+            pthread_cond_broadcast(&gm->gm_work);
+            break;
+        }
+        __atomic_add_fetch(&gm->gm_idle, 1, __ATOMIC_RELAXED);
+        pthread_cond_wait(&gm->gm_work, &gm->gm_lock);
+        __atomic_sub_fetch(&gm->gm_idle, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&gm->gm_lock);
+    return ret;
 }
 
-void akl_gc_pool_use(struct akl_gc_pool *p, unsigned int ind)
+/* The marking loop of a thread, the markers of the types are
+  called concurrently (they only read the objects) */
+static void
+gc_worker_mark(struct akl_gc_worker *w)
 {
-    assert(p);
-    ASSERT_INDEX(ind);
-    p->gp_pool.av_count++;
-    SET_BIT(BIT_INDEX(p->gp_freemap, ind), ind);
+    struct akl_gc_markers *gm = w->w_markers;
+    struct akl_state *s = gm->gm_state;
+    struct akl_gc_type *types = (struct akl_gc_type *)s->ai_gc_types.av_vector;
+    void *obj;
+
+    gc_worker = w;
+    do {
+        while (w->w_count != 0) {
+            obj = w->w_stack[--w->w_count];
+            types[AKL_GC_TYPE_ID((struct akl_gc_generic_object *)obj)]
+                .gt_marker_fn(s, obj, TRUE);
+            if (w->w_count >= GC_SHARE_MIN
+                && __atomic_load_n(&gm->gm_idle, __ATOMIC_RELAXED) != 0)
+                gc_worker_share(w, w->w_count/2);
+        }
+    } while (gc_worker_take(w));
+    gc_worker = NULL;
 }
 
-void akl_gc_pool_clear_use(struct akl_gc_pool *p, unsigned int ind)
+static void *
+gc_helper_main(void *arg)
 {
-    assert(p);
-    ASSERT_INDEX(ind);
-    p->gp_pool.av_count--;
-    CLEAR_BIT(BIT_INDEX(p->gp_freemap, ind), ind);
+    struct akl_gc_worker *w = (struct akl_gc_worker *)arg;
+    struct akl_gc_markers *gm = w->w_markers;
+    unsigned long phase = 0;
+
+    pthread_mutex_lock(&gm->gm_lock);
+    for (;;) {
+        while (gm->gm_phase == phase && !gm->gm_quit)
+            pthread_cond_wait(&gm->gm_start, &gm->gm_lock);
+        if (gm->gm_quit)
+            break;
+        phase = gm->gm_phase;
+        pthread_mutex_unlock(&gm->gm_lock);
+
+        gc_worker_mark(w);
+
+        pthread_mutex_lock(&gm->gm_lock);
+        if (--gm->gm_running == 0)
+            pthread_cond_signal(&gm->gm_done);
+    }
+    pthread_mutex_unlock(&gm->gm_lock);
+    return NULL;
 }
 
-bool_t akl_gc_pool_have_free(struct akl_gc_pool *p)
+/* Start the helper threads (the collecting thread is the first marker) */
+static struct akl_gc_markers *
+akl_gc_start_markers(struct akl_state *s, unsigned int nthreads)
 {
-    int i;
-    assert(p);
-    for (i = 0; i < AKL_GC_POOL_SIZE/BITS_IN_UINT; i++) {
-        if (p->gp_freemap[i] != UINT_MAX) {
-            return TRUE;
+    struct akl_gc_markers *gm = AKL_MALLOC(s, struct akl_gc_markers);
+    unsigned int i;
+    gm->gm_state    = s;
+    gm->gm_nthreads = nthreads;
+    gm->gm_phase    = 0;
+    gm->gm_running  = 0;
+    gm->gm_idle     = 0;
+    gm->gm_finished = FALSE;
+    gm->gm_quit     = FALSE;
+    gm->gm_workers  = (struct akl_gc_worker *)akl_calloc(s, nthreads
+                                            , sizeof(struct akl_gc_worker));
+    pthread_mutex_init(&gm->gm_lock, NULL);
+    pthread_cond_init(&gm->gm_start, NULL);
+    pthread_cond_init(&gm->gm_work, NULL);
+    pthread_cond_init(&gm->gm_done, NULL);
+    gm->gm_workers[0].w_markers = gm;
+    for (i = 1; i < nthreads; i++) {
+        gm->gm_workers[i].w_markers = gm;
+        if (pthread_create(&gm->gm_workers[i].w_thread, NULL
+                           , gc_helper_main, &gm->gm_workers[i]) != 0)
+            break;
+    }
+    gm->gm_nworkers = i;
+    return gm;
+}
+
+static void
+akl_gc_stop_markers(struct akl_state *s)
+{
+    struct akl_gc_markers *gm = s->ai_gc_markers;
+    unsigned int i;
+    if (gm == NULL)
+        return;
+
+    pthread_mutex_lock(&gm->gm_lock);
+    gm->gm_quit = TRUE;
+    pthread_cond_broadcast(&gm->gm_start);
+    pthread_mutex_unlock(&gm->gm_lock);
+    for (i = 1; i < gm->gm_nworkers; i++) {
+        pthread_join(gm->gm_workers[i].w_thread, NULL);
+    }
+    pthread_mutex_destroy(&gm->gm_lock);
+    pthread_cond_destroy(&gm->gm_start);
+    pthread_cond_destroy(&gm->gm_work);
+    pthread_cond_destroy(&gm->gm_done);
+    akl_free(s, gm->gm_workers, gm->gm_nthreads * sizeof(struct akl_gc_worker));
+    AKL_FREE(s, gm);
+    s->ai_gc_markers = NULL;
+}
+#endif /* AKL_GC_PARALLEL */
+
+/*
+ * Make every gray object black with ai_gc_mark_threads threads.
+ * Only worth it for the major collections, the young objects
+ * are marked quickly by akl_gc_drain().
+*/
+static void
+akl_gc_drain_parallel(struct akl_state *s)
+{
+#ifdef AKL_GC_PARALLEL
+    struct akl_gc_markers *gm;
+    struct akl_gc_worker *w;
+    unsigned int i;
+    if (s->ai_gc_mark_threads < 2 || akl_vector_is_empty(&s->ai_gc_gray))
+        return;
+
+    if (s->ai_gc_markers == NULL)
+        s->ai_gc_markers = akl_gc_start_markers(s, s->ai_gc_mark_threads);
+    gm = s->ai_gc_markers;
+    if (gm->gm_nworkers < 2)
+        return;
+
+    pthread_mutex_lock(&gm->gm_lock);
+    gm->gm_finished = FALSE;
+    gm->gm_running  = gm->gm_nworkers - 1;
+    gm->gm_phase++;
+    pthread_cond_broadcast(&gm->gm_start);
+    pthread_mutex_unlock(&gm->gm_lock);
+
+    gc_worker_mark(&gm->gm_workers[0]);
+
+    pthread_mutex_lock(&gm->gm_lock);
+    while (gm->gm_running != 0)
+        pthread_cond_wait(&gm->gm_done, &gm->gm_lock);
+    pthread_mutex_unlock(&gm->gm_lock);
+
+    for (i = 0; i < gm->gm_nworkers; i++) {
+        w = &gm->gm_workers[i];
+        s->ai_gc_live       += w->w_live;
+        s->ai_gc_live_bytes += w->w_live_bytes;
+        w->w_live       = 0;
+        w->w_live_bytes = 0;
+    }
+#endif
+}
+
+/* Roots of the collection: the interpreter and the executed
+  context (and its callers), since a context of a compiled program
+  does not have to be on the frame stack. */
+static void
+akl_gc_mark_roots(struct akl_state *s, struct akl_context *ctx)
+{
+    struct akl_context *cx;
+    akl_gc_mark(s);
+    for (cx = ctx; cx != NULL; cx = cx->cx_parent) {
+        akl_gc_mark_context(s, cx);
+    }
+}
+
+/* Mark the children of an old object */
+static void
+akl_gc_scan_object(struct akl_state *s, struct akl_gc_type *t, void *obj)
+{
+    t->gt_marker_fn(s, obj, TRUE);
+}
+
+/* Scan the objects of a pool, which have a bit in the bitmap */
+static void
+akl_gc_scan_bitmap(struct akl_state *s, struct akl_gc_type *t
+                   , struct akl_gc_pool *p, akl_gc_bitmap_t *map)
+{
+    unsigned int w;
+    akl_gc_bitmap_t bits;
+    for (w = 0; w < p->gp_words; w++) {
+        for (bits = map[w]; bits != 0; bits &= bits - 1) {
+            akl_gc_scan_object(s, t
+                   , POOL_SLOT(p, w * BITS_IN_WORD + BITMAP_CTZ(bits)));
         }
     }
-    return FALSE;
 }
 
-int akl_gc_pool_find_free(struct akl_gc_pool *p)
+/*
+ * The old objects can only reference young objects, when they
+ * were modified (see the write barrier). These are the additional
+ * roots of a minor collection. The types without the barrier
+ * cannot tell, which objects were modified, so all of their old
+ * objects are scanned.
+*/
+static void
+akl_gc_scan_old(struct akl_state *s)
 {
-    int i, j;
-    assert(p);
-    /* Is the next element is usable? */
-    int cnt = akl_vector_count(&p->gp_pool);
-    if (cnt < AKL_GC_POOL_SIZE && !akl_gc_pool_in_use(p, cnt))
-        return cnt;
-
-    /* Nope... */
-    for (i = 0; i < AKL_GC_POOL_SIZE/BITS_IN_UINT; i++) {
-        if (p->gp_freemap[i] != UINT_MAX) {
-            for (j = 0; j < BITS_IN_UINT; j++) {
-                if (IS_BIT_NOT_SET(p->gp_freemap[i], j))
-                    return j;
+    unsigned int i;
+    struct akl_gc_type *t;
+    struct akl_gc_pool *p;
+    for (i = 0; i < akl_vector_count(&s->ai_gc_types); i++) {
+        t = akl_gc_get_type(s, i);
+        if (t->gt_marker_fn == NULL)
+            continue;
+        for (p = t->gt_pool_head; p != NULL; p = p->gp_next) {
+            if (!t->gt_barrier)
+                akl_gc_scan_bitmap(s, t, p, p->gp_markmap);
+            else if (p->gp_dirty)
+                akl_gc_scan_bitmap(s, t, p, p->gp_dirtymap);
+            if (p->gp_dirty) {
+                memset(p->gp_dirtymap, 0, sizeof(p->gp_dirtymap));
+                p->gp_dirty = FALSE;
             }
         }
     }
-    return -1;
 }
 
-static bool_t
-akl_gc_type_have_free(struct akl_state *s, struct akl_gc_type *t, struct akl_gc_pool **pool, unsigned int *ind)
+/* Everything is young again, before a major collection */
+static void
+akl_gc_clear_marks(struct akl_state *s)
 {
-    struct akl_gc_pool *p = t->gt_pool_head;
-    int i;
-    /* The last pool should have some free room (small optimization) */
-    if (p == NULL) {
-        *pool = akl_gc_pool_create(s, t);
-        *ind = 0;
-        return TRUE;
+    unsigned int i;
+    struct akl_gc_type *t;
+    struct akl_gc_pool *p;
+    for (i = 0; i < akl_vector_count(&s->ai_gc_types); i++) {
+        t = akl_gc_get_type(s, i);
+        for (p = t->gt_pool_head; p != NULL; p = p->gp_next) {
+            memset(p->gp_markmap, 0, sizeof(p->gp_markmap));
+            memset(p->gp_dirtymap, 0, sizeof(p->gp_dirtymap));
+            p->gp_dirty = FALSE;
+        }
     }
+}
 
-    if (akl_gc_pool_have_free(t->gt_pool_last)) {
-        *ind = akl_gc_pool_find_free(t->gt_pool_last);
-        *pool = t->gt_pool_last;
-        return TRUE;
+/* The interpreter of a (not static) GC object */
+struct akl_state *akl_gc_state_of(void *obj)
+{
+    assert(obj && !((struct akl_gc_generic_object *)obj)->gc_obj.gc_static);
+    return POOL_OF(obj)->gp_state;
+}
+
+/**
+ * @brief Remember an old object, which gets a new reference
+ * @param obj A GC'd object (or NULL)
+ * Call it before the object is modified. The young objects are only
+ * marked from the roots in a minor collection, so the old objects
+ * referencing them must be scanned. While an incremental mark phase
+ * runs, the current children of the object are marked instead (they
+ * were reachable, when the marking started).
+*/
+void akl_gc_write_barrier(void *obj)
+{
+    struct akl_gc_generic_object *go = (struct akl_gc_generic_object *)obj;
+    struct akl_gc_pool *p;
+    struct akl_state *s;
+    unsigned int ind;
+    /* Static objects must be reachable from the roots */
+    if (go == NULL || go->gc_obj.gc_static)
+        return;
+
+    p   = POOL_OF(obj);
+    s   = p->gp_state;
+    if (s->ai_gc_marking) {
+        akl_gc_get_type(s, p->gp_type_id)->gt_marker_fn(s, obj, TRUE);
+        return;
     }
+    ind = POOL_INDEX(p, obj);
+    if (TEST_BIT(p->gp_markmap, ind) && !TEST_BIT(p->gp_dirtymap, ind)) {
+        SET_BIT(p->gp_dirtymap, ind);
+        p->gp_dirty = TRUE;
+    }
+}
 
-    /* Ok. We have to check the others too :-( */
-    while (p && p != t->gt_pool_last) { /* The last was already checked... */
-        /* TODO: Rework this */
-        if (akl_gc_pool_have_free(p)) {
-            i = akl_gc_pool_find_free(p);
-            *pool = p;
-            if (i == -1) {
-                continue;
-            }
-            return TRUE;
+static void akl_gc_sweep_type(struct akl_state *, struct akl_gc_type *);
+
+/* The marking is done: the unmarked objects can be swept and
+  the next collection is scheduled */
+static void
+akl_gc_finish(struct akl_state *s, bool_t major, size_t old_bytes)
+{
+    struct akl_gc_type *t;
+    unsigned int i;
+
+    /* The pools are swept lazily by akl_gc_malloc(), one by one,
+      before allocating from them. Until then, no pool is known
+      to have free slots. */
+    for (i = 0; i < akl_vector_count(&s->ai_gc_types); i++) {
+        t = akl_gc_get_type(s, i);
+        t->gt_pool_sweep = t->gt_pool_head;
+        t->gt_pool_free  = NULL;
+        /* Do not wait with the finalizers (e.g. for closing files) */
+        if (t->gt_sweep_now)
+            akl_gc_sweep_type(s, t);
+    }
+
+    /* The next major collection is due, when the old generation
+      grew by the given ratio of the live bytes (100% means doubling) */
+    if (major) {
+        s->ai_gc_promoted = 0;
+        s->ai_gc_major_threshold = s->ai_gc_live_bytes / 100 * s->ai_gc_growth;
+        if (s->ai_gc_major_threshold < s->ai_gc_min_heap)
+            s->ai_gc_major_threshold = s->ai_gc_min_heap;
+    } else {
+        s->ai_gc_promoted += s->ai_gc_live_bytes - old_bytes;
+    }
+    s->ai_gc_allocs    = 0;
+    s->ai_gc_threshold = (s->ai_gc_nursery != 0)
+                       ? s->ai_gc_nursery : s->ai_gc_major_threshold;
+}
+
+/*
+ * An incremental step marks the gray objects in proportion to the
+ * bytes allocated since the last step (see ai_gc_mark_rate), but not
+ * for longer than ai_gc_max_pause. When the program allocated more,
+ * than a whole major collection allows, the marking is finished
+ * without limits.
+*/
+static void
+akl_gc_step(struct akl_context *ctx)
+{
+    struct akl_state *s = ctx->cx_state;
+    size_t budget = (s->ai_gc_allocs - s->ai_gc_step_allocs)
+                  / 100 * s->ai_gc_mark_rate;
+    bool_t force = (s->ai_gc_allocs >= s->ai_gc_major_threshold);
+
+    s->ai_gc_step_allocs = s->ai_gc_allocs;
+    if (force)
+        akl_gc_drain_parallel(s);
+    if (!akl_gc_drain(s, force ? 0 : budget + 1
+                      , force ? 0 : s->ai_gc_max_pause)) {
+        s->ai_gc_threshold = s->ai_gc_allocs + AKL_GC_STEP_BYTES;
+        return;
+    }
+
+    /* The roots are not protected by the write barrier */
+    akl_gc_mark_roots(s, ctx);
+    akl_gc_drain(s, 0, 0);
+    s->ai_gc_marking = FALSE;
+    akl_gc_finish(s, TRUE, 0);
+}
+
+/*
+ * Collect the garbage. The executed context (and its callers)
+ * are roots too, since a context of a compiled program does not
+ * have to be on the frame stack. Only call this, when every live
+ * object is reachable from the roots (see the safe points of the
+ * executor), not from C variables.
+ *
+ * The collector is generational, but does not move the objects:
+ * the mark bits are kept after a minor collection, so the marked
+ * objects are old, and only the young (unmarked) ones can be freed.
+ * A major collection clears the marks first, when too many bytes
+ * got old since the last one.
+ *
+ * With the 'gc-incremental' feature, the major collections only
+ * mark the roots here, the rest of the marking is done in steps
+ * at the next safe points (see akl_gc_step()). Meanwhile the
+ * new objects are allocated as marked and there are no minor
+ * collections.
+*/
+void akl_gc_collect(struct akl_context *ctx)
+{
+    struct akl_state *s = ctx->cx_state;
+    unsigned long start;
+    size_t old_bytes;
+    bool_t major;
+    if (!AKL_IS_FEATURE_ON(s, AKL_CFG_USE_GC))
+        return;
+
+    start = gc_clock_usec();
+    if (s->ai_gc_marking) {
+        akl_gc_step(ctx);
+        s->ai_gc_stats.gs_steps++;
+        gc_count_pause(s, gc_clock_usec() - start);
+        return;
+    }
+
+    /* The mark bits of the last collection must be consumed */
+    akl_gc_sweep(s);
+    major = (s->ai_gc_nursery == 0
+          || s->ai_gc_promoted >= s->ai_gc_major_threshold);
+    old_bytes = s->ai_gc_live_bytes;
+    if (major) {
+        akl_gc_clear_marks(s);
+        s->ai_gc_live = 0;
+        s->ai_gc_live_bytes = 0;
+        s->ai_gc_stats.gs_major++;
+    } else {
+        akl_gc_scan_old(s);
+        s->ai_gc_stats.gs_minor++;
+    }
+    akl_gc_mark_roots(s, ctx);
+
+    if (major && AKL_IS_FEATURE_ON(s, AKL_CFG_GC_INCREMENTAL)) {
+        s->ai_gc_marking     = TRUE;
+        s->ai_gc_allocs      = 0;
+        s->ai_gc_step_allocs = 0;
+        s->ai_gc_threshold   = AKL_GC_STEP_BYTES;
+    } else {
+        if (major)
+            akl_gc_drain_parallel(s);
+        akl_gc_drain(s, 0, 0);
+        akl_gc_finish(s, major, old_bytes);
+    }
+    gc_count_pause(s, gc_clock_usec() - start);
+}
+
+/* Bits of the slots over the capacity of the pool in a bitmap word */
+static akl_gc_bitmap_t
+pool_tail_mask(unsigned int cap, unsigned int w)
+{
+    if ((w+1) * BITS_IN_WORD <= cap)
+        return 0;
+    if (w * BITS_IN_WORD >= cap)
+        return ~(akl_gc_bitmap_t)0;
+    return ~(akl_gc_bitmap_t)0 << (cap % BITS_IN_WORD);
+}
+
+static void
+pool_push_free(struct akl_gc_type *t, struct akl_gc_pool *p)
+{
+    p->gp_next_free = t->gt_pool_free;
+    t->gt_pool_free = p;
+}
+
+/* Take the first free slot of a pool (it must have one) */
+static void *
+pool_take_slot(struct akl_gc_pool *p)
+{
+    akl_gc_bitmap_t free;
+    unsigned int w, bit;
+    for (w = p->gp_hint; w < p->gp_words; w++) {
+        free = ~p->gp_usemap[w];
+        if (free != 0) {
+            bit = BITMAP_CTZ(free);
+            p->gp_usemap[w] |= (akl_gc_bitmap_t)1 << bit;
+            p->gp_hint = w;
+            p->gp_count++;
+            return POOL_SLOT(p, w * BITS_IN_WORD + bit);
         }
-        p = p->gp_next;
     }
-    return FALSE;
+    assert(!"The GC pool is full");
+    return NULL;
 }
 
 bool_t akl_gc_pool_is_empty(struct akl_gc_pool *p)
 {
     assert(p);
-    int i, s = 0;
-    for (i = 0; i < AKL_GC_POOL_SIZE/BITS_IN_UINT; i++) {
-        s += p->gp_freemap[i];
-    }
-    return s == 0;
+    return p->gp_count == 0;
 }
 
 void akl_gc_pool_free(struct akl_state *s, struct akl_gc_pool *p)
 {
-    akl_vector_destroy(s, &p->gp_pool);
-    akl_free(s, p->gp_freemap, AKL_GC_POOL_SIZE/BITS_IN_UINT);
-    AKL_FREE(s, p);
+    akl_free(s, p->gp_mem, AKL_GC_POOL_BYTES*2);
 }
 
 bool_t akl_gc_type_tryfree(struct akl_state *s, struct akl_gc_type *t)
 {
     assert(s && t);
-    struct akl_gc_pool *prev = NULL;
-    struct akl_gc_pool *next;
-    /* Must start from the second pool. */
-    struct akl_gc_pool *p = t->gt_pool_head;
+    struct akl_gc_pool **pp = &t->gt_pool_head;
+    struct akl_gc_pool *p;
     bool_t succeed = FALSE;
 
-    while (p) {
-        next = p->gp_next;
+    /* Every pool is swept here, so the free list is built again
+      from the remaining ones */
+    t->gt_pool_free = NULL;
+    while ((p = *pp) != NULL) {
         if (akl_gc_pool_is_empty(p)) {
             succeed = TRUE;
-            if (prev)
-                prev->gp_next = next;
-
-            /* This was the last pool, update the 'last' pointer */
-            if (next == NULL)
-                t->gt_pool_last = prev;
+            *pp = p->gp_next;
+            t->gt_pool_count--;
             akl_gc_pool_free(s, p);
         } else {
-            prev = p;
+            if (p->gp_count < p->gp_cap)
+                pool_push_free(t, p);
+            pp = &p->gp_next;
         }
-        p = next;
     }
     return succeed;
 }
@@ -414,6 +1213,8 @@ bool_t akl_gc_tryfree(struct akl_state *s)
     assert(s);
     bool_t succeed = FALSE;
     int i;
+    /* Only the swept pools know, that they are empty */
+    akl_gc_sweep(s);
     for (i = 0; i < akl_vector_count(&s->ai_gc_types); i++) {
         if (akl_gc_type_tryfree(s, akl_gc_get_type(s, i)))
             succeed = TRUE;
@@ -421,37 +1222,57 @@ bool_t akl_gc_tryfree(struct akl_state *s)
     return succeed;
 }
 
-void akl_gc_sweep_pool(struct akl_state *s, struct akl_gc_pool *p, akl_gc_marker_t marker)
+/*
+ * Free the unmarked objects of a pool: the marked objects are
+ * the used ones from now (a word at a time). The marks are kept,
+ * they are the old generation. Gives back TRUE, when the pool has
+ * free slots (then it is put on the free list of its type).
+ * When the type has a finalizer, it is called for every dead object.
+*/
+bool_t akl_gc_sweep_pool(struct akl_state *s, struct akl_gc_pool *p)
 {
-    struct akl_vector *v;
-    struct akl_gc_generic_object *go;
-    int i;
-    if (!p || !marker)
-        return;
-
-    v = &p->gp_pool;
-    for (i = 0; i < AKL_GC_POOL_SIZE; i++) {
-        go = (struct akl_gc_generic_object *)akl_vector_at(v, i);
-        if (akl_gc_pool_in_use(p, i)) {
-            if (AKL_GC_IS_MARKED(go)) {
-                marker(s, go, FALSE);
-            } else {
-                akl_gc_pool_clear_use(p, i);
+    struct akl_gc_type *t = akl_gc_get_type(s, p->gp_type_id);
+    unsigned int w, count = 0;
+    akl_gc_bitmap_t dead;
+
+    /* The words after gp_words are always full */
+    for (w = 0; w < p->gp_words; w++) {
+        if (t->gt_free_fn != NULL) {
+            dead = p->gp_usemap[w] & ~p->gp_markmap[w]
+                 & ~pool_tail_mask(p->gp_cap, w);
+            for (; dead != 0; dead &= dead - 1) {
+                t->gt_free_fn(s, POOL_SLOT(p, w * BITS_IN_WORD + BITMAP_CTZ(dead)));
             }
         }
+        count += BITMAP_POPCOUNT(p->gp_markmap[w]);
+        p->gp_usemap[w] = p->gp_markmap[w] | pool_tail_mask(p->gp_cap, w);
     }
-    akl_gc_sweep_pool(s, p->gp_next, marker);
+    p->gp_count = count;
+    p->gp_hint  = 0;
+    if (count < p->gp_cap) {
+        pool_push_free(t, p);
+        return TRUE;
+    }
+    return FALSE;
 }
 
+/* Sweep the pools of a type, which are not swept since the last mark */
+static void
+akl_gc_sweep_type(struct akl_state *s, struct akl_gc_type *t)
+{
+    struct akl_gc_pool *p;
+    while ((p = t->gt_pool_sweep) != NULL) {
+        t->gt_pool_sweep = p->gp_next;
+        akl_gc_sweep_pool(s, p);
+    }
+}
+
+/* Sweep every pool, which is not swept since the last mark */
 void akl_gc_sweep(struct akl_state *s)
 {
     int i;
-    struct akl_gc_type *t;
-    if (AKL_IS_FEATURE_ON(s, AKL_CFG_USE_GC)) {
-        for (i = 0; i < akl_vector_count(&s->ai_gc_types); i++) {
-            t = akl_gc_get_type(s, i);
-            akl_gc_sweep_pool(s, t->gt_pool_head, t->gt_marker_fn);
-        }
+    for (i = 0; i < akl_vector_count(&s->ai_gc_types); i++) {
+        akl_gc_sweep_type(s, akl_gc_get_type(s, i));
     }
 }
 
@@ -469,6 +1290,152 @@ void akl_gc_disable(struct akl_state *s)
     }
 }
 
+/**
+ * @brief Set the heap growth between two major collections
+ * @param s An instance of the interpreter
+ * @param percent The allowed growth in the percent of the live bytes
+ * (e.g. 100 collects when the heap doubled, 50 is more frequent)
+ * Takes effect after the next major collection.
+*/
+void akl_gc_set_growth(struct akl_state *s, unsigned int percent)
+{
+    assert(s);
+    s->ai_gc_growth = percent;
+}
+
+/* Number of bytes to allocate between two minor collections
+  (0 means, that every collection is a major one) */
+void akl_gc_set_nursery(struct akl_state *s, size_t bytes)
+{
+    assert(s);
+    s->ai_gc_nursery = bytes;
+    s->ai_gc_threshold = (bytes != 0) ? bytes : s->ai_gc_major_threshold;
+}
+
+/* Bytes to mark in an incremental step, in the percent of the
+  bytes allocated since the last step (more finishes sooner) */
+void akl_gc_set_mark_rate(struct akl_state *s, unsigned int percent)
+{
+    assert(s);
+    s->ai_gc_mark_rate = percent;
+}
+
+/* Time limit of an incremental step in microseconds (0 means no limit).
+  The marking is finished anyway, when it cannot keep up. */
+void akl_gc_set_max_pause(struct akl_state *s, unsigned long usec)
+{
+    assert(s);
+    s->ai_gc_max_pause = usec;
+}
+
+/**
+ * @brief Set the number of threads marking in a major collection
+ * @param s An instance of the interpreter
+ * @param nthreads Number of threads (0 or 1 marks on the collecting
+ * thread only). The helper threads are started by the next major
+ * collection. Without AKL_GC_PARALLEL, the marking is never parallel.
+*/
+void akl_gc_set_mark_threads(struct akl_state *s, unsigned int nthreads)
+{
+    assert(s);
+#ifdef AKL_GC_PARALLEL
+    akl_gc_stop_markers(s);
+#endif
+    s->ai_gc_mark_threads = nthreads;
+}
+
+/* Minimal number of bytes to allocate between two major collections */
+void akl_gc_set_min_heap(struct akl_state *s, size_t bytes)
+{
+    assert(s);
+    s->ai_gc_min_heap = bytes;
+    if (s->ai_gc_major_threshold < bytes)
+        s->ai_gc_major_threshold = bytes;
+    if (s->ai_gc_nursery == 0)
+        s->ai_gc_threshold = s->ai_gc_major_threshold;
+}
+
+/**
+ * @brief Set the number of objects in the new pools of a GC type
+ * @param s An instance of the interpreter
+ * @param tid The GC type
+ * @param nobjs Number of objects (0 means the most, which fits in a pool)
+ * The existing pools keep their size. Gives back FALSE, when the
+ * objects do not fit in a pool.
+*/
+bool_t akl_gc_set_pool_size(struct akl_state *s, akl_gc_type_t tid, unsigned int nobjs)
+{
+    struct akl_gc_type *t;
+    assert(s);
+    if (tid >= akl_vector_count(&s->ai_gc_types))
+        return FALSE;
+
+    t = akl_gc_get_type(s, tid);
+    if (nobjs == 0)
+        nobjs = POOL_MAX_CAP(t->gt_type_size);
+    else if (nobjs > POOL_MAX_CAP(t->gt_type_size))
+        return FALSE;
+
+    t->gt_pool_cap = nobjs;
+    return TRUE;
+}
+
+/**
+ * @brief Query the counters of the collector
+ * @param s An instance of the interpreter
+ * @param st The counters are copied here
+ * The time values are in microseconds. The lazy sweeping is
+ * not a pause, but it is counted in the total time.
+*/
+void akl_gc_get_stats(struct akl_state *s, struct akl_gc_stats *st)
+{
+    struct akl_gc_type *t;
+    unsigned int i;
+    assert(s && st);
+    *st = s->ai_gc_stats;
+    st->gs_malloc_bytes = s->ai_gc_malloc_size;
+    st->gs_live         = s->ai_gc_live;
+    st->gs_live_bytes   = s->ai_gc_live_bytes;
+    st->gs_heap_bytes   = 0;
+    for (i = 0; i < akl_vector_count(&s->ai_gc_types); i++) {
+        t = akl_gc_get_type(s, i);
+        st->gs_heap_bytes += (size_t)t->gt_pool_count * AKL_GC_POOL_BYTES;
+    }
+}
+
+/**
+ * @brief Query the counters of a GC type
+ * @param s An instance of the interpreter
+ * @param tid The GC type
+ * @param ts The counters are written here
+ * The objects are counted in the bitmaps of the pools, the marked
+ * ones are the survivors of the last collection and the objects
+ * allocated as old since then. Gives back FALSE for an unknown type.
+*/
+bool_t akl_gc_get_type_stats(struct akl_state *s, akl_gc_type_t tid
+                             , struct akl_gc_type_stats *ts)
+{
+    struct akl_gc_type *t;
+    struct akl_gc_pool *p;
+    unsigned int w;
+    assert(s && ts);
+    if (tid >= akl_vector_count(&s->ai_gc_types))
+        return FALSE;
+
+    t = akl_gc_get_type(s, tid);
+    ts->ts_allocs = t->gt_allocs;
+    ts->ts_used   = 0;
+    ts->ts_live   = 0;
+    ts->ts_pools  = t->gt_pool_count;
+    ts->ts_bytes  = (size_t)t->gt_pool_count * AKL_GC_POOL_BYTES;
+    for (p = t->gt_pool_head; p != NULL; p = p->gp_next) {
+        ts->ts_used += p->gp_count;
+        for (w = 0; w < p->gp_words; w++)
+            ts->ts_live += BITMAP_POPCOUNT(p->gp_markmap[w]);
+    }
+    ts->ts_live_bytes = ts->ts_live * t->gt_type_size;
+    return TRUE;
+}
 
 struct akl_gc_type *akl_gc_get_type(struct akl_state *s, akl_gc_type_t type)
 {
@@ -476,82 +1443,159 @@ struct akl_gc_type *akl_gc_get_type(struct akl_state *s, akl_gc_type_t type)
     return (struct akl_gc_type *)akl_vector_at(&s->ai_gc_types, type);
 }
 
+/* The memory is allocated with the double size, to find
+  an aligned pool in it. */
 struct akl_gc_pool *akl_gc_pool_create(struct akl_state *s, struct akl_gc_type *type)
 {
-    struct akl_gc_pool *pool = AKL_MALLOC(s, struct akl_gc_pool);
-    pool->gp_next = NULL;
-    akl_init_vector(s, &pool->gp_pool, AKL_GC_POOL_SIZE, type->gt_type_size);
-    memset(pool->gp_freemap, 0, AKL_GC_POOL_SIZE/BITS_IN_UINT);
-
-    if (type->gt_pool_last)
-        type->gt_pool_last->gp_next = pool;
+    struct akl_gc_pool *pool;
+    unsigned int w;
+    void *mem = akl_alloc(s, AKL_GC_POOL_BYTES*2);
+    if (mem == NULL)
+        return NULL;
 
-    if (type->gt_pool_head == NULL)
-        type->gt_pool_head = pool;
+    pool = (struct akl_gc_pool *)(((uintptr_t)mem + AKL_GC_POOL_BYTES-1)
+                                  & ~(uintptr_t)(AKL_GC_POOL_BYTES-1));
+    pool->gp_mem      = mem;
+    pool->gp_type_id  = type->gt_type_id;
+    pool->gp_obj_size = type->gt_type_size;
+    pool->gp_cap      = type->gt_pool_cap;
+    pool->gp_words    = (pool->gp_cap + BITS_IN_WORD-1) / BITS_IN_WORD;
+    pool->gp_count    = 0;
+    pool->gp_hint     = 0;
+    pool->gp_dirty    = FALSE;
+    pool->gp_state    = s;
+    for (w = 0; w < AKL_GC_BITMAP_WORDS; w++) {
+        pool->gp_usemap[w]   = pool_tail_mask(pool->gp_cap, w);
+        pool->gp_markmap[w]  = 0;
+        pool->gp_dirtymap[w] = 0;
+    }
 
-    type->gt_pool_last = pool;
+    /* New pools are put before the ones waiting for the sweep */
+    pool->gp_next      = type->gt_pool_head;
+    type->gt_pool_head = pool;
     type->gt_pool_count++;
+    pool_push_free(type, pool);
     return pool;
 }
 
-// TODO: Implement akl_gc_mark_function and akl_gc_mark_udata
 const akl_gc_marker_t base_type_markers[] = {
     akl_gc_mark_value, akl_gc_mark_variable, akl_gc_mark_list, akl_gc_mark_list_entry
-  , akl_gc_mark_function, akl_gc_mark_udata
+  , akl_gc_mark_function, akl_gc_mark_udata, akl_gc_mark_cons, akl_gc_mark_hash
+  , akl_gc_mark_fvector
 };
 
 const size_t base_type_sizes[] = {
     sizeof(struct akl_value), sizeof(struct akl_variable), sizeof(struct akl_list)
   , sizeof(struct akl_list_entry), sizeof(struct akl_function)
-  , sizeof(struct akl_userdata)
+  , sizeof(struct akl_userdata), sizeof(struct akl_cons), sizeof(struct akl_hash)
+  , sizeof(struct akl_fvector)
 };
 
 void akl_gc_init(struct akl_state *s)
 {
     int i;
-    s->ai_gc_last_was_mark = FALSE;
     s->ai_gc_malloc_size = 0;
+    s->ai_gc_allocs      = 0;
+    s->ai_gc_live        = 0;
+    s->ai_gc_live_bytes  = 0;
+    s->ai_gc_growth      = AKL_GC_GROWTH;
+    s->ai_gc_min_heap    = AKL_GC_MIN_HEAP;
+    s->ai_gc_nursery     = AKL_GC_NURSERY;
+    s->ai_gc_promoted    = 0;
+    s->ai_gc_major_threshold = AKL_GC_MIN_HEAP;
+    s->ai_gc_threshold   = AKL_GC_NURSERY;
+    s->ai_gc_marking     = FALSE;
+    s->ai_gc_step_allocs = 0;
+    s->ai_gc_mark_rate   = AKL_GC_MARK_RATE;
+    s->ai_gc_max_pause   = 0;
+    s->ai_gc_mark_threads = 1;
+    s->ai_gc_markers     = NULL;
+    memset(&s->ai_gc_stats, 0, sizeof(s->ai_gc_stats));
+    akl_init_vector(s, &s->ai_gc_gray, 0, sizeof(void *));
 
-    akl_gc_disable(s);
     akl_init_vector(s, &s->ai_gc_types, AKL_GC_NR_BASE_TYPES, sizeof(struct akl_gc_type));
     for (i = 0; i < AKL_GC_NR_BASE_TYPES; i++) {
         akl_gc_register_type(s, base_type_markers[i], base_type_sizes[i]);
     }
+    /* Most of the values and lists die young, the other
+      objects (functions, variables...) are long living */
+    akl_gc_get_type(s, AKL_GC_VALUE)->gt_nursery      = TRUE;
+    akl_gc_get_type(s, AKL_GC_LIST)->gt_nursery       = TRUE;
+    akl_gc_get_type(s, AKL_GC_LIST_ENTRY)->gt_nursery = TRUE;
+    akl_gc_get_type(s, AKL_GC_CONS)->gt_nursery       = TRUE;
+    /* The variables (set without the barrier), the functions (their
+      inline caches) and the userdata are scanned on every minor
+      collection */
+    akl_gc_get_type(s, AKL_GC_VALUE)->gt_barrier      = TRUE;
+    akl_gc_get_type(s, AKL_GC_LIST)->gt_barrier       = TRUE;
+    akl_gc_get_type(s, AKL_GC_LIST_ENTRY)->gt_barrier = TRUE;
+    akl_gc_get_type(s, AKL_GC_CONS)->gt_barrier       = TRUE;
+    /* Only akl_hash_set() stores into the tables, a big table must
+      not be scanned on every minor collection */
+    akl_gc_get_type(s, AKL_GC_HASH)->gt_barrier       = TRUE;
+    /* The number vectors have no references at all */
+    akl_gc_get_type(s, AKL_GC_FVECTOR)->gt_barrier    = TRUE;
+    /* The resources of the userdata are given back by their types */
+    akl_gc_get_type(s, AKL_GC_UDATA)->gt_free_fn   = akl_gc_free_udata;
+    akl_gc_get_type(s, AKL_GC_UDATA)->gt_sweep_now = TRUE;
+    /* The arrays of the packed lists can wait for the lazy sweep */
+    akl_gc_get_type(s, AKL_GC_LIST)->gt_free_fn    = akl_gc_free_list;
+    akl_gc_get_type(s, AKL_GC_HASH)->gt_free_fn    = akl_gc_free_hash;
+    akl_gc_get_type(s, AKL_GC_FVECTOR)->gt_free_fn = akl_gc_free_fvector;
 }
 /**
  * @brief Request memory from the GC
  * @param s An instance of the interpreter (cannot be NULL)
  * @param type Type of the GC object
  * @see AKL_GC_OBJECT_TYPE
- * If the claim is not met, try to collect some memory or
- * create a new GC pool.
+ * Objects are taken from the first pool of the free list, so it
+ * does not matter how many (full) pools are there. When the list
+ * is empty, the pools are swept lazily here (after a collection)
+ * and if there is still no free room, create a new GC pool. There is
+ * no marking here (the new objects are only referenced from C
+ * variables), the allocations are only counted. The executor
+ * collects (or does an incremental step) on its next safe point,
+ * when enough objects were allocated.
 */
 void *akl_gc_malloc(struct akl_state *s, akl_gc_type_t tid)
 {
     assert(s && tid < akl_vector_count(&s->ai_gc_types));
     struct akl_gc_type *t = akl_gc_get_type(s, tid);
     struct akl_gc_pool *p;
-    unsigned int ind;
-    if (akl_gc_type_have_free(s, t, &p, &ind)) {
-        /* This was too easy... */
-        akl_gc_pool_use(p, ind);
-        return akl_vector_at(&p->gp_pool, ind);
-    } else {
-        if (!s->ai_gc_last_was_mark && AKL_IS_FEATURE_ON(s, AKL_CFG_USE_GC)) {
-            akl_gc_mark(s);
-            akl_gc_sweep(s);
-            s->ai_gc_last_was_mark = TRUE;
-            return akl_gc_malloc(s, tid);
-        } else {
-            /* We cannot collect enough memory :-( => we have to to some
-             * allocation. To do this we must also need to create the
-             * container pool (just for that type). */
-            p = akl_gc_pool_create(s, t);
-            s->ai_gc_last_was_mark = FALSE;
-            akl_gc_pool_use(p, 0);
-            return akl_vector_at(&p->gp_pool, 0);
+    unsigned long start, elapsed;
+    void *obj;
+    s->ai_gc_allocs += t->gt_type_size;
+    /* Sweep the pools one by one, until one of them has free room.
+      If every pool is full, we must create a new one. */
+    while ((p = t->gt_pool_free) == NULL) {
+        p = t->gt_pool_sweep;
+        if (p == NULL) {
+            if (akl_gc_pool_create(s, t) == NULL)
+                return NULL;
+            continue;
         }
+        t->gt_pool_sweep = p->gp_next;
+        start = gc_clock_usec();
+        akl_gc_sweep_pool(s, p);
+        elapsed = gc_clock_usec() - start;
+        s->ai_gc_stats.gs_sweep_time += elapsed;
+        s->ai_gc_stats.gs_total_time += elapsed;
+    }
+    obj = pool_take_slot(p);
+    t->gt_allocs++;
+    /* Objects without a nursery are born old, and every object is
+      marked while the (incremental) marking is running */
+    if (!t->gt_nursery || s->ai_gc_marking) {
+        SET_BIT(p->gp_markmap, POOL_INDEX(p, obj));
+        s->ai_gc_live++;
+        s->ai_gc_live_bytes += t->gt_type_size;
+        if (!s->ai_gc_marking)
+            s->ai_gc_promoted += t->gt_type_size;
     }
+    /* Full pools are left out of the free list */
+    if (p->gp_count == p->gp_cap)
+        t->gt_pool_free = p->gp_next_free;
+    return obj;
 }
 
 /* ~~~===### Free functions ###===~~~ */
@@ -0,0 +1,327 @@
+/************************************************************************
+ *   Copyright (c) 2012 Ákos Kovács - AkLisp Lisp dialect
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ ************************************************************************/
+#include "aklisp.h"
+
+/*
+ * Hash tables for values. The slots are stored in one array (its size
+ * is a power of two) and found by linear probing. A removed slot is
+ * filled by moving back the following slots of the same run, so there
+ * are no tombstones and a lookup stops at the first empty slot.
+*/
+
+#define HASH_MIN_CAP 8
+/* Grow when the table would be more than 3/4 full */
+#define HASH_IS_FULL(h) (((h)->ht_count + 1) * 4 > (h)->ht_cap * 3)
+#define HASH_SLOT_BYTES(cap) ((cap) * sizeof(struct akl_hash_slot))
+
+/* Spread the bits (the finalizer of MurmurHash3) */
+static unsigned int hash_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (unsigned int)x;
+}
+
+static unsigned int hash_number(double num)
+{
+    uint64_t bits;
+    if (num == 0)
+        num = 0.0; /* -0.0 is equal to 0.0 */
+    memcpy(&bits, &num, sizeof(bits));
+    return hash_mix(bits);
+}
+
+static unsigned int hash_combine(unsigned int h, unsigned int eh)
+{
+    return (h ^ eh) * 16777619U;
+}
+
+/**
+ * @brief Hash a value
+ * @param v The value
+ * The equal values (see akl_compare_values()) have the same hash:
+ * the numbers are hashed by their value (so the fixnums and the
+ * boxed numbers match), the strings by their content, the symbols
+ * by their (case folded) name, the lists, the cons lists and the
+ * number vectors by their elements. Other values are hashed by their address.
+*/
+unsigned int akl_hash_value(struct akl_value *v)
+{
+    struct akl_list_iter it;
+    struct akl_value *ev;
+    struct akl_fvector *fv;
+    unsigned int h, i;
+    const char *str;
+
+    switch (AKL_TYPE(v)) {
+        case AKL_VT_NUMBER:
+        return hash_number(AKL_GET_NUMBER_VALUE(v));
+
+        case AKL_VT_STRING:
+        h = AKL_HASH_INIT;
+        str = AKL_GET_STRING_VALUE(v);
+        while (str != NULL && *str)
+            h = (h ^ (unsigned char)*str++) * 16777619U;
+        return h;
+
+        case AKL_VT_SYMBOL:
+        return v->va_value.symbol->sb_hash;
+
+        case AKL_VT_LIST:
+        h = AKL_VT_LIST;
+        akl_list_iter_init(&it, AKL_GET_LIST_VALUE(v));
+        while ((ev = akl_list_iter_next(&it)) != NULL)
+            h = hash_combine(h, akl_hash_value(ev));
+        return h;
+
+        case AKL_VT_CONS:
+        h = AKL_VT_LIST;
+        while (AKL_CHECK_TYPE(v, AKL_VT_CONS)) {
+            h = hash_combine(h, akl_hash_value(v->va_value.cons->cs_car));
+            v = v->va_value.cons->cs_cdr;
+        }
+        return AKL_IS_NIL(v) ? h : hash_combine(h, akl_hash_value(v));
+
+        case AKL_VT_FVECTOR:
+        h = AKL_VT_FVECTOR;
+        fv = AKL_GET_FVECTOR_VALUE(v);
+        for (i = 0; i < AKL_FVECTOR_COUNT(fv); i++)
+            h = hash_combine(h, hash_number(AKL_FVECTOR_DATA(fv)[i]));
+        return h;
+
+        case AKL_VT_NIL:
+        case AKL_VT_TRUE:
+        return AKL_TYPE(v);
+
+        default:
+        return hash_mix((uintptr_t)v);
+    }
+}
+
+static void hash_alloc_slots(struct akl_state *s, struct akl_hash *h, unsigned int cap)
+{
+    h->ht_slots = (struct akl_hash_slot *)akl_calloc(s, cap, sizeof(struct akl_hash_slot));
+    h->ht_cap   = cap;
+    /* The arrays are not GC objects, but the GC must know about them */
+    s->ai_gc_allocs += HASH_SLOT_BYTES(cap);
+}
+
+/**
+ * @brief Create an empty hash table
+ * @param s An instance of the interpreter
+ * @param cap Expected number of elements (it can grow)
+*/
+struct akl_hash *akl_new_hash(struct akl_state *s, unsigned int cap)
+{
+    struct akl_hash *h = (struct akl_hash *)akl_gc_malloc(s, AKL_GC_HASH);
+    unsigned int size = HASH_MIN_CAP;
+    AKL_GC_INIT_OBJ(h, AKL_GC_HASH);
+    while (size * 3 < cap * 4)
+        size *= 2;
+    h->ht_count = 0;
+    hash_alloc_slots(s, h, size);
+    return h;
+}
+
+/* The slot of the key, or the empty slot where it should be */
+static struct akl_hash_slot *
+hash_find_slot(struct akl_hash *h, struct akl_value *key, unsigned int hash)
+{
+    unsigned int mask = h->ht_cap - 1;
+    unsigned int i = hash & mask;
+    struct akl_hash_slot *slot;
+    for (;; i = (i + 1) & mask) {
+        slot = &h->ht_slots[i];
+        if (slot->hs_key == NULL)
+            return slot;
+        if (slot->hs_hash == hash && akl_compare_values(slot->hs_key, key) == 0)
+            return slot;
+    }
+}
+
+/* Move the slots to a new array (the hashes are kept in the slots) */
+static void hash_grow(struct akl_state *s, struct akl_hash *h)
+{
+    struct akl_hash_slot *oslots = h->ht_slots;
+    unsigned int ocap = h->ht_cap;
+    unsigned int i, j, mask;
+    hash_alloc_slots(s, h, ocap * 2);
+    mask = h->ht_cap - 1;
+    for (i = 0; i < ocap; i++) {
+        if (oslots[i].hs_key == NULL)
+            continue;
+        for (j = oslots[i].hs_hash & mask; h->ht_slots[j].hs_key != NULL; j = (j + 1) & mask)
+            ;
+        h->ht_slots[j] = oslots[i];
+    }
+    akl_free(s, oslots, HASH_SLOT_BYTES(ocap));
+}
+
+/**
+ * @brief Look up a key
+ * @param h The hash table
+ * @param key The key
+ * Gives back NULL, if the key is not in the table.
+*/
+struct akl_value *akl_hash_get(struct akl_hash *h, struct akl_value *key)
+{
+    assert(h && key);
+    return hash_find_slot(h, key, akl_hash_value(key))->hs_value;
+}
+
+/**
+ * @brief Add a key or change its value
+ * @param s An instance of the interpreter
+ * @param h The hash table
+ * @param key The key (it should not be modified while it is in the table)
+ * @param value The new value
+*/
+void akl_hash_set(struct akl_state *s, struct akl_hash *h
+                  , struct akl_value *key, struct akl_value *value)
+{
+    unsigned int hash;
+    struct akl_hash_slot *slot;
+    assert(key && value);
+    hash = akl_hash_value(key);
+    slot = hash_find_slot(h, key, hash);
+    /* The marking only needs the overwritten value (scanning the
+      whole table every time would be quadratic), an old table
+      must be remembered for the minor collections */
+    if (s->ai_gc_marking) {
+        if (slot->hs_value != NULL)
+            akl_gc_mark_object(s, slot->hs_value, TRUE);
+    } else {
+        akl_gc_write_barrier(h);
+    }
+
+    if (slot->hs_key != NULL) {
+        slot->hs_value = value;
+        return;
+    }
+    if (HASH_IS_FULL(h)) {
+        hash_grow(s, h);
+        slot = hash_find_slot(h, key, hash);
+    }
+    slot->hs_key   = key;
+    slot->hs_value = value;
+    slot->hs_hash  = hash;
+    h->ht_count++;
+}
+
+/**
+ * @brief Remove a key
+ * @param s An instance of the interpreter
+ * @param h The hash table
+ * @param key The key
+ * Gives back FALSE, if the key was not in the table.
+*/
+bool_t akl_hash_del(struct akl_state *s, struct akl_hash *h, struct akl_value *key)
+{
+    unsigned int mask = h->ht_cap - 1;
+    struct akl_hash_slot *slot;
+    unsigned int i, j, k;
+    assert(key);
+    slot = hash_find_slot(h, key, akl_hash_value(key));
+    if (slot->hs_key == NULL)
+        return FALSE;
+
+    /* The removed ones were reachable when the marking started */
+    if (s->ai_gc_marking) {
+        akl_gc_mark_object(s, slot->hs_key, TRUE);
+        akl_gc_mark_object(s, slot->hs_value, TRUE);
+    }
+    /* Move back the slots, which are after their home slot, over the hole */
+    i = slot - h->ht_slots;
+    for (j = (i + 1) & mask; h->ht_slots[j].hs_key != NULL; j = (j + 1) & mask) {
+        k = h->ht_slots[j].hs_hash & mask;
+        if (((j - k) & mask) >= ((j - i) & mask)) {
+            h->ht_slots[i] = h->ht_slots[j];
+            i = j;
+        }
+    }
+    h->ht_slots[i].hs_key   = NULL;
+    h->ht_slots[i].hs_value = NULL;
+    h->ht_count--;
+    return TRUE;
+}
+
+unsigned int akl_hash_count(struct akl_hash *h)
+{
+    return (h != NULL) ? h->ht_count : 0;
+}
+
+/**
+ * @brief Iterate over the key-value pairs
+ * @param h The hash table
+ * @param ind Position of the iteration (start from zero)
+ * @param key Where to put the next key (can be NULL)
+ * @param value Where to put its value (can be NULL)
+ * Gives back FALSE after the last pair. The order is arbitrary and
+ * changes when the table is modified.
+*/
+bool_t akl_hash_next(struct akl_hash *h, unsigned int *ind
+                     , struct akl_value **key, struct akl_value **value)
+{
+    struct akl_hash_slot *slot;
+    while (*ind < h->ht_cap) {
+        slot = &h->ht_slots[(*ind)++];
+        if (slot->hs_key != NULL) {
+            if (key != NULL)
+                *key = slot->hs_key;
+            if (value != NULL)
+                *value = slot->hs_value;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* A copy of the table, with duplicated keys and values */
+struct akl_hash *akl_hash_duplicate(struct akl_state *s, struct akl_hash *h)
+{
+    struct akl_hash *nh = akl_new_hash(s, h->ht_count);
+    struct akl_value *key, *value;
+    unsigned int i = 0;
+    while (akl_hash_next(h, &i, &key, &value)) {
+        akl_hash_set(s, nh, akl_duplicate_value(s, key)
+                     , akl_duplicate_value(s, value));
+    }
+    return nh;
+}
+
+void akl_print_hash(struct akl_state *s, struct akl_hash *h)
+{
+    struct akl_value *key, *value;
+    unsigned int i = 0;
+    printf("<HASH");
+    while (akl_hash_next(h, &i, &key, &value)) {
+        printf(" ");
+        akl_print_value(s, key);
+        printf(" ");
+        akl_print_value(s, value);
+    }
+    printf(">");
+}
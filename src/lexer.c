@@ -31,6 +31,7 @@ static void init_lexer(struct akl_io_device *dev)
     dev->iod_buffer      = (char *)akl_alloc(dev->iod_state, DEF_BUFFER_SIZE);
     dev->iod_buffer_size = DEF_BUFFER_SIZE;
     dev->iod_backlog     = tEOF;
+    dev->iod_hash        = AKL_HASH_INIT;
 }
 
 void akl_lex_free(struct akl_io_device *dev)
@@ -54,10 +55,12 @@ const char *akl_lex_get_filename(struct akl_io_device *dev)
 static void 
 put_buffer(struct akl_io_device *dev, int pos, char ch)
 {
+    size_t osize = dev->iod_buffer_size;
     if (pos+1 >= dev->iod_buffer_size) {
         dev->iod_buffer_size = dev->iod_buffer_size
                 + (dev->iod_buffer_size / 2);
-        dev->iod_buffer = (char *)akl_realloc(dev->iod_state, dev->iod_buffer, dev->iod_buffer_size);
+        dev->iod_buffer = (char *)akl_realloc(dev->iod_state, dev->iod_buffer
+                                              , osize, dev->iod_buffer_size);
     }
     dev->iod_buffer[pos]   = ch;
     /* XXX: Take this serious! */
@@ -182,15 +185,22 @@ size_t copy_string(struct akl_io_device *dev)
     return i;
 }
 
+/* Atoms are case insensitive, the hash of the name is
+  computed here (see akl_hash_name()) */
 size_t copy_atom(struct akl_io_device *dev)
 {
     char ch;
     size_t i = 0;
+    unsigned int hash = AKL_HASH_INIT;
     assert(dev);
 
+    dev->iod_hash = hash;
     while ((ch = akl_io_getc(dev))) {
         if (ch != ' ' && ch != '(' && ch != ')' && ch != '\n') {
-            put_buffer(dev, i++, tolower(ch));
+            ch = tolower(ch);
+            hash = AKL_HASH_STEP(hash, ch);
+            put_buffer(dev, i++, ch);
+            dev->iod_hash = hash;
         } else {
             akl_io_ungetc(ch, dev);
             break;
@@ -268,6 +278,7 @@ akl_lex(struct akl_io_device *dev)
                     strcpy(dev->iod_buffer, "++");
                 else
                     strcpy(dev->iod_buffer, "--");
+                dev->iod_hash = akl_hash_name(dev->iod_buffer);
                 op = 0;
                 return tATOM;
             }
@@ -284,6 +295,7 @@ akl_lex(struct akl_io_device *dev)
                     strcpy(dev->iod_buffer, "+");
                 else
                     strcpy(dev->iod_buffer, "-");
+                dev->iod_hash = akl_hash_name(dev->iod_buffer);
                 op = 0;
                 if (ch == ')') {
                     akl_io_ungetc(ch, dev);
@@ -398,7 +410,8 @@ struct akl_symbol *
 akl_lex_get_symbol(struct akl_io_device *dev)
 {
     struct akl_symbol *sym;
-    sym = akl_get_or_create_symbol(dev->iod_state, dev->iod_buffer);
+    sym = akl_get_or_create_symbol_hash(dev->iod_state, dev->iod_buffer
+                                        , dev->iod_hash);
     dev->iod_buffer[0] = '\0';
     return sym;
 }
@@ -94,10 +94,28 @@ AKL_DEFINE_FUN(islist, cx, argc)
     return AKL_NIL;
 }
 
+AKL_DEFINE_FUN(iscons, cx, argc)
+{
+    struct akl_value *v = akl_frame_pop(cx);
+    if (AKL_CHECK_TYPE(v, AKL_VT_CONS)) {
+        return AKL_TRUE;
+    }
+    return AKL_NIL;
+}
+
+AKL_DEFINE_FUN(ishash, cx, argc)
+{
+    struct akl_value *v = akl_frame_pop(cx);
+    if (AKL_CHECK_TYPE(v, AKL_VT_HASH)) {
+        return AKL_TRUE;
+    }
+    return AKL_NIL;
+}
+
 AKL_DEFINE_FUN(isnumber, cx, argc)
 {
-    double *n = akl_frame_pop_number(cx);
-    if (n == NULL) {
+    double n;
+    if (!akl_frame_pop_number(cx, &n)) {
         return AKL_NIL;
     }
     return AKL_TRUE;
@@ -129,17 +147,95 @@ AKL_DEFINE_FUN(describe, cx, argc)
 
 extern void show_features(struct akl_state *, const char *fname); // @ util.c
 
+/* Names of the base GC types (for akl-cfg! :gc-pool-size) */
+static const char *gc_type_names[AKL_GC_NR_BASE_TYPES] = {
+    "value", "variable", "list", "list-entry", "function", "udata", "cons"
+  , "hash", "fvector"
+};
+
+/*
+ * GC settings with a value:
+ *  (akl-cfg! :gc-growth 150)
+ *  (akl-cfg! :gc-min-heap 1048576)
+ *  (akl-cfg! :gc-nursery 524288)
+ *  (akl-cfg! :gc-mark-rate 300)
+ *  (akl-cfg! :gc-max-pause 2000)
+ *  (akl-cfg! :gc-mark-threads 4)
+ *  (akl-cfg! :gc-pool-size :list-entry 1024)
+*/
+static struct akl_value *
+set_gc_option(struct akl_context *cx, const char *sname)
+{
+    struct akl_state *s = cx->cx_state;
+    struct akl_value *tv;
+    akl_gc_type_t tid;
+    double n;
+
+    if (strcmp(sname, "gc-pool-size") == 0) {
+        tv = akl_frame_shift(cx);
+        if (!AKL_CHECK_TYPE(tv, AKL_VT_SYMBOL)) {
+            akl_raise_error(cx, AKL_ERROR, "%s: Expected a GC type name", cx->cx_func_name);
+            return AKL_NIL;
+        }
+        for (tid = 0; tid < AKL_GC_NR_BASE_TYPES; tid++) {
+            if (strcmp(gc_type_names[tid], tv->va_value.symbol->sb_name) == 0)
+                break;
+        }
+        if (tid == AKL_GC_NR_BASE_TYPES) {
+            akl_raise_error(cx, AKL_WARNING, "Unknown GC type '%s'"
+                            , tv->va_value.symbol->sb_name);
+            return AKL_NIL;
+        }
+        if (!akl_frame_shift_number(cx, &n) || n < 0)
+            goto need_number;
+        if (!akl_gc_set_pool_size(s, tid, (unsigned int)n)) {
+            akl_raise_error(cx, AKL_WARNING, "Too many objects for a GC pool");
+            return AKL_NIL;
+        }
+        return AKL_TRUE;
+    }
+
+    if (!akl_frame_shift_number(cx, &n) || n < 0)
+        goto need_number;
+    if (strcmp(sname, "gc-growth") == 0) {
+        akl_gc_set_growth(s, (unsigned int)n);
+    } else if (strcmp(sname, "gc-min-heap") == 0) {
+        akl_gc_set_min_heap(s, (size_t)n);
+    } else if (strcmp(sname, "gc-nursery") == 0) {
+        akl_gc_set_nursery(s, (size_t)n);
+    } else if (strcmp(sname, "gc-mark-rate") == 0) {
+        akl_gc_set_mark_rate(s, (unsigned int)n);
+    } else if (strcmp(sname, "gc-max-pause") == 0) {
+        akl_gc_set_max_pause(s, (unsigned long)n);
+    } else if (strcmp(sname, "gc-mark-threads") == 0) {
+        akl_gc_set_mark_threads(s, (unsigned int)n);
+    } else {
+        akl_raise_error(cx, AKL_WARNING, "Cannot set option '%s'", sname);
+        return AKL_NIL;
+    }
+    return AKL_TRUE;
+
+need_number:
+    akl_raise_error(cx, AKL_ERROR, "%s: Expected a non-negative number for '%s'"
+                    , cx->cx_func_name, sname);
+    return AKL_NIL;
+}
+
 // To set specific interpreter features
 AKL_DEFINE_FUN(akl_cfg, cx, argc)
 {
-    struct akl_symbol *sym;
+    struct akl_value *v = akl_frame_shift(cx);
     const char *sname;
     struct akl_state *s = cx->cx_state;
-    if (akl_get_args_strict(cx, 1, AKL_VT_OPT, AKL_VT_SYMBOL, &sym) == -1) {
+    /* The symbol is optional, so it is not checked by akl_get_args_strict() */
+    if (!AKL_CHECK_TYPE(v, AKL_VT_SYMBOL)) {
        show_features(s, cx->cx_func_name);
        return AKL_NIL;
     }
-    sname = sym->sb_name;
+    sname = v->va_value.symbol->sb_name;
+    if (argc > 1)
+        return set_gc_option(cx, sname);
+
     if (akl_set_feature(s, sname)) {
         return AKL_TRUE;
     } else {
@@ -151,6 +247,80 @@ AKL_DEFINE_FUN(akl_cfg, cx, argc)
     }
 }
 
+/* A keyword (like :name) */
+static struct akl_value *
+gc_stats_key(struct akl_state *s, const char *name)
+{
+    struct akl_value *v = akl_new_sym_value(s, akl_new_symbol(s, (char *)name, TRUE));
+    v->is_quoted = TRUE;
+    return v;
+}
+
+/* Append a ':name value' pair to a property list */
+static void
+gc_stats_put(struct akl_state *s, struct akl_list *l, const char *name, double n)
+{
+    akl_list_append_value(s, l, gc_stats_key(s, name));
+    akl_list_append_value(s, l, akl_new_number_value(s, n));
+}
+
+/*
+ * The counters of the collector as a property list:
+ *  (:minor 12 :major 2 ... :pauses (0 3 ...) :types ((:value :allocs 100 ...) ...))
+ * The times are in microseconds, the histogram counts the pauses
+ * from 2^i to 2^(i+1) microseconds in its i. element.
+*/
+AKL_DEFINE_FUN(gc_stats, cx, argc)
+{
+    struct akl_state *s = cx->cx_state;
+    struct akl_gc_stats st;
+    struct akl_gc_type_stats ts;
+    struct akl_list *l, *hl, *tl, *el;
+    akl_gc_type_t tid;
+    int i;
+
+    akl_gc_get_stats(s, &st);
+    l = akl_new_list(s);
+    gc_stats_put(s, l, "minor", st.gs_minor);
+    gc_stats_put(s, l, "major", st.gs_major);
+    gc_stats_put(s, l, "steps", st.gs_steps);
+    gc_stats_put(s, l, "total-time", st.gs_total_time);
+    gc_stats_put(s, l, "sweep-time", st.gs_sweep_time);
+    gc_stats_put(s, l, "last-pause", st.gs_last_pause);
+    gc_stats_put(s, l, "max-pause", st.gs_max_pause);
+    gc_stats_put(s, l, "malloc-bytes", st.gs_malloc_bytes);
+    gc_stats_put(s, l, "heap-bytes", st.gs_heap_bytes);
+    gc_stats_put(s, l, "live", st.gs_live);
+    gc_stats_put(s, l, "live-bytes", st.gs_live_bytes);
+
+    hl = akl_new_list(s);
+    hl->is_quoted = TRUE;
+    for (i = 0; i < AKL_GC_PAUSE_BUCKETS; i++)
+        akl_list_append_value(s, hl, akl_new_number_value(s, st.gs_pauses[i]));
+    akl_list_append_value(s, l, gc_stats_key(s, "pauses"));
+    akl_list_append_value(s, l, akl_new_list_value(s, hl));
+
+    tl = akl_new_list(s);
+    tl->is_quoted = TRUE;
+    for (tid = 0; tid < AKL_GC_NR_BASE_TYPES; tid++) {
+        akl_gc_get_type_stats(s, tid, &ts);
+        el = akl_new_list(s);
+        el->is_quoted = TRUE;
+        akl_list_append_value(s, el, gc_stats_key(s, gc_type_names[tid]));
+        gc_stats_put(s, el, "allocs", ts.ts_allocs);
+        gc_stats_put(s, el, "used", ts.ts_used);
+        gc_stats_put(s, el, "live", ts.ts_live);
+        gc_stats_put(s, el, "live-bytes", ts.ts_live_bytes);
+        gc_stats_put(s, el, "pools", ts.ts_pools);
+        gc_stats_put(s, el, "bytes", ts.ts_bytes);
+        akl_list_append_value(s, tl, akl_new_list_value(s, el));
+    }
+    akl_list_append_value(s, l, gc_stats_key(s, "types"));
+    akl_list_append_value(s, l, akl_new_list_value(s, tl));
+    l->is_quoted = TRUE;
+    return akl_new_list_value(s, l);
+}
+
 AKL_DEFINE_FUN(print, cx, argc)
 {
     struct akl_value *v;
@@ -167,7 +337,7 @@ formatted_display(struct akl_context *ctx)
 {
     struct akl_value *v;
     while ((v = akl_frame_shift(ctx)) != NULL) {
-        switch (v->va_type) {
+        switch (AKL_TYPE(v)) {
             case AKL_VT_NUMBER:
             printf("%g", AKL_GET_NUMBER_VALUE(v));
             break;
@@ -198,9 +368,9 @@ AKL_DEFINE_FUN(write, cx, argc)
 AKL_DEFINE_FUN(plus, cx, argc)
 {
     double sum = 0.0;
-    double *n;
-    while ((n = akl_frame_pop_number(cx)) != NULL) {
-       sum += *n;
+    double n;
+    while (akl_frame_pop_number(cx, &n)) {
+       sum += n;
     }
 
     return AKL_NUMBER(cx, sum);
@@ -238,9 +408,9 @@ not_a_number:
 AKL_DEFINE_FUN(mul, cx, argc)
 {
     double prod = 1.0;
-    double *n;
-    while ((n = akl_frame_pop_number(cx)) != NULL) {
-       prod *= *n;
+    double n;
+    while (akl_frame_pop_number(cx, &n)) {
+       prod *= n;
     }
 
     return AKL_NUMBER(cx, prod);
@@ -248,46 +418,38 @@ AKL_DEFINE_FUN(mul, cx, argc)
 
 AKL_DEFINE_FUN(ddiv, cx, argc)
 {
-    double *n = akl_frame_shift_number(cx);
+    double n;
     double div = 0.0;
-    if (n == NULL) {
+    if (!akl_frame_shift_number(cx, &n)) {
         return AKL_NUMBER(cx, 0.0);
     }
-    div = (*n);
-    do {
-        n = akl_frame_shift_number(cx);
-        if (n == NULL) {
-            return AKL_NUMBER(cx, div);
-        }
-        if ((*n) == 0.0) {
+    div = n;
+    while (akl_frame_shift_number(cx, &n)) {
+        if (n == 0.0) {
             akl_raise_error(cx, AKL_ERROR, "Zero division.");
             return AKL_NIL;
         }
-        div /= (*n);
-    } while (n);
+        div /= n;
+    }
 
     return AKL_NUMBER(cx, div);
 }
 
 AKL_DEFINE_FUN(idiv, cx, argc)
 {
-    double *n = akl_frame_shift_number(cx);
+    double n;
     long div = 0;
-    if (n == NULL) {
+    if (!akl_frame_shift_number(cx, &n)) {
         return AKL_NUMBER(cx, 0);
     }
-    div = (*n);
-    do {
-        n = akl_frame_shift_number(cx);
-        if (n == NULL) {
-            return AKL_NUMBER(cx, div);
-        }
-        if (((long)(*n)) == 0) {
+    div = n;
+    while (akl_frame_shift_number(cx, &n)) {
+        if (((long)n) == 0) {
             akl_raise_error(cx, AKL_ERROR, "Zero division.");
             return AKL_NIL;
         }
-        div /= (int)(*n);
-    } while (n);
+        div /= (int)n;
+    }
 
     return AKL_NUMBER(cx, div);
 }
@@ -341,11 +503,10 @@ AKL_DEFINE_FUN(hello, cx, argc)
 AKL_DEFINE_FUN(dump_stack, cx, argc)
 {
     struct akl_value *v;
-    struct akl_list_entry *ent;
-    int n = 0;
+    unsigned int n;
     printf("stack contents:\n");
-    AKL_LIST_FOREACH(ent, cx->cx_stack) {
-        v = (struct akl_value *)ent->le_data;
+    for (n = 0; n < akl_vector_count(cx->cx_stack); n++) {
+        v = AKL_STACK_AT(cx->cx_stack, n);
         printf("%%%d: ", n);
         akl_print_value(cx->cx_state, v);
         printf("\n");
@@ -447,6 +608,17 @@ AKL_DEFINE_FUN(length, ctx, argc)
         case AKL_VT_LIST:
         return akl_new_number_value(ctx->cx_state
                           , (double)akl_list_count(AKL_GET_LIST_VALUE(vp)));
+
+        case AKL_VT_CONS:
+        return akl_new_number_value(ctx->cx_state, (double)akl_cons_count(vp));
+
+        case AKL_VT_HASH:
+        return akl_new_number_value(ctx->cx_state
+                          , (double)akl_hash_count(AKL_GET_HASH_VALUE(vp)));
+
+        case AKL_VT_FVECTOR:
+        return akl_new_number_value(ctx->cx_state
+                          , (double)AKL_FVECTOR_COUNT(AKL_GET_FVECTOR_VALUE(vp)));
         default:
         akl_raise_error(ctx, AKL_ERROR, "Argument must be a list or a string!");
     }
@@ -455,12 +627,14 @@ AKL_DEFINE_FUN(length, ctx, argc)
 
 AKL_DEFINE_FUN(ls_index, ctx, argc)
 {
-    double *n = akl_frame_shift_number(ctx);
+    double n;
+    bool_t has_index = akl_frame_shift_number(ctx, &n);
     int i;
     struct akl_value *v = akl_frame_pop(ctx);
+    struct akl_fvector *fv;
     char *t;
     char *ns;
-    if (n == NULL) {
+    if (!has_index) {
         akl_raise_error(ctx, AKL_ERROR, "No index is given.");
         return AKL_NIL;
     }
@@ -470,7 +644,7 @@ AKL_DEFINE_FUN(ls_index, ctx, argc)
         return AKL_NIL;
     }
 
-    i = (int)*n;
+    i = (int)n;
 
     switch (AKL_TYPE(v)) {
         case AKL_VT_STRING:
@@ -488,6 +662,21 @@ AKL_DEFINE_FUN(ls_index, ctx, argc)
         v = akl_list_index_value(AKL_GET_LIST_VALUE(v), i);
         break;
 
+        case AKL_VT_CONS:
+        v = akl_cons_index(v, i);
+        break;
+
+        case AKL_VT_FVECTOR:
+        fv = AKL_GET_FVECTOR_VALUE(v);
+        v = NULL;
+        /* Negative indexes count from the end, like for the lists */
+        if (i < 0)
+            i += AKL_FVECTOR_COUNT(fv);
+        if (i >= 0 && i < AKL_FVECTOR_COUNT(fv)) {
+            v = AKL_NUMBER(ctx, AKL_FVECTOR_DATA(fv)[i]);
+        }
+        break;
+
         default:
         akl_raise_error(ctx, AKL_ERROR, "Argument must be a list or a string!");
         break;
@@ -522,6 +711,10 @@ AKL_DEFINE_FUN(ls_head, ctx, argc)
         v = akl_list_head(AKL_GET_LIST_VALUE(v));
         break;
 
+        case AKL_VT_CONS:
+        v = v->va_value.cons->cs_car;
+        break;
+
         default:
         akl_raise_error(ctx, AKL_ERROR, "Argument must be a list or a string!");
         break;
@@ -558,6 +751,10 @@ AKL_DEFINE_FUN(ls_last, ctx, argc)
         v = akl_list_last(AKL_GET_LIST_VALUE(v));
         break;
 
+        case AKL_VT_CONS:
+        v = akl_cons_index(v, -1);
+        break;
+
         default:
         akl_raise_error(ctx, AKL_ERROR, "Argument must be a list or a string!");
         break;
@@ -598,6 +795,11 @@ AKL_DEFINE_FUN(ls_tail, ctx, argc)
         }
         break;
 
+        case AKL_VT_CONS:
+        /* The rest is already there, nothing to allocate */
+        v = v->va_value.cons->cs_cdr;
+        break;
+
         default:
         akl_raise_error(ctx, AKL_ERROR, "Argument must be a list or a string!");
         break;
@@ -684,9 +886,9 @@ AKL_DEFINE_FUN(ls_append, ctx, argc)
         break;
 
         case AKL_VT_NIL:
-        l = akl_new_list(ctx->cx_state);
+        l = akl_new_data_list(ctx->cx_state, 0);
         v = akl_new_list_value(ctx->cx_state, l);
-        akl_list_append(ctx->cx_state, l, iv);
+        akl_list_append_value(ctx->cx_state, l, iv);
         break;
 
         default:
@@ -704,7 +906,7 @@ AKL_DEFINE_FUN(progn, ctx, argc)
 AKL_DEFINE_FUN(list, ctx, argc)
 {
     struct akl_value *v;
-    struct akl_list *list = akl_new_list(ctx->cx_state);
+    struct akl_list *list = akl_new_data_list(ctx->cx_state, argc);
     while ((v = akl_frame_shift(ctx))) {
         akl_list_append_value(ctx->cx_state, list, v);
     }
@@ -712,84 +914,658 @@ AKL_DEFINE_FUN(list, ctx, argc)
     return akl_new_list_value(ctx->cx_state, list);
 }
 
+AKL_DEFINE_FUN(cons, ctx, argc)
+{
+    struct akl_value *car, *cdr;
+    if (akl_get_args(ctx, 2, &car, &cdr) == -1) {
+        return AKL_NIL;
+    }
+    return akl_new_cons_value(ctx->cx_state, car, cdr);
+}
+
+AKL_DEFINE_FUN(to_cons, ctx, argc)
+{
+    struct akl_value *v;
+    if (akl_get_args(ctx, 1, &v) == -1) {
+        return AKL_NIL;
+    }
+
+    switch (AKL_TYPE(v)) {
+        case AKL_VT_LIST:
+        return akl_list_to_cons(ctx->cx_state, AKL_GET_LIST_VALUE(v));
+
+        case AKL_VT_CONS:
+        case AKL_VT_NIL:
+        return v;
+
+        default:
+        akl_raise_error(ctx, AKL_ERROR, "Argument must be a list!");
+        break;
+    }
+    return AKL_NIL;
+}
+
+/*
+ * Hash tables:
+ *  (set! h (make-hash :a 1 :b 2))
+ *  (hash-set! :c 3 h)
+ *  (hash-get :c h)       => 3
+ *  (hash-get :d h 0)     => 0 (the default, if the key is missing)
+ *  (hash-del! :a h)
+*/
+AKL_DEFINE_FUN(make_hash, ctx, argc)
+{
+    struct akl_hash *h;
+    struct akl_value *key, *value;
+    if (argc % 2 != 0) {
+        akl_raise_error(ctx, AKL_ERROR, "%s: Expected key-value pairs", ctx->cx_func_name);
+        return AKL_NIL;
+    }
+    h = akl_new_hash(ctx->cx_state, argc / 2);
+    while ((key = akl_frame_shift(ctx)) != NULL) {
+        value = akl_frame_shift(ctx);
+        akl_hash_set(ctx->cx_state, h, key, value);
+    }
+    return akl_new_hash_value(ctx->cx_state, h);
+}
+
+AKL_DEFINE_FUN(hash_get, ctx, argc)
+{
+    struct akl_value *key, *hv, *value, *def = AKL_NIL;
+    if (argc != 2 && argc != 3) {
+        akl_raise_error(ctx, AKL_ERROR, "%s: Expected a key, a hash table and an optional default"
+                        , ctx->cx_func_name);
+        return AKL_NIL;
+    }
+    key = akl_frame_shift(ctx);
+    hv  = akl_frame_shift(ctx);
+    if (argc == 3) {
+        def = akl_frame_shift(ctx);
+    }
+    if (!AKL_CHECK_TYPE(hv, AKL_VT_HASH)) {
+        akl_raise_error(ctx, AKL_ERROR, "%s: Expected hash but got %s"
+                        , ctx->cx_func_name, akl_type_name[AKL_TYPE(hv)]);
+        return AKL_NIL;
+    }
+    value = akl_hash_get(AKL_GET_HASH_VALUE(hv), key);
+    return (value != NULL) ? value : def;
+}
+
+AKL_DEFINE_FUN(hash_set, ctx, argc)
+{
+    struct akl_value *key, *value;
+    struct akl_hash *h;
+    if (akl_get_args_strict(ctx, 3, AKL_VT_ANY, &key, AKL_VT_ANY, &value
+                            , AKL_VT_HASH, &h) == -1) {
+        return AKL_NIL;
+    }
+    akl_hash_set(ctx->cx_state, h, key, value);
+    return value;
+}
+
+AKL_DEFINE_FUN(hash_del, ctx, argc)
+{
+    struct akl_value *key;
+    struct akl_hash *h;
+    if (akl_get_args_strict(ctx, 2, AKL_VT_ANY, &key, AKL_VT_HASH, &h) == -1) {
+        return AKL_NIL;
+    }
+    return akl_hash_del(ctx->cx_state, h, key) ? AKL_TRUE : AKL_NIL;
+}
+
+AKL_DEFINE_FUN(hash_count, ctx, argc)
+{
+    struct akl_hash *h;
+    if (akl_get_args_strict(ctx, 1, AKL_VT_HASH, &h) == -1) {
+        return AKL_NIL;
+    }
+    return AKL_NUMBER(ctx, akl_hash_count(h));
+}
+
+/* The keys or the values of a table in a list */
+static struct akl_value *
+hash_items(struct akl_context *ctx, bool_t is_keys)
+{
+    struct akl_hash *h;
+    struct akl_list *l;
+    struct akl_value *key, *value;
+    unsigned int i = 0;
+    if (akl_get_args_strict(ctx, 1, AKL_VT_HASH, &h) == -1) {
+        return AKL_NIL;
+    }
+    l = akl_new_data_list(ctx->cx_state, akl_hash_count(h));
+    l->is_quoted = TRUE;
+    while (akl_hash_next(h, &i, &key, &value)) {
+        akl_list_append_value(ctx->cx_state, l, is_keys ? key : value);
+    }
+    return akl_new_list_value(ctx->cx_state, l);
+}
+
+AKL_DEFINE_FUN(hash_keys, ctx, argc)
+{
+    return hash_items(ctx, TRUE);
+}
+
+AKL_DEFINE_FUN(hash_values, ctx, argc)
+{
+    return hash_items(ctx, FALSE);
+}
+
+/*
+ * Number vectors (the loops are vectorized, see fvector.c):
+ *  (set! v (fvector 1 2 3))
+ *  (to-fvector '(1 2 3))    => <FVECTOR 1 2 3>
+ *  (fvector-range 1 4)      => <FVECTOR 1 2 3 4>
+ *  (fvector-sum v)          => 6
+ *  (fvector-dot v v)        => 14
+ *  (fvector-add v v)        => <FVECTOR 2 4 6>
+ *  (fvector-scale v 0.5)    => <FVECTOR 0.5 1 1.5>
+ *  (fvector-prefix-sum v)   => <FVECTOR 1 3 6>
+ *  (fvector-gt v 1)         => <FVECTOR 0 1 1> (a mask, see fvector-sum)
+*/
+AKL_DEFINE_FUN(fvector, ctx, argc)
+{
+    struct akl_fvector *fv = akl_new_fvector(ctx->cx_state, argc);
+    struct akl_value *v;
+    unsigned int i = 0;
+    while ((v = akl_frame_shift(ctx)) != NULL) {
+        if (!AKL_CHECK_TYPE(v, AKL_VT_NUMBER)) {
+            akl_raise_error(ctx, AKL_ERROR, "%s: Expected number but got %s"
+                            , ctx->cx_func_name, akl_type_name[AKL_TYPE(v)]);
+            return AKL_NIL;
+        }
+        AKL_FVECTOR_DATA(fv)[i++] = AKL_GET_NUMBER_VALUE(v);
+    }
+    return akl_new_fvector_value(ctx->cx_state, fv);
+}
+
+AKL_DEFINE_FUN(to_fvector, ctx, argc)
+{
+    struct akl_fvector *fv;
+    struct akl_value *v;
+    if (akl_get_args(ctx, 1, &v) == -1) {
+        return AKL_NIL;
+    }
+
+    switch (AKL_TYPE(v)) {
+        case AKL_VT_LIST:
+        case AKL_VT_CONS:
+        fv = akl_fvector_from(ctx->cx_state, v);
+        if (fv == NULL) {
+            akl_raise_error(ctx, AKL_ERROR, "%s: Only numbers can be in a number vector"
+                            , ctx->cx_func_name);
+            return AKL_NIL;
+        }
+        return akl_new_fvector_value(ctx->cx_state, fv);
+
+        case AKL_VT_NIL:
+        return akl_new_fvector_value(ctx->cx_state, akl_new_fvector(ctx->cx_state, 0));
+
+        case AKL_VT_FVECTOR:
+        return v;
+
+        default:
+        akl_raise_error(ctx, AKL_ERROR, "Argument must be a list!");
+        break;
+    }
+    return AKL_NIL;
+}
+
+AKL_DEFINE_FUN(fvector_range, ctx, argc)
+{
+    double fp, tp;
+    struct akl_fvector *fv;
+    int f, t, i;
+    if (akl_get_args_strict(ctx, 2, AKL_VT_NUMBER, &fp, AKL_VT_NUMBER, &tp) == -1) {
+        return AKL_NIL;
+    }
+
+    f = (int)fp;
+    t = (int)tp;
+    fv = akl_new_fvector(ctx->cx_state, (f <= t) ? t - f + 1 : 0);
+    for (i = 0; f <= t; f++, i++) {
+        AKL_FVECTOR_DATA(fv)[i] = (double)f;
+    }
+    return akl_new_fvector_value(ctx->cx_state, fv);
+}
+
+AKL_DEFINE_FUN(fvector_to_list, ctx, argc)
+{
+    struct akl_fvector *fv;
+    struct akl_list *l;
+    unsigned int i;
+    if (akl_get_args_strict(ctx, 1, AKL_VT_FVECTOR, &fv) == -1) {
+        return AKL_NIL;
+    }
+    l = akl_new_data_list(ctx->cx_state, AKL_FVECTOR_COUNT(fv));
+    l->is_quoted = TRUE;
+    for (i = 0; i < AKL_FVECTOR_COUNT(fv); i++) {
+        akl_list_append_value(ctx->cx_state, l, AKL_NUMBER(ctx, AKL_FVECTOR_DATA(fv)[i]));
+    }
+    return akl_new_list_value(ctx->cx_state, l);
+}
+
+AKL_DEFINE_FUN(isfvector, cx, argc)
+{
+    struct akl_value *v = akl_frame_pop(cx);
+    if (AKL_CHECK_TYPE(v, AKL_VT_FVECTOR)) {
+        return AKL_TRUE;
+    }
+    return AKL_NIL;
+}
+
+AKL_DEFINE_FUN(fvector_sum, ctx, argc)
+{
+    struct akl_fvector *fv;
+    if (akl_get_args_strict(ctx, 1, AKL_VT_FVECTOR, &fv) == -1) {
+        return AKL_NIL;
+    }
+    return AKL_NUMBER(ctx, akl_fvector_sum(fv));
+}
+
+/* Nil for an empty vector */
+AKL_DEFINE_FUN(fvector_min, ctx, argc)
+{
+    struct akl_fvector *fv;
+    double r;
+    if (akl_get_args_strict(ctx, 1, AKL_VT_FVECTOR, &fv) == -1
+            || !akl_fvector_min(fv, &r)) {
+        return AKL_NIL;
+    }
+    return AKL_NUMBER(ctx, r);
+}
+
+AKL_DEFINE_FUN(fvector_max, ctx, argc)
+{
+    struct akl_fvector *fv;
+    double r;
+    if (akl_get_args_strict(ctx, 1, AKL_VT_FVECTOR, &fv) == -1
+            || !akl_fvector_max(fv, &r)) {
+        return AKL_NIL;
+    }
+    return AKL_NUMBER(ctx, r);
+}
+
+/* The two vectors of the element-wise operations (with the same size) */
+static bool_t
+fvector_get_pair(struct akl_context *ctx, struct akl_fvector **a, struct akl_fvector **b)
+{
+    if (akl_get_args_strict(ctx, 2, AKL_VT_FVECTOR, a, AKL_VT_FVECTOR, b) == -1) {
+        return FALSE;
+    }
+    if (AKL_FVECTOR_COUNT(*a) != AKL_FVECTOR_COUNT(*b)) {
+        akl_raise_error(ctx, AKL_ERROR, "%s: The vectors must have the same length"
+                        , ctx->cx_func_name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+AKL_DEFINE_FUN(fvector_dot, ctx, argc)
+{
+    struct akl_fvector *a, *b;
+    if (!fvector_get_pair(ctx, &a, &b)) {
+        return AKL_NIL;
+    }
+    return AKL_NUMBER(ctx, akl_fvector_dot(a, b));
+}
+
+AKL_DEFINE_FUN(fvector_add, ctx, argc)
+{
+    struct akl_fvector *a, *b, *r;
+    if (!fvector_get_pair(ctx, &a, &b)) {
+        return AKL_NIL;
+    }
+    r = akl_new_fvector(ctx->cx_state, AKL_FVECTOR_COUNT(a));
+    akl_fvector_add(r, a, b);
+    return akl_new_fvector_value(ctx->cx_state, r);
+}
+
+AKL_DEFINE_FUN(fvector_mul, ctx, argc)
+{
+    struct akl_fvector *a, *b, *r;
+    if (!fvector_get_pair(ctx, &a, &b)) {
+        return AKL_NIL;
+    }
+    r = akl_new_fvector(ctx->cx_state, AKL_FVECTOR_COUNT(a));
+    akl_fvector_mul(r, a, b);
+    return akl_new_fvector_value(ctx->cx_state, r);
+}
+
+AKL_DEFINE_FUN(fvector_prefix_sum, ctx, argc)
+{
+    struct akl_fvector *fv, *r;
+    if (akl_get_args_strict(ctx, 1, AKL_VT_FVECTOR, &fv) == -1) {
+        return AKL_NIL;
+    }
+    r = akl_new_fvector(ctx->cx_state, AKL_FVECTOR_COUNT(fv));
+    akl_fvector_prefix_sum(r, fv);
+    return akl_new_fvector_value(ctx->cx_state, r);
+}
+
+/* The operations with a vector and a number */
+static struct akl_value *
+fvector_with_number(struct akl_context *ctx
+                    , void (*op)(struct akl_fvector *, struct akl_fvector *, double))
+{
+    struct akl_fvector *fv, *r;
+    double n;
+    if (akl_get_args_strict(ctx, 2, AKL_VT_FVECTOR, &fv, AKL_VT_NUMBER, &n) == -1) {
+        return AKL_NIL;
+    }
+    r = akl_new_fvector(ctx->cx_state, AKL_FVECTOR_COUNT(fv));
+    op(r, fv, n);
+    return akl_new_fvector_value(ctx->cx_state, r);
+}
+
+AKL_DEFINE_FUN(fvector_scale, ctx, argc)
+{
+    return fvector_with_number(ctx, akl_fvector_scale);
+}
+
+AKL_DEFINE_FUN(fvector_lt, ctx, argc)
+{
+    return fvector_with_number(ctx, akl_fvector_less);
+}
+
+AKL_DEFINE_FUN(fvector_gt, ctx, argc)
+{
+    return fvector_with_number(ctx, akl_fvector_greater);
+}
+
 AKL_DEFINE_FUN(map, ctx, argc)
 {
     struct akl_function *fn;
     struct akl_list *lp, *nl;
-    struct akl_list_entry *it;
-    struct akl_value *v;
+    struct akl_list_iter it;
+    struct akl_value *v, *rv;
     struct akl_context *cx;
     // TODO: Change TYPE_* to bit masks.
     if (akl_get_args_strict(ctx, 2, AKL_VT_LIST, &lp, AKL_VT_FUNCTION, &fn) == -1) {
        return AKL_NIL;
     }
-    it = akl_list_it_begin(lp);
+    akl_list_iter_init(&it, lp);
     cx = akl_bound_function(ctx, NULL, fn);
-    nl = akl_new_list(ctx->cx_state);
+    nl = akl_new_data_list(ctx->cx_state, akl_list_count(lp));
     nl->is_quoted = TRUE;
-    while ((v = akl_list_it_next(&it)) != NULL) {
+    /* Keep the result on the stack, the GC may run during the calls */
+    rv = akl_new_list_value(ctx->cx_state, nl);
+    akl_stack_push(ctx, rv);
+    while ((v = akl_list_iter_next(&it)) != NULL) {
         akl_stack_push(ctx, v);
         akl_call_function_bound(cx, 1); /* TODO: How to go with more arguments? */
         akl_list_append_value(ctx->cx_state, nl, akl_stack_pop(ctx));
     }
+    akl_unbound_function(cx);
 
-    return akl_new_list_value(ctx->cx_state, nl);
+    return rv;
 }
 
 AKL_DEFINE_FUN(map_index, ctx, argc)
 {
     struct akl_function *fn;
     struct akl_list *lp, *nl;
-    struct akl_list_entry *it;
-    struct akl_value *v;
+    struct akl_list_iter it;
+    struct akl_value *v, *rv;
     struct akl_context *cx;
     int ind = 0;
     // TODO: Change TYPE_* to bit masks.
     if (akl_get_args_strict(ctx, 2, AKL_VT_LIST, &lp, AKL_VT_FUNCTION, &fn) == -1) {
        return AKL_NIL;
     }
-    it = akl_list_it_begin(lp);
+    akl_list_iter_init(&it, lp);
     cx = akl_bound_function(ctx, NULL, fn);
-    nl = akl_new_list(ctx->cx_state);
+    nl = akl_new_data_list(ctx->cx_state, akl_list_count(lp));
     nl->is_quoted = TRUE;
-    while ((v = akl_list_it_next(&it)) != NULL) {
+    rv = akl_new_list_value(ctx->cx_state, nl);
+    akl_stack_push(ctx, rv);
+    while ((v = akl_list_iter_next(&it)) != NULL) {
         akl_stack_push(ctx, AKL_NUMBER(ctx, ind++));
         akl_stack_push(ctx, v);
         akl_call_function_bound(cx, 1);
         akl_list_append_value(ctx->cx_state, nl, akl_stack_pop(ctx));
     }
+    akl_unbound_function(cx);
 
-    return akl_new_list_value(ctx->cx_state, nl);
+    return rv;
 }
 
 AKL_DEFINE_FUN(foldl, ctx, argc)
 {
     struct akl_function *fn;
     struct akl_list *lp;
-    struct akl_list_entry *it;
+    struct akl_list_iter it;
     struct akl_value *v, *vl;
     struct akl_context *cx;
     if (akl_get_args_strict(ctx, 3, AKL_VT_ANY, &v, AKL_VT_LIST, &lp, AKL_VT_FUNCTION, &fn) == -1) {
        return AKL_NIL;
     }
-    it = akl_list_it_begin(lp);
+    akl_list_iter_init(&it, lp);
     cx = akl_bound_function(ctx, NULL, fn);
-    while ((vl = akl_list_it_next(&it)) != NULL) {
+    while ((vl = akl_list_iter_next(&it)) != NULL) {
         akl_stack_push(cx, v);
         akl_stack_push(cx, vl);
         akl_call_function_bound(cx, 2);
         v = akl_stack_pop(cx);
     }
+    akl_unbound_function(cx);
 
     return v;
 }
 
+/* Sort orders for the sort builtins (the compare builtins are called directly) */
+static bool_t sort_less(void *data, struct akl_value *a, struct akl_value *b)
+{
+    return akl_compare_values(a, b) < 0;
+}
+
+static bool_t sort_greater(void *data, struct akl_value *a, struct akl_value *b)
+{
+    return akl_compare_values(a, b) > 0;
+}
+
+/* Lists of numbers only (the most common case) */
+static bool_t sort_less_number(void *data, struct akl_value *a, struct akl_value *b)
+{
+    return AKL_GET_NUMBER_VALUE(a) < AKL_GET_NUMBER_VALUE(b);
+}
+
+static bool_t sort_greater_number(void *data, struct akl_value *a, struct akl_value *b)
+{
+    return AKL_GET_NUMBER_VALUE(a) > AKL_GET_NUMBER_VALUE(b);
+}
+
+static bool_t sort_is_numbers(struct akl_list *l)
+{
+    struct akl_list_iter it;
+    struct akl_value *v;
+    akl_list_iter_init(&it, l);
+    while ((v = akl_list_iter_next(&it)) != NULL) {
+        if (!AKL_CHECK_TYPE(v, AKL_VT_NUMBER))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Any other function is called with the two values */
+static bool_t sort_call(void *data, struct akl_value *a, struct akl_value *b)
+{
+    struct akl_context *cx = (struct akl_context *)data;
+    struct akl_value *r;
+    akl_stack_push(cx, a);
+    akl_stack_push(cx, b);
+    akl_call_function_bound(cx, 2);
+    r = akl_stack_pop(cx);
+    return !AKL_IS_NIL(r);
+}
+
+/* Packed copy of a list (or of a cons list, when it is NULL) */
+static struct akl_list *
+sort_copy(struct akl_state *s, struct akl_list *l, struct akl_value *cons)
+{
+    struct akl_list *nl;
+    struct akl_list_iter it;
+    struct akl_value *e;
+    if (l != NULL) {
+        nl = akl_new_data_list(s, akl_list_count(l));
+        akl_list_iter_init(&it, l);
+        while ((e = akl_list_iter_next(&it)) != NULL)
+            akl_list_append_value(s, nl, e);
+    } else {
+        nl = akl_new_data_list(s, akl_cons_count(cons));
+        for (e = cons; AKL_CHECK_TYPE(e, AKL_VT_CONS); e = e->va_value.cons->cs_cdr)
+            akl_list_append_value(s, nl, e->va_value.cons->cs_car);
+    }
+    nl->is_quoted = TRUE;
+    return nl;
+}
+
+/* Give the sorted values back to the list, unless its length changed */
+static bool_t sort_write_back(struct akl_list *l, struct akl_list *sorted)
+{
+    struct akl_list_entry *ent;
+    unsigned int i, n = akl_list_count(sorted);
+    if (akl_list_count(l) != n)
+        return FALSE;
+    if (AKL_LIST_IS_PACKED(l)) {
+        akl_gc_write_barrier(l);
+        for (i = 0; i < n; i++)
+            l->li_elems[i] = akl_list_index_value(sorted, i);
+        return TRUE;
+    }
+    i = 0;
+    AKL_LIST_FOREACH(ent, l) {
+        akl_gc_write_barrier(ent);
+        ent->le_data = akl_list_index_value(sorted, i++);
+    }
+    return TRUE;
+}
+
+/*
+ * Sorting (stable for the lists):
+ *  (sort '(3 1 2))           => '(1 2 3)
+ *  (sort '(3 1 2) >)         => '(3 2 1)
+ *  (sort l (lambda (a b) (< (length a) (length b))))
+ *  (sort! l)                 (sorts the list itself)
+ * The function must give true, when its first argument is the lesser.
+ * Cons lists can only be sorted into new ones, the number vectors only
+ * with < or >. When the function changes the length of the list, sort!
+ * gives an error.
+*/
+static struct akl_value *
+sort_impl(struct akl_context *ctx, int argc, bool_t in_place)
+{
+    struct akl_state *s = ctx->cx_state;
+    struct akl_value *v, *fv = NULL;
+    struct akl_function *fn = NULL;
+    struct akl_context *cx;
+    struct akl_list *l, *nl;
+    akl_less_fn_t less = sort_less;
+
+    if (argc != 1 && argc != 2) {
+        akl_raise_error(ctx, AKL_ERROR, "%s: Expected a list and an optional function"
+                        , ctx->cx_func_name);
+        return AKL_NIL;
+    }
+    v = akl_frame_shift(ctx);
+    if (argc == 2) {
+        fv = akl_frame_shift(ctx);
+        if (!AKL_CHECK_TYPE(fv, AKL_VT_FUNCTION)) {
+            akl_raise_error(ctx, AKL_ERROR, "%s: Expected function but got %s"
+                            , ctx->cx_func_name, akl_type_name[AKL_TYPE(fv)]);
+            return AKL_NIL;
+        }
+        fn = AKL_GET_FUNCTION_VALUE(fv);
+        if (fn->fn_type == AKL_FUNC_CFUN && fn->fn_body.cfun == AKL_CAT(AKL_CFUN_PREFIX, lt)) {
+            less = sort_less;
+        } else if (fn->fn_type == AKL_FUNC_CFUN
+                   && fn->fn_body.cfun == AKL_CAT(AKL_CFUN_PREFIX, gt)) {
+            less = sort_greater;
+        } else {
+            less = sort_call;
+        }
+    }
+
+    switch (AKL_TYPE(v)) {
+        case AKL_VT_NIL:
+        return AKL_NIL;
+
+        case AKL_VT_FVECTOR:
+        if (less == sort_call) {
+            akl_raise_error(ctx, AKL_ERROR, "%s: Number vectors can only be sorted with < or >"
+                            , ctx->cx_func_name);
+            return AKL_NIL;
+        }
+        if (!in_place) {
+            v = akl_duplicate_value(s, v);
+        }
+        akl_fvector_sort(AKL_GET_FVECTOR_VALUE(v), less == sort_greater);
+        return v;
+
+        case AKL_VT_LIST:
+        l = AKL_GET_LIST_VALUE(v);
+        break;
+
+        case AKL_VT_CONS:
+        if (!in_place) {
+            l = NULL;
+            break;
+        }
+        /* FALLTHROUGH */
+        default:
+        akl_raise_error(ctx, AKL_ERROR, "%s: Expected list but got %s"
+                        , ctx->cx_func_name, akl_type_name[AKL_TYPE(v)]);
+        return AKL_NIL;
+    }
+
+    /* A new list is sorted as a packed one */
+    nl = in_place ? l : sort_copy(s, l, v);
+    if (less != sort_call) {
+        if (sort_is_numbers(nl))
+            less = (less == sort_less) ? sort_less_number : sort_greater_number;
+        akl_list_sort(s, nl, less, NULL);
+    } else {
+        /* The function can change the list and reach a safe point:
+          a private copy is sorted (the sort holds some of the values
+          only in C variables), an other one keeps all of them on the stack */
+        if (in_place)
+            nl = sort_copy(s, l, v);
+        akl_stack_push(ctx, akl_new_list_value(s, nl));
+        akl_stack_push(ctx, akl_new_list_value(s, sort_copy(s, nl, NULL)));
+        cx = akl_bound_function(ctx, NULL, fn);
+        akl_list_sort(s, nl, less, cx);
+        akl_unbound_function(cx);
+        if (in_place && !sort_write_back(l, nl)) {
+            akl_raise_error(ctx, AKL_ERROR, "%s: The list was changed during the sort"
+                            , ctx->cx_func_name);
+            return AKL_NIL;
+        }
+    }
+
+    if (in_place)
+        return v;
+    if (l == NULL)
+        return akl_list_to_cons(s, nl);
+    return akl_new_list_value(s, nl);
+}
+
+AKL_DEFINE_FUN(sort, ctx, argc)
+{
+    return sort_impl(ctx, argc, FALSE);
+}
+
+AKL_DEFINE_FUN(sort_inplace, ctx, argc)
+{
+    return sort_impl(ctx, argc, TRUE);
+}
+
 static struct akl_value *
 times_impl(struct akl_context *ctx, bool_t is_indexed)
 {
     struct akl_function *fn;
     struct akl_context *cx;
     struct akl_list *nl;
+    struct akl_value *rv;
     int i;
     double times_arg;
     // TODO: Change TYPE_* to bit masks.
@@ -798,8 +1574,10 @@ times_impl(struct akl_context *ctx, bool_t is_indexed)
        return AKL_NIL;
     }
     cx = akl_bound_function(ctx, NULL, fn);
-    nl = akl_new_list(ctx->cx_state);
+    nl = akl_new_data_list(ctx->cx_state, (times_arg > 0) ? (unsigned int)times_arg : 0);
     nl->is_quoted = TRUE;
+    rv = akl_new_list_value(ctx->cx_state, nl);
+    akl_stack_push(ctx, rv);
     for (i = 0; i < (int)times_arg; i++) {
         if (is_indexed) {
             akl_stack_push(cx, AKL_NUMBER(cx, i));
@@ -807,8 +1585,9 @@ times_impl(struct akl_context *ctx, bool_t is_indexed)
         akl_call_function_bound(cx, (is_indexed) ? 1 : 0);
         akl_list_append_value(ctx->cx_state, nl, akl_stack_pop(ctx));
     }
+    akl_unbound_function(cx);
 
-    return akl_new_list_value(ctx->cx_state, nl);
+    return rv;
 }
 
 AKL_DEFINE_FUN(times, ctx, argc)
@@ -832,7 +1611,7 @@ AKL_DEFINE_FUN(range, ctx, argc)
 
     f = (int)fp;
     t = (int)tp;
-    list = akl_new_list(ctx->cx_state);
+    list = akl_new_data_list(ctx->cx_state, (f <= t) ? t - f + 1 : 0);
     list->is_quoted = TRUE;
     for (;f <= t; f++) {
        akl_list_append_value(ctx->cx_state, list, AKL_NUMBER(ctx, (double)f));
@@ -924,11 +1703,9 @@ AKL_DEFINE_NE_FUN(set, ctx, argc)
     return AKL_NIL;
 }
 
-extern void akl_stack_clear(struct akl_context *ctx, size_t c);
 AKL_DEFINE_FUN(clear_stack, ctx, argc)
 {
-    while (akl_stack_pop(ctx))
-        ;
+    akl_stack_clear(ctx, 0);
     return AKL_NIL;
 }
 
@@ -942,6 +1719,7 @@ AKL_DEFINE_FUN(about, ctx, argc)
     struct akl_list_entry *ent;
     struct akl_module *mod;
     struct akl_state *s = ctx->cx_state;
+    struct akl_gc_stats st;
     printf("\nAkLisp version %d.%d-%s\n"
             "\tCopyleft (c) Akos Kovacs\n"
             "\tBuilt on %s %s\n"
@@ -977,8 +1755,15 @@ AKL_DEFINE_FUN(about, ctx, argc)
         }
         printf("\n");
     }
+    akl_gc_get_stats(s, &st);
     printf("\nGC statistics:\n");
-    printf("\tallocated memory: %u bytes\n", s->ai_gc_malloc_size);
+    printf("\tallocated memory: %lu bytes\n", (unsigned long)st.gs_malloc_bytes);
+    printf("\theap: %lu bytes, live: %lu bytes\n"
+           , (unsigned long)st.gs_heap_bytes, (unsigned long)st.gs_live_bytes);
+    printf("\tcollections: %lu minor, %lu major, %lu incremental steps\n"
+           , st.gs_minor, st.gs_major, st.gs_steps);
+    printf("\ttime: %llu usec, longest pause: %lu usec\n"
+           , st.gs_total_time, st.gs_max_pause);
 
     return &TRUE_VALUE;
 }
@@ -1179,7 +1964,7 @@ AKL_DEFINE_FUN(split, cx, argc) {
     }
     str = AKL_GET_STRING_VALUE(vstr);
     str = (str != NULL) ? strdup(str) : NULL;
-    ret = akl_new_list(cx->cx_state);
+    ret = akl_new_data_list(cx->cx_state, 0);
     ret->is_quoted = TRUE;
     while ((sub = strtok(str, delim)) != NULL) {
         strent = akl_new_string_value(cx->cx_state, sub);
@@ -2165,11 +2950,37 @@ AKL_DECLARE_FUNS(akl_basic_funs) {
     AKL_FUN(isnumber,    "number?", "Gives true if the parameter is a number"),
     AKL_FUN(isstring,    "string?", "Gives true if the parameter is a string"),
     AKL_FUN(islist,      "list?", "Gives true if the parameter is a list"),
+    AKL_FUN(iscons,      "cons?", "Gives true if the parameter is a pair (cons cell)"),
+    AKL_FUN(ishash,      "hash?", "Gives true if the parameter is a hash table"),
+    AKL_FUN(isfvector,   "fvector?", "Gives true if the parameter is a number vector"),
     AKL_FUN(issymbol,    "symbol?", "Gives true if the parameter is a symbol"),
     AKL_FUN(tonumber,    "number", "Converts values to a floating point number"),
     AKL_FUN(toint,       "int", "Converts values to an integer number"),
     AKL_FUN(tostr,       "string", "Converts values to a string"),
     AKL_FUN(list,        "list", "Create a list from the given arguments"),
+    AKL_FUN(cons,        "cons", "Create an immutable pair from a value and a rest (nil or a pair)"),
+    AKL_FUN(to_cons,     "to-cons", "Create a cons list from the elements of a list"),
+    AKL_FUN(make_hash,   "make-hash", "Create a hash table from the given keys and values"),
+    AKL_FUN(hash_get,    "hash-get", "Get the value of a key from a hash table (or the default)"),
+    AKL_FUN(hash_set,    "hash-set!", "Set the value of a key in a hash table"),
+    AKL_FUN(hash_del,    "hash-del!", "Remove a key from a hash table"),
+    AKL_FUN(hash_count,  "hash-count", "Get the number of the keys in a hash table"),
+    AKL_FUN(hash_keys,   "hash-keys", "Get the keys of a hash table as a list"),
+    AKL_FUN(hash_values, "hash-values", "Get the values of a hash table as a list"),
+    AKL_FUN(fvector,     "fvector", "Create a number vector from the given numbers"),
+    AKL_FUN(to_fvector,  "to-fvector", "Create a number vector from the numbers of a list"),
+    AKL_FUN(fvector_range, "fvector-range", "Create a number vector with the numbers of the given range"),
+    AKL_FUN(fvector_to_list, "fvector-to-list", "Get the numbers of a number vector as a list"),
+    AKL_FUN(fvector_sum, "fvector-sum", "Sum of the numbers in a number vector"),
+    AKL_FUN(fvector_min, "fvector-min", "The least number in a number vector"),
+    AKL_FUN(fvector_max, "fvector-max", "The greatest number in a number vector"),
+    AKL_FUN(fvector_dot, "fvector-dot", "Dot product of two number vectors"),
+    AKL_FUN(fvector_add, "fvector-add", "Element-wise sum of two number vectors"),
+    AKL_FUN(fvector_mul, "fvector-mul", "Element-wise product of two number vectors"),
+    AKL_FUN(fvector_scale, "fvector-scale", "Multiply the elements of a number vector with a number"),
+    AKL_FUN(fvector_prefix_sum, "fvector-prefix-sum", "Running sums of a number vector"),
+    AKL_FUN(fvector_lt,  "fvector-lt", "Mask (1 or 0) of the elements lesser than a number"),
+    AKL_FUN(fvector_gt,  "fvector-gt", "Mask (1 or 0) of the elements greater than a number"),
     AKL_FUN(length,      "length", "Get the length of a string or the element count for a list"),
     AKL_FUN(ls_index,    "index", "Index a list or a string"),
     AKL_FUN(ls_head ,    "head", "Get the first element of a list or the first character of a string"),
@@ -2184,11 +2995,14 @@ AKL_DECLARE_FUNS(akl_basic_funs) {
     AKL_FUN(range,       "range", "Make a list of numbers from a range"),
     AKL_FUN(progn,       "$", "Evaulate all elements and give back the last (primitive sequence)"),
     AKL_FUN(akl_cfg,     "akl-cfg!", "Set/unset interpreter features"),
+    AKL_FUN(gc_stats,    "gc-stats", "Counters and pause times of the garbage collector"),
     AKL_FUN(describe,    "describe", "Get a global atom help string"),
     AKL_FUN(map,         "map", "Call a function on list elements"),
     AKL_FUN(map_index,   "map-index", "Call a function on list with the elements' index (from 0) and the elements themselves"),
     AKL_FUN(foldl,       "foldl", "Fold a list from left"),
     AKL_FUN(foldl,       "fold", "Fold a list from left"),
+    AKL_FUN(sort,        "sort", "Sort a list (or a number vector) into a new one, with an optional less function"),
+    AKL_FUN(sort_inplace, "sort!", "Sort a list (or a number vector) in place, with an optional less function"),
     AKL_FUN(times,       "times", "Call a function n times"),
     AKL_FUN(times_index, "times-index", "Call a function n times (also passing the index to the function)"),
     AKL_FUN(exit,        "exit!", "Exit"),
@@ -69,6 +69,8 @@ AKL_CFUN_DEFINE(file_close, in, args)
     }
     if ((fp = unpack_file_userdata(udata)) != NULL) {
         fclose(fp);
+        /* Already closed, the GC must not close it again */
+        udata->ud_private = NULL;
         return AKL_TRUE;
     }
     return AKL_NIL;
@@ -310,7 +312,7 @@ AKL_DECLARE_FUNS(file_io_funs) {
 
 void akl_init_file(struct akl_state *s)
 {
-    akl_file_utype = akl_register_type(s, "FILE", file_utype_desctruct);
+    akl_file_utype = akl_register_type(s, "FILE", file_utype_desctruct, NULL);
     akl_stdin = akl_new_symbol(s, AKL_CSTR("stdin"));
     akl_stout = akl_new_symbol(s, AKL_CSTR("stdout"));
     akl_sterr = akl_new_symbol(s, AKL_CSTR("stderr"));
@@ -29,7 +29,7 @@
 AKL_DEFINE_SFUN(when, ctx)
 {
     int loff = 0;
-    struct akl_list *label = akl_new_labels(ctx, &loff, 1);
+    struct akl_vector *label = akl_new_labels(ctx, &loff, 1);
     akl_compile_next(ctx, NULL);
     akl_build_jump(ctx, AKL_JMP_FALSE, label, loff+0);
     akl_compile_next(ctx, NULL);
@@ -61,7 +61,7 @@ AKL_DEFINE_SFUN(sif, ctx)
 {
     /* Allocate the branch */
     int loff = 0;
-    struct akl_list *labels = akl_new_labels(ctx, &loff, 2);
+    struct akl_vector *labels = akl_new_labels(ctx, &loff, 2);
 
     /* Condition:*/
     akl_compile_next(ctx, NULL);
@@ -83,7 +83,7 @@ AKL_DEFINE_SFUN(sif, ctx)
 AKL_DEFINE_SFUN(swhile, ctx)
 {
     int loff = 0;
-    struct akl_list *labels = akl_new_labels(ctx, &loff, 2);
+    struct akl_vector *labels = akl_new_labels(ctx, &loff, 2);
     /* .L0: Condition: */
     akl_build_label(ctx, labels, loff+0);
     akl_compile_next(ctx, NULL);
@@ -103,8 +103,7 @@ akl_parse_params(struct akl_context *ctx, const char *fname, struct akl_vector *
 {
     assert(ctx && ctx->cx_state && ctx->cx_dev);
     akl_token_t tok;
-    int i = 0;
-    const int DEF_ARGC = 3;
+    struct akl_symbol *sym;
     tok = akl_lex(ctx->cx_dev);
 
     /* Empty argument list (0 args) */
@@ -123,12 +122,11 @@ akl_parse_params(struct akl_context *ctx, const char *fname, struct akl_vector *
         return;
     }
 
-    akl_init_vector(ctx->cx_state, args, DEF_ARGC, sizeof(struct akl_symbol *));
-
     while ((tok = akl_lex(ctx->cx_dev)) != tRBRACE) {
         /* TODO: pattern matching... */
         if (tok == tATOM) {
-           akl_vector_push(args, akl_lex_get_symbol(ctx->cx_dev));
+           sym = akl_lex_get_symbol(ctx->cx_dev);
+           akl_vector_push(args, &sym);
         }
     }
 }
@@ -139,14 +137,14 @@ AKL_DEFINE_SFUN(defun, ctx)
     akl_token_t tok;
     struct akl_function *func = akl_new_function(ctx->cx_state);
     struct akl_value *fval = akl_new_function_value(ctx->cx_state, func);
-    struct akl_list *oir = ctx->cx_ir;
+    struct akl_vector *oir = ctx->cx_ir;
+    struct akl_function *ofunc = ctx->cx_comp_func;
     struct akl_symbol *fsym;
     char *docstring = NULL;
 
     func->fn_type = AKL_FUNC_USER;
     ufun = &func->fn_body.ufun;
-    akl_init_list(&ufun->uf_body);
-    akl_init_list(&ufun->uf_labels);
+    akl_init_lisp_fun(ctx->cx_state, ufun);
 
     if (akl_lex(ctx->cx_dev) == tATOM) {
         fsym = akl_lex_get_symbol(ctx->cx_dev);
@@ -172,6 +170,8 @@ AKL_DEFINE_SFUN(defun, ctx)
 
     //tok = akl_lex(ctx->cx_dev);
     akl_compile_next(ctx, NULL);
+    akl_build_ret(ctx);
+    akl_build_tail_calls(ctx);
 #if 0
     if (tok == tLBRACE) {
         akl_compile_list(ctx);
@@ -183,6 +183,7 @@ AKL_DEFINE_SFUN(defun, ctx)
 
     /* Build needs the old IR */
     ctx->cx_ir = oir;
+    ctx->cx_comp_func = ofunc;
     akl_build_push(ctx, akl_new_sym_value(ctx->cx_state, fsym));
     return func;
 }
@@ -192,12 +193,13 @@ AKL_DEFINE_SFUN(lambda, ctx)
     struct akl_lisp_fun *ufun;
     akl_token_t tok;
     struct akl_function *func = akl_new_function(ctx->cx_state);
+    struct akl_vector *oir = ctx->cx_ir;
+    struct akl_function *ofunc = ctx->cx_comp_func;
     char *docstring = NULL;
 
     func->fn_type = AKL_FUNC_USER;
     ufun = &func->fn_body.ufun;
-    akl_init_list(&ufun->uf_body);
-    akl_init_list(&ufun->uf_labels);
+    akl_init_lisp_fun(ctx->cx_state, ufun);
 
     ctx->cx_comp_func = func;
     akl_parse_params(ctx, NULL, &ufun->uf_args);
@@ -211,6 +213,10 @@ AKL_DEFINE_SFUN(lambda, ctx)
         akl_lex_putback(ctx->cx_dev, tok);
     }
     akl_compile_next(ctx, NULL);
+    akl_build_ret(ctx);
+    akl_build_tail_calls(ctx);
+    ctx->cx_ir = oir;
+    ctx->cx_comp_func = ofunc;
     return func;
 }
 
@@ -21,17 +21,119 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  ************************************************************************/
 #include "aklisp.h"
+
+/*
+ * Lists have two representations: the linked lists are chains of
+ * entries, the packed (data) lists hold their values in an array
+ * (li_elems), so they can be indexed in O(1) and their elements take
+ * only a pointer. Every function works on both of them, but the ones
+ * working with entries (and the AKL_LIST_FIRST() like macros) turn a
+ * packed list into a linked one first (see akl_list_linked()). It is
+ * never turned back.
+*/
+
+/* Append to a packed list, the array grows by the half */
+static void
+list_packed_push(struct akl_state *s, struct akl_list *list, struct akl_value *val)
+{
+    unsigned int ncap;
+    /* Nothing is overwritten, so the marking does not need the
+      barrier (it would scan the whole array), only an old list */
+    if (!s->ai_gc_marking)
+        akl_gc_write_barrier(list);
+    if (list->li_count == list->li_cap) {
+        ncap = list->li_cap + list->li_cap/2;
+        list->li_elems = (struct akl_value **)akl_realloc(s, list->li_elems
+                              , list->li_cap * sizeof(struct akl_value *)
+                              , ncap * sizeof(struct akl_value *));
+        /* The arrays are not GC objects, but the GC must know about them */
+        s->ai_gc_allocs += (ncap - list->li_cap) * sizeof(struct akl_value *);
+        list->li_cap = ncap;
+    }
+    list->li_elems[list->li_count++] = val;
+    list->is_nil = FALSE;
+}
+
+/**
+ * @brief Make a list linked
+ * @param list A list (packed or linked)
+ * Creates the entries of a packed list and frees its array.
+ * Gives back the list itself.
+*/
+struct akl_list *akl_list_linked(struct akl_list *list)
+{
+    struct akl_state *s;
+    struct akl_value **elems;
+    unsigned int i, count, cap;
+    if (list == NULL || !AKL_LIST_IS_PACKED(list))
+        return list;
+
+    s     = akl_gc_state_of(list);
+    elems = list->li_elems;
+    count = list->li_count;
+    cap   = list->li_cap;
+    /* The marker must see the values before they are moved */
+    akl_gc_write_barrier(list);
+    list->li_elems = NULL;
+    list->li_cap   = 0;
+    list->li_count = 0;
+    for (i = 0; i < count; i++)
+        akl_list_append_value(s, list, elems[i]);
+    akl_free(s, elems, cap * sizeof(struct akl_value *));
+    return list;
+}
+
+void akl_list_iter_init(struct akl_list_iter *it, struct akl_list *list)
+{
+    it->it_list   = list;
+    it->it_ind    = 0;
+    it->it_packed = (list != NULL && AKL_LIST_IS_PACKED(list));
+    it->it_ent    = (list != NULL && !it->it_packed) ? list->li_head : NULL;
+}
+
+/* Gives back NULL after the last value. The list can be
+  modified meanwhile (even made linked). */
+struct akl_value *akl_list_iter_next(struct akl_list_iter *it)
+{
+    struct akl_list *list = it->it_list;
+    struct akl_list_entry *ent;
+    if (list == NULL)
+        return NULL;
+
+    if (AKL_LIST_IS_PACKED(list)) {
+        if (it->it_ind >= list->li_count)
+            return NULL;
+        return list->li_elems[it->it_ind++];
+    }
+    if (it->it_packed) {
+        /* The list was made linked since the last value */
+        it->it_packed = FALSE;
+        it->it_ent = (it->it_ind < list->li_count)
+                   ? akl_list_index_entry(list, it->it_ind) : NULL;
+    }
+    if ((ent = it->it_ent) == NULL)
+        return NULL;
+    it->it_ent = ent->le_next;
+    it->it_ind++;
+    return (struct akl_value *)ent->le_data;
+}
+
 /* This function also works on sublists */
 struct akl_list_entry 
 *akl_list_append(struct akl_state *s, struct akl_list *list, void *data)
 {
     assert(list != NULL);
-    struct akl_list_entry *ent = akl_new_list_entry(s);
+    struct akl_list_entry *ent;
+    /* Only values can be packed */
+    akl_list_linked(list);
+    ent = akl_new_list_entry(s);
     ent->le_data = data;
 
+    akl_gc_write_barrier(list);
     if (list->li_head == NULL) {
         list->li_head = ent;
     } else {
+        akl_gc_write_barrier(list->li_last);
         list->li_last->le_next = ent;
         ent->le_prev = list->li_last;
     }
@@ -42,10 +144,16 @@ struct akl_list_entry
     return ent; 
 }
 
+/* Gives back NULL for a packed list (it has no entries) */
 struct akl_list_entry
 *akl_list_append_value(struct akl_state *s, struct akl_list *list, struct akl_value *val)
 {
-    struct akl_list_entry *ent = akl_list_append(s, list, (void *)val);
+    struct akl_list_entry *ent;
+    if (AKL_LIST_IS_PACKED(list)) {
+        list_packed_push(s, list, val);
+        return NULL;
+    }
+    ent = akl_list_append(s, list, (void *)val);
     ent->gc_obj.gc_le_is_obj = TRUE;
     return ent;
 }
@@ -54,8 +162,11 @@ struct akl_list_entry *
 akl_list_insert_head(struct akl_state *s, struct akl_list *list, void *data)
 {
     assert(list);
-    struct akl_list_entry *ent = akl_new_list_entry(s);
+    struct akl_list_entry *ent;
+    akl_list_linked(list);
+    ent = akl_new_list_entry(s);
     ent->le_data = data;
+    akl_gc_write_barrier(list);
     if (list->li_head == NULL) {
         list->li_last = ent;
     } else {
@@ -71,6 +182,8 @@ akl_list_insert_head(struct akl_state *s, struct akl_list *list, void *data)
 void *akl_list_head(struct akl_list *list)
 {
     if (list != NULL) {
+        if (AKL_LIST_IS_PACKED(list))
+            return (list->li_count == 0) ? NULL : list->li_elems[0];
         return (list->li_head == NULL) ? NULL : list->li_head->le_data;
     }
     return NULL;
@@ -88,8 +201,9 @@ struct akl_list_entry *
 akl_list_shift_entry(struct akl_list *list)
 {
     assert(list);
-    struct akl_list_entry *ohead = list->li_head;
+    struct akl_list_entry *ohead = akl_list_linked(list)->li_head;
     struct akl_list_entry *nhead = (ohead) ? ohead->le_next : NULL;
+    akl_gc_write_barrier(list);
     list->li_head = nhead;
     if (nhead)
         nhead->le_prev = NULL;
@@ -112,9 +226,13 @@ akl_list_shift(struct akl_list *list)
 struct akl_value *akl_duplicate_value(struct akl_state *in, struct akl_value *oval)
 {
     struct akl_value *nval;
+    struct akl_fvector *fv, *nfv;
     if (oval == NULL)
         return NULL;
 
+    if (AKL_IS_IMMEDIATE(oval))
+        return oval;
+
     switch (oval->va_type) {
         case AKL_VT_LIST:
         return akl_new_list_value(in
@@ -133,7 +251,20 @@ struct akl_value *akl_duplicate_value(struct akl_state *in, struct akl_value *ov
         case AKL_VT_STRING:
         return akl_new_string_value(in, AKL_GET_STRING_VALUE(oval));
 
+        case AKL_VT_HASH:
+        return akl_new_hash_value(in
+                  , akl_hash_duplicate(in, AKL_GET_HASH_VALUE(oval)));
+
+        case AKL_VT_FVECTOR:
+        fv = AKL_GET_FVECTOR_VALUE(oval);
+        nfv = akl_new_fvector(in, AKL_FVECTOR_COUNT(fv));
+        memcpy(AKL_FVECTOR_DATA(nfv), AKL_FVECTOR_DATA(fv)
+               , AKL_FVECTOR_COUNT(fv) * sizeof(double));
+        return akl_new_fvector_value(in, nfv);
+
         case AKL_VT_FUNCTION:
+        case AKL_VT_CONS:
+        /* The pairs are immutable, they can be shared */
         nval = akl_new_value(in);
         *nval = *oval;
         return nval;
@@ -152,15 +283,17 @@ struct akl_value *akl_duplicate_value(struct akl_state *in, struct akl_value *ov
     return NULL;
 }
 
+/* The copy is always a packed list */
 struct akl_list *akl_list_duplicate(struct akl_state *in, struct akl_list *list)
 {
-    struct akl_list *nlist = akl_new_list(in);
-    struct akl_list_entry *ent;
-    struct akl_value *nval;
-    AKL_LIST_FOREACH(ent, list) {
-        nval = akl_duplicate_value(in, AKL_ENTRY_VALUE(ent));
-        akl_list_append_value(in, nlist, nval);
+    struct akl_list *nlist = akl_new_data_list(in, akl_list_count(list));
+    struct akl_list_iter it;
+    struct akl_value *val;
+    akl_list_iter_init(&it, list);
+    while ((val = akl_list_iter_next(&it)) != NULL) {
+        akl_list_append_value(in, nlist, akl_duplicate_value(in, val));
     }
+    nlist->is_quoted = list->is_quoted;
     return nlist;
 }
 
@@ -194,7 +327,7 @@ akl_list_index_entry(struct akl_list *list, int index)
     assert(list && !AKL_IS_NIL(list));
     struct akl_list_entry *ent;
 
-    if (list->li_head == NULL)
+    if (akl_list_linked(list)->li_head == NULL)
         return NULL;
 
     if (index >= 0) {
@@ -213,9 +346,18 @@ akl_list_index_entry(struct akl_list *list, int index)
     return ent;
 }
 
+/* The negative indexes count from the end (-1 is the last one) */
 void *akl_list_index(struct akl_list *list, int index)
 {
-    struct akl_list_entry *ent = akl_list_index_entry(list, index);
+    struct akl_list_entry *ent;
+    if (AKL_LIST_IS_PACKED(list)) {
+        if (index < 0)
+            index += list->li_count;
+        if (index < 0 || index >= (int)list->li_count)
+            return NULL;
+        return list->li_elems[index];
+    }
+    ent = akl_list_index_entry(list, index);
     return ent ? ent->le_data : NULL;
 }
 
@@ -227,6 +369,8 @@ akl_list_index_value(struct akl_list *list, int index)
 
 void *akl_list_last(struct akl_list *list)
 {
+    if (list != NULL && AKL_LIST_IS_PACKED(list))
+        return (list->li_count == 0) ? NULL : list->li_elems[list->li_count-1];
     if (list != NULL && list->li_last != NULL) {
         return list->li_last->le_data;
     }
@@ -246,7 +390,9 @@ akl_list_remove_entry(struct akl_list *list, struct akl_list_entry *ent)
     if (ent) {
         prev = ent->le_prev;
         next = ent->le_next;
+        akl_gc_write_barrier(list);
         if (prev) {
+            akl_gc_write_barrier(prev);
             prev->le_next = next;
         }
         if (next) {
@@ -296,7 +442,7 @@ struct akl_list_entry *
 akl_list_pop_entry(struct akl_list *list)
 {
     struct akl_list_entry *ent;
-    if (list == NULL || list->li_last == NULL)
+    if (list == NULL || akl_list_linked(list)->li_last == NULL)
         return NULL;
 
     ent = akl_list_remove_entry(list, list->li_last);
@@ -305,7 +451,18 @@ akl_list_pop_entry(struct akl_list *list)
 
 void *akl_list_pop(struct akl_list *list)
 {
-    struct akl_list_entry *ent = akl_list_pop_entry(list);
+    struct akl_list_entry *ent;
+    struct akl_state *s;
+    if (list != NULL && AKL_LIST_IS_PACKED(list)) {
+        if (list->li_count == 0)
+            return NULL;
+        /* Only the removed value must survive the marking */
+        s = akl_gc_state_of(list);
+        if (s->ai_gc_marking)
+            akl_gc_mark_object(s, list->li_elems[list->li_count-1], TRUE);
+        return list->li_elems[--list->li_count];
+    }
+    ent = akl_list_pop_entry(list);
     return ent ? ent->le_data : NULL;
 }
 
@@ -322,6 +479,8 @@ struct akl_list *akl_cdr(struct akl_state *s, struct akl_list *l)
     if (AKL_IS_NIL(l) || l->li_count == 0)
         return NULL;
 
+    /* The tail shares the entries with the list */
+    akl_list_linked(l);
     nhead = akl_new_list(s);
     nhead->li_count = l->li_count - 1;
     if (nhead->li_count <= 0) {
@@ -339,6 +498,207 @@ akl_list_tail(struct akl_state *s, struct akl_list *l)
     return akl_cdr(s, l);
 }
 
+/* Short runs of a packed list are sorted by insertion at first */
+#define SORT_RUN 16
+
+static void
+sort_insertion(struct akl_value **a, unsigned int n, akl_less_fn_t less, void *data)
+{
+    struct akl_value *v;
+    unsigned int i, j;
+    for (i = 1; i < n; i++) {
+        v = a[i];
+        for (j = i; j > 0 && less(data, v, a[j-1]); j--)
+            a[j] = a[j-1];
+        a[j] = v;
+    }
+}
+
+/* Merge src[lo..mid) and src[mid..hi) to dst (the left one wins on ties) */
+static void
+sort_merge(struct akl_value **src, struct akl_value **dst, unsigned int lo
+           , unsigned int mid, unsigned int hi, akl_less_fn_t less, void *data)
+{
+    unsigned int i = lo, j = mid, k = lo;
+    /* Already in order (e.g. a sorted input) */
+    if (mid == hi || !less(data, src[mid], src[mid-1])) {
+        memcpy(dst + lo, src + lo, (hi - lo) * sizeof(struct akl_value *));
+        return;
+    }
+    while (i < mid && j < hi) {
+        if (less(data, src[j], src[i]))
+            dst[k++] = src[j++];
+        else
+            dst[k++] = src[i++];
+    }
+    while (i < mid)
+        dst[k++] = src[i++];
+    while (j < hi)
+        dst[k++] = src[j++];
+}
+
+static void
+list_sort_packed(struct akl_state *s, struct akl_list *list
+                 , akl_less_fn_t less, void *data)
+{
+    struct akl_value **a = list->li_elems, **tmp, **src, **dst, **t;
+    unsigned int n = list->li_count, i, w;
+
+    for (i = 0; i < n; i += SORT_RUN)
+        sort_insertion(a + i, (n - i < SORT_RUN) ? n - i : SORT_RUN, less, data);
+    if (n <= SORT_RUN)
+        return;
+
+    tmp = (struct akl_value **)akl_alloc(s, n * sizeof(struct akl_value *));
+    src = a;
+    dst = tmp;
+    for (w = SORT_RUN; w < n; w *= 2) {
+        for (i = 0; i < n; i += 2 * w) {
+            sort_merge(src, dst, i, (n - i < w) ? n : i + w
+                       , (n - i < 2 * w) ? n : i + 2 * w, less, data);
+        }
+        t = src; src = dst; dst = t;
+    }
+    if (src != a)
+        memcpy(a, src, n * sizeof(struct akl_value *));
+    akl_free(s, tmp, n * sizeof(struct akl_value *));
+}
+
+/* Merge two chains of entries (ended by NULL), a is the earlier */
+static struct akl_list_entry *
+sort_merge_entries(struct akl_list_entry *a, struct akl_list_entry *b
+                   , akl_less_fn_t less, void *data)
+{
+    struct akl_list_entry *r = NULL, **tail = &r;
+    while (a != NULL && b != NULL) {
+        if (less(data, b->le_data, a->le_data)) {
+            *tail = b;
+            b = b->le_next;
+        } else {
+            *tail = a;
+            a = a->le_next;
+        }
+        tail = &(*tail)->le_next;
+    }
+    *tail = (a != NULL) ? a : b;
+    return r;
+}
+
+/*
+ * Bottom-up merge sort on the entries: bins[k] holds a sorted chain
+ * of 2^k entries, the new ones are merged in like a binary counter.
+ * Only the links are changed, nothing is allocated.
+*/
+static void
+list_sort_linked(struct akl_list *list, akl_less_fn_t less, void *data)
+{
+    struct akl_list_entry *bins[sizeof(unsigned int) * 8 + 1];
+    struct akl_list_entry *ent, *next, *run, *prev = NULL;
+    unsigned int k, nbins = 0;
+
+    /* The old links must be seen by the GC (see the write barrier) */
+    akl_gc_write_barrier(list);
+    for (ent = list->li_head; ent != NULL; ent = ent->le_next)
+        akl_gc_write_barrier(ent);
+
+    for (ent = list->li_head; ent != NULL; ent = next) {
+        next = ent->le_next;
+        ent->le_next = NULL;
+        run = ent;
+        for (k = 0; k < nbins && bins[k] != NULL; k++) {
+            run = sort_merge_entries(bins[k], run, less, data);
+            bins[k] = NULL;
+        }
+        if (k == nbins)
+            nbins++;
+        bins[k] = run;
+    }
+    run = NULL;
+    for (k = 0; k < nbins; k++) {
+        if (bins[k] != NULL)
+            run = (run == NULL) ? bins[k] : sort_merge_entries(bins[k], run, less, data);
+    }
+
+    list->li_head = run;
+    for (ent = run; ent != NULL; ent = ent->le_next) {
+        ent->le_prev = prev;
+        prev = ent;
+    }
+    list->li_last = prev;
+}
+
+/**
+ * @brief Sort a list in place (stable)
+ * @param s An instance of the interpreter
+ * @param list The list (packed or linked)
+ * @param less Gives TRUE, when its first value must be before the second
+ * (it must not modify the list)
+ * @param data Passed to the less function
+ * The elements of a packed list are merged through a temporary array,
+ * the entries of a linked list are relinked.
+*/
+void akl_list_sort(struct akl_state *s, struct akl_list *list
+                   , akl_less_fn_t less, void *data)
+{
+    if (list == NULL || list->li_count < 2)
+        return;
+    if (AKL_LIST_IS_PACKED(list))
+        list_sort_packed(s, list, less, data);
+    else
+        list_sort_linked(list, less, data);
+}
+
+/**
+ * @brief Make a cons list from the values of a list
+ * @param s An instance of the interpreter
+ * @param list The list (packed or linked, it is not modified)
+ * Gives back nil for an empty list.
+*/
+struct akl_value *akl_list_to_cons(struct akl_state *s, struct akl_list *list)
+{
+    struct akl_list_iter it;
+    struct akl_value *v, *first = AKL_NIL, *cell, *last = NULL;
+    akl_list_iter_init(&it, list);
+    while ((v = akl_list_iter_next(&it)) != NULL) {
+        cell = akl_new_cons_value(s, v, AKL_NIL);
+        if (last == NULL) {
+            first = cell;
+        } else {
+            /* The pairs are immutable only after they are built */
+            akl_gc_write_barrier(last->va_value.cons);
+            last->va_value.cons->cs_cdr = cell;
+        }
+        last = cell;
+    }
+    return first;
+}
+
+/* The number of pairs in a cons list */
+unsigned int akl_cons_count(struct akl_value *v)
+{
+    unsigned int n = 0;
+    while (AKL_CHECK_TYPE(v, AKL_VT_CONS)) {
+        v = v->va_value.cons->cs_cdr;
+        n++;
+    }
+    return n;
+}
+
+/* The negative indexes count from the end, like at the lists */
+struct akl_value *akl_cons_index(struct akl_value *v, int index)
+{
+    if (index < 0)
+        index += akl_cons_count(v);
+    if (index < 0)
+        return NULL;
+    while (AKL_CHECK_TYPE(v, AKL_VT_CONS)) {
+        if (index-- == 0)
+            return v->va_value.cons->cs_car;
+        v = v->va_value.cons->cs_cdr;
+    }
+    return NULL;
+}
+
 /* Is this symbol can be found in the string array, by name? */
 bool_t akl_is_strings_include(struct akl_symbol *sym, const char **strs)
 {
@@ -363,7 +723,7 @@ void akl_print_value(struct akl_state *s, struct akl_value *val)
         return;
     }
 
-    switch (val->va_type) {
+    switch (AKL_TYPE(val)) {
         case AKL_VT_NUMBER:
         AKL_START_COLOR(s, AKL_YELLOW);
         printf("%g", AKL_GET_NUMBER_VALUE(val));
@@ -380,6 +740,18 @@ void akl_print_value(struct akl_state *s, struct akl_value *val)
         akl_print_list(s, AKL_GET_LIST_VALUE(val));
         break;
 
+        case AKL_VT_CONS:
+        akl_print_cons(s, val);
+        break;
+
+        case AKL_VT_HASH:
+        akl_print_hash(s, AKL_GET_HASH_VALUE(val));
+        break;
+
+        case AKL_VT_FVECTOR:
+        akl_print_fvector(s, AKL_GET_FVECTOR_VALUE(val));
+        break;
+
         case AKL_VT_SYMBOL:
         sym = val->va_value.symbol;
         if (AKL_IS_QUOTED(val)) {
@@ -429,8 +801,9 @@ void akl_print_value(struct akl_state *s, struct akl_value *val)
 
 void akl_print_list(struct akl_state *s, struct akl_list *list)
 {
-    struct akl_list_entry *ent;
-    
+    struct akl_list_iter it;
+    unsigned int i;
+
     AKL_ASSERT(s, AKL_NOTHING);
 
     if (list == NULL || AKL_IS_NIL(list)
@@ -445,14 +818,31 @@ void akl_print_list(struct akl_state *s, struct akl_list *list)
         printf("\'");
     printf("(");
     struct akl_value *v;
-    AKL_LIST_FOREACH(ent, list) {
-        if (ent == NULL || ent->le_data == NULL)
-            break;
-        v = AKL_ENTRY_VALUE(ent);
+    akl_list_iter_init(&it, list);
+    for (i = 0; (v = akl_list_iter_next(&it)) != NULL; i++) {
+        if (i > 0)
+            printf(" ");
         akl_print_value(s, v);
-        if (AKL_LIST_NEXT(ent) != NULL)
+    }
+    printf(")");
+}
+
+/* Printed like the lists, an improper end is separated with a dot */
+void akl_print_cons(struct akl_state *s, struct akl_value *val)
+{
+    struct akl_cons *cons;
+    printf("\'(");
+    while (AKL_CHECK_TYPE(val, AKL_VT_CONS)) {
+        cons = val->va_value.cons;
+        akl_print_value(s, cons->cs_car);
+        val = cons->cs_cdr;
+        if (AKL_CHECK_TYPE(val, AKL_VT_CONS))
             printf(" ");
     }
+    if (!AKL_IS_NIL(val)) {
+        printf(" . ");
+        akl_print_value(s, val);
+    }
     printf(")");
 }
 
@@ -461,7 +851,7 @@ akl_list_it_begin(struct akl_list *l)
 {
     struct akl_list_entry *ent = NULL;
     if (l) {
-        ent = l->li_head;
+        ent = akl_list_linked(l)->li_head;
     }
     return ent;
 }
@@ -471,7 +861,7 @@ akl_list_it_end(struct akl_list *l)
 {
     struct akl_list_entry *ent = NULL;
     if (l) {
-        ent = l->li_last;
+        ent = akl_list_linked(l)->li_last;
     }
     return ent;
 }
@@ -23,7 +23,7 @@
 #include "aklisp.h"
 #include <unistd.h>
 #include <string.h>
-#include "../config.h"
+#include "config.h"
 
 #if HAVE_GETOPT_H
 # include <getopt.h>
@@ -311,12 +311,12 @@ int main(int argc, char* const* argv)
     int c;
     int opt_index = 1;
     struct akl_io_device *dev = NULL;
-    struct akl_list args;
+    struct akl_list *args;
     struct akl_value *args_value = AKL_NIL, *file_value = AKL_NIL;
     const char *fname = NULL, *eval_arg = NULL;
 
     init_aklisp();
-    akl_init_list(&args);
+    args = akl_new_list(&state);
 
 #ifdef HAVE_GETOPT_H
     while ((c = getopt_long(argc, argv, "aD:dC:e:E:chiv", akl_options, &opt_index)) != -1) {
@@ -364,14 +364,14 @@ int main(int argc, char* const* argv)
         fname = argv[optind];
 
         while (optind < argc) {
-            akl_list_append_value(&state, &args
+            akl_list_append_value(&state, args
                 , akl_new_string_value(&state, strdup(argv[optind++])));
         }
     }
 
     /* If there are no other arguments, the *args* will be NIL */
-    if (akl_list_count(&args) > 0) {
-            args_value = akl_new_list_value(&state, &args);
+    if (akl_list_count(args) > 0) {
+            args_value = akl_new_list_value(&state, args);
     }
     akl_set_global_variable(&state, AKL_CSTR("*args*")
         , AKL_CSTR("The list of command-line arguments"), args_value);
@@ -379,7 +379,7 @@ int main(int argc, char* const* argv)
     /* Sometimes is good to have an short way */
     akl_set_global_variable(&state, AKL_CSTR("*argc*")
         , AKL_CSTR("Count of the command-line arguments '(length *args*)'")
-        , akl_new_number_value(&state, akl_list_count(&args)));
+        , akl_new_number_value(&state, akl_list_count(args)));
 
     if (eval_arg) {
         dev = akl_new_string_device(&state, "eval", eval_arg);
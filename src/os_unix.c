@@ -120,12 +120,12 @@ AKL_DEFINE_FUN(getpid, ctx, argc)
 
 AKL_DEFINE_FUN(sleep, ctx, argc)
 {
-    double *n = akl_frame_pop_number(ctx);
-    if (n == NULL) {
+    double n;
+    if (!akl_frame_pop_number(ctx, &n)) {
         akl_raise_error(ctx, AKL_ERROR, "A number is needed.");
         return AKL_NIL;
     }
-    sleep((unsigned int)*n);
+    sleep((unsigned int)n);
     return akl_new_true_value(ctx->cx_state);
 }
 
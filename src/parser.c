@@ -83,8 +83,11 @@ akl_parse_token(struct akl_context *ctx, akl_token_t tok, bool_t is_quoted)
         break;
     }
 
-    value->is_quoted = is_quoted;
-    akl_set_lex_info(ctx, value);
+    /* Immediates cannot carry these */
+    if (value != NULL && !AKL_IS_IMMEDIATE(value)) {
+        value->is_quoted = is_quoted;
+        akl_set_lex_info(ctx, value);
+    }
     return value;
 }
 
@@ -106,7 +109,7 @@ struct akl_list *akl_parse_list(struct akl_context *ctx)
 {
     struct akl_value *value = NULL;
     struct akl_list *list, *lval;
-    list = akl_new_list(ctx->cx_state);
+    list = akl_new_data_list(ctx->cx_state, 0);
     while ((value = akl_parse_value(ctx)) != NULL) {
 
         /* If the next value is a list, reparent it... */
@@ -147,7 +150,11 @@ const char *akl_ir_instruction_set[] = {
   , "call" , "get"   , "set"
   , "br"   , "jmp"   , "jt"
   , "jn"   , "head"  , "tail"
-  , "ret"  , NULL
+  , "ret"  , "tcall" , "add"
+  , "sub"  , "mul"   , "div"
+  , "inc"  , "dec"   , "eq"
+  , "ne"   , "lt"    , "le"
+  , "gt"   , "ge"    , NULL
 };
 
 //#define AKL_ASSEMBLER
@@ -166,8 +173,8 @@ static void akl_asm_parse_label(struct akl_context *ctx)
     ufun = &fn->fn_body.ufun;
     if (label && label_name) {
         label->la_name = label_name;
-        label->la_ir = ctx->cx_ir;
-        label->la_branch = AKL_LIST_LAST(label->la_ir);
+        label->la_offset = akl_vector_count(ctx->cx_ir);
+        label->la_patch = -1;
     }
     akl_vector_push(ufun->uf_labels, label);
     if (akl_asm_lex(ctx->cx_dev) != tASM_COLON)
@@ -22,19 +22,19 @@
  ************************************************************************/
 #include "aklisp.h"
 
-const char *akl_type_name[10] = {
+const char *akl_type_name[13] = {
     "nil", "true", "symbol", "variable", "number"
-  , "string", "list", "function", "userdata", NULL
+  , "string", "list", "function", "userdata", "cons", "hash", "fvector", NULL
 };
 
 struct akl_value TRUE_VALUE = {
-    { AKL_GC_VALUE , FALSE, FALSE , TRUE }
+    { AKL_GC_VALUE , FALSE , TRUE }
   , NULL, AKL_VT_TRUE, { (double)1 }
   , FALSE, FALSE
 };
 
 struct akl_value NIL_VALUE = {
-    { AKL_GC_VALUE , FALSE, FALSE , TRUE }
+    { AKL_GC_VALUE , FALSE , TRUE }
   , NULL, AKL_VT_NIL, { (double)0 }
   , FALSE, TRUE
 };
@@ -61,13 +61,22 @@ void akl_init_state(struct akl_state *s, const struct akl_mem_callbacks *cbs)
     AKL_SET_FEATURE(s, AKL_CFG_USE_COLORS);
     AKL_SET_FEATURE(s, AKL_CFG_USE_GC);
     akl_gc_init(s);
+    akl_fvector_init();
 
     RB_INIT(&s->ai_symbols);
+    s->ai_symtab_size = AKL_SYMTAB_SIZE;
+    s->ai_symtab = (struct akl_symbol **)akl_calloc(s, AKL_SYMTAB_SIZE
+                                            , sizeof(struct akl_symbol *));
     RB_INIT(&s->ai_global_vars);
+    akl_init_vector(s, &s->ai_global_slots, 128, sizeof(struct akl_variable *));
+    s->ai_symbol_count = 0;
     s->ai_device = NULL;
     akl_init_list(&s->ai_modules);
-    akl_init_vector(s, &s->ai_utypes, 5, sizeof(struct akl_module *));
-    akl_init_list(&s->ai_stack);
+    AKL_GC_SET_STATIC(&s->ai_modules);
+    akl_init_vector(s, &s->ai_utypes, 5, sizeof(struct akl_utype));
+    akl_init_vector(s, &s->ai_stack, AKL_STACK_SIZE, sizeof(struct akl_value *));
+    akl_init_vector(s, &s->ai_frames, AKL_STACK_SIZE, sizeof(struct akl_context *));
+    s->ai_frame_depth = 0;
     s->ai_errors   = NULL;
     akl_init_context(&s->ai_context);
     akl_init_os(s);
@@ -76,11 +85,12 @@ void akl_init_state(struct akl_state *s, const struct akl_mem_callbacks *cbs)
 struct akl_state *akl_new_state(const struct akl_mem_callbacks *cbs)
 {
     struct akl_state *s;
-    void *(*alloc)(size_t);
-    if (cbs == NULL || cbs->mc_malloc_fn == NULL) {
-         alloc = malloc;
-    }
-    s = (struct akl_state *)alloc(sizeof(struct akl_state));
+    /* The state is allocated with the given functions too */
+    if (cbs == NULL || cbs->mc_malloc_fn == NULL)
+        s = (struct akl_state *)malloc(sizeof(struct akl_state));
+    else
+        s = (struct akl_state *)cbs->mc_malloc_fn(cbs->mc_context
+                                                  , sizeof(struct akl_state));
     if (s == NULL)
         return NULL;
 
@@ -100,6 +110,8 @@ void akl_init_list(struct akl_list *list)
     list->is_quoted = FALSE;
     list->is_nil    = FALSE;
     list->li_parent = NULL;
+    list->li_elems  = NULL;
+    list->li_cap    = 0;
     list->li_count  = 0;
 }
 
@@ -110,6 +122,24 @@ struct akl_list *akl_new_list(struct akl_state *s)
     return list;
 }
 
+/**
+ * @brief Create a packed list for values
+ * @param s An instance of the interpreter
+ * @param cap Expected number of elements (it can grow)
+ * The values are stored in an array, so they can be indexed in O(1).
+ * The list is turned into a linked one, when its entries are needed.
+*/
+struct akl_list *akl_new_data_list(struct akl_state *s, unsigned int cap)
+{
+    struct akl_list *list = akl_new_list(s);
+    if (cap < 4)
+        cap = 4;
+    list->li_elems = (struct akl_value **)akl_alloc(s, cap * sizeof(struct akl_value *));
+    list->li_cap   = cap;
+    s->ai_gc_allocs += cap * sizeof(struct akl_value *);
+    return list;
+}
+
 void akl_init_context(struct akl_context *ctx)
 {
     ctx->cx_state     = NULL;
@@ -119,30 +149,25 @@ void akl_init_context(struct akl_context *ctx)
     ctx->cx_ir        = NULL;
     ctx->cx_lex_info  = NULL;
     ctx->cx_parent    = NULL;
-    ctx->cx_frame     = NULL;
     ctx->cx_stack     = NULL;
     ctx->cx_fn_main   = NULL;
-    ctx->cx_frame_len = 0;
+    ctx->cx_comp_func = NULL;
+    ctx->cx_frame_base = 0;
+    ctx->cx_frame_len  = 0;
+    ctx->cx_depth      = 0;
 }
 
+/* The frame is the last 'len' values of the stack */
 void
 akl_init_frame(struct akl_context *ctx, int len)
 {
-    int fs = len;
-    struct akl_list_entry *it = akl_list_it_end(ctx->cx_stack);
-
-    ctx->cx_frame = akl_new_list(ctx->cx_state);
-    if (fs == -1) {
-        return;
+    unsigned int sp = akl_vector_count(ctx->cx_stack);
+    if (len < 0 || (unsigned int)len > sp) {
+        len = 0;
     }
 
-    ctx->cx_frame->li_count = len;
-    ctx->cx_frame_len = len;
-    ctx->cx_frame->li_last = it;
-    while (--fs && akl_list_it_has_prev(it)) {
-        akl_list_it_prev(&it);
-    }
-    ctx->cx_frame->li_head = it;
+    ctx->cx_frame_base = sp - len;
+    ctx->cx_frame_len  = len;
 }
 
 struct akl_context *
@@ -154,17 +179,63 @@ akl_new_context(struct akl_state *s)
     return ctx;
 }
 
+/*
+ * Symbols are interned in an open addressing hash table with linear
+ * probing. The table is kept at most half full.
+*/
+static struct akl_symbol **
+symtab_slot(struct akl_symbol **tab, unsigned int size
+            , const char *name, unsigned int hash)
+{
+    unsigned int i = hash & (size-1);
+    while (tab[i] != NULL) {
+        if (tab[i]->sb_hash == hash && strcasecmp(tab[i]->sb_name, name) == 0)
+            break;
+        i = (i+1) & (size-1);
+    }
+    return &tab[i];
+}
+
+static void
+symtab_grow(struct akl_state *s)
+{
+    unsigned int i, j, size = s->ai_symtab_size*2;
+    struct akl_symbol **tab = (struct akl_symbol **)
+                    akl_calloc(s, size, sizeof(struct akl_symbol *));
+    struct akl_symbol *sym;
+
+    for (i = 0; i < s->ai_symtab_size; i++) {
+        if ((sym = s->ai_symtab[i]) == NULL)
+            continue;
+        /* The names are unique, only need an empty slot */
+        j = sym->sb_hash & (size-1);
+        while (tab[j] != NULL)
+            j = (j+1) & (size-1);
+        tab[j] = sym;
+    }
+    akl_free(s, s->ai_symtab, s->ai_symtab_size*sizeof(struct akl_symbol *));
+    s->ai_symtab      = tab;
+    s->ai_symtab_size = size;
+}
+
 static struct akl_symbol *
-get_or_create_symbol(struct akl_state *s, char *name)
+get_or_create_symbol(struct akl_state *s, char *name, unsigned int hash)
 {
-    struct akl_symbol *sym = akl_get_symbol(s, name);
+    struct akl_symbol **slot = symtab_slot(s->ai_symtab, s->ai_symtab_size
+                                           , name, hash);
+    struct akl_symbol *sym = *slot;
 
     if (sym == NULL) {
         sym = AKL_MALLOC(s, struct akl_symbol);
         if (sym) {
             sym->sb_name    = name; /* SYM_TREE_RB_INSERT() needs this */
             sym->sb_is_cdef = TRUE;
+            sym->sb_hash    = hash;
+            sym->sb_id      = s->ai_symbol_count++;
             SYM_TREE_RB_INSERT(&s->ai_symbols, sym);
+            *slot = sym;
+            if (s->ai_symbol_count*2 > s->ai_symtab_size)
+                symtab_grow(s);
             /* The caller has to know, that this is a new symbol */
             sym->sb_name    = NULL;
         }
@@ -175,7 +246,7 @@ get_or_create_symbol(struct akl_state *s, char *name)
 struct akl_symbol *
 akl_new_symbol(struct akl_state *s, char *name, bool_t is_cname)
 {
-    struct akl_symbol *sym = get_or_create_symbol(s, name);
+    struct akl_symbol *sym = get_or_create_symbol(s, name, akl_hash_name(name));
     /* If the symbol already exsisted, no need to modifiy it's name */
     if (sym != NULL && sym->sb_name == NULL) {
         sym->sb_name    = name;
@@ -188,17 +259,24 @@ akl_new_symbol(struct akl_state *s, char *name, bool_t is_cname)
 struct akl_symbol *
 akl_get_symbol(struct akl_state *s, char *name)
 {
-    struct akl_symbol sym, *sptr;
-    sym.sb_name = name;
-    sptr = SYM_TREE_RB_FIND(&s->ai_symbols, &sym);
-    return sptr;
+    AKL_ASSERT(name, NULL);
+    return *symtab_slot(s->ai_symtab, s->ai_symtab_size
+                        , name, akl_hash_name(name));
 }
 
 /* Only copies the string, when a new symbol is created */
 struct akl_symbol *
 akl_get_or_create_symbol(struct akl_state *s, char *name)
 {
-    struct akl_symbol *sym = get_or_create_symbol(s, name);
+    return akl_get_or_create_symbol_hash(s, name, akl_hash_name(name));
+}
+
+/* Same as akl_get_or_create_symbol(), but the hash of the name is
+  already known (see copy_atom()) */
+struct akl_symbol *
+akl_get_or_create_symbol_hash(struct akl_state *s, char *name, unsigned int hash)
+{
+    struct akl_symbol *sym = get_or_create_symbol(s, name, hash);
     if (sym != NULL && sym->sb_name == NULL) {
         sym->sb_name    = AKL_STRDUP(name);
         sym->sb_is_cdef = FALSE;
@@ -271,7 +349,11 @@ struct akl_value *akl_new_string_value(struct akl_state *in, char *str)
 
 struct akl_value *akl_new_number_value(struct akl_state *in, double num)
 {
-    struct akl_value *val = akl_new_value(in);
+    struct akl_value *val;
+    if (AKL_FIXNUM_FITS(num))
+        return AKL_MAKE_FIXNUM(num);
+
+    val = akl_new_value(in);
     val->va_type = AKL_VT_NUMBER;
     val->va_value.number = num;
     return val;
@@ -286,18 +368,33 @@ struct akl_value *akl_new_list_value(struct akl_state *s, struct akl_list *lh)
     return val;
 }
 
+struct akl_value *akl_new_hash_value(struct akl_state *s, struct akl_hash *h)
+{
+    struct akl_value *val = akl_new_value(s);
+    assert(h != NULL);
+    val->va_type = AKL_VT_HASH;
+    val->va_value.hash = h;
+    return val;
+}
+
+struct akl_value *akl_new_fvector_value(struct akl_state *s, struct akl_fvector *fv)
+{
+    struct akl_value *val = akl_new_value(s);
+    assert(fv != NULL);
+    val->va_type = AKL_VT_FVECTOR;
+    val->va_value.fvector = fv;
+    return val;
+}
+
+/* Nil and true are singletons, nothing to allocate */
 struct akl_value *akl_new_nil_value(struct akl_state *s)
 {
-    struct akl_value *nil = akl_new_value(s);
-    *nil = NIL_VALUE;
-    return nil;
+    return AKL_NIL;
 }
 
 struct akl_value *akl_new_true_value(struct akl_state *s)
 {
-    struct akl_value *t = akl_new_value(s);
-    *t = TRUE_VALUE;
-    return t;
+    return AKL_TRUE;
 }
 
 struct akl_value *akl_new_user_value(struct akl_state *s, unsigned int type, void *data)
@@ -307,6 +404,7 @@ struct akl_value *akl_new_user_value(struct akl_state *s, unsigned int type, voi
     /* We should stop now, since the requested type does not exist */
     assert(akl_vector_at(&s->ai_utypes, type));
     udata = (struct akl_userdata *)akl_gc_malloc(s, AKL_GC_UDATA);
+    AKL_GC_INIT_OBJ(udata, AKL_GC_UDATA);
     value = akl_new_value(s);
     udata->ud_id = type;
     udata->ud_private = data;
@@ -315,6 +413,29 @@ struct akl_value *akl_new_user_value(struct akl_state *s, unsigned int type, voi
     return value;
 }
 
+/**
+ * @brief Create a pair (cons cell)
+ * @param s An instance of the interpreter
+ * @param car The first element
+ * @param cdr The rest (nil or the next pair for a proper cons list)
+ * The pair cannot be modified later, so its tail can be shared.
+*/
+struct akl_value *
+akl_new_cons_value(struct akl_state *s, struct akl_value *car, struct akl_value *cdr)
+{
+    struct akl_cons  *cons;
+    struct akl_value *value;
+    assert(car && cdr);
+    cons = (struct akl_cons *)akl_gc_malloc(s, AKL_GC_CONS);
+    AKL_GC_INIT_OBJ(cons, AKL_GC_CONS);
+    cons->cs_car = car;
+    cons->cs_cdr = cdr;
+    value = akl_new_value(s);
+    value->va_type = AKL_VT_CONS;
+    value->va_value.cons = cons;
+    return value;
+}
+
 struct akl_value *
 akl_new_sym_value(struct akl_state *s, struct akl_symbol *sym)
 {
@@ -380,13 +501,13 @@ akl_new_label(struct akl_context *ctx)
 
 void akl_init_label(struct akl_label *l, int ind)
 {
-    l->la_ir     = NULL;
-    l->la_branch = NULL;
+    l->la_offset = AKL_LABEL_UNRESOLVED;
+    l->la_patch  = -1;
     l->la_name   = NULL;
     l->la_ind    = ind;
 }
 
-struct akl_list *
+struct akl_vector *
 akl_new_labels(struct akl_context *ctx, int *loff, int n)
 {
     struct akl_label *l;
@@ -394,21 +515,26 @@ akl_new_labels(struct akl_context *ctx, int *loff, int n)
     int i, cnt;
     assert(ctx && ctx->cx_state && ctx->cx_comp_func);
     uf = &ctx->cx_comp_func->fn_body.ufun;
-    cnt = akl_list_count(&uf->uf_labels);
+    cnt = akl_vector_count(&uf->uf_labels);
     if (loff != NULL) {
         *loff = cnt;
     }
     for (i = 0; i < n; i++) {
-        l = akl_new_label(ctx);
-        if (l == NULL) {
-            return NULL;
-        }
+        l = (struct akl_label *)akl_vector_reserve(&uf->uf_labels);
         akl_init_label(l, i+cnt);
-        akl_list_append(ctx->cx_state, &uf->uf_labels, l);
     }
     return &uf->uf_labels;
 }
 
+void akl_init_lisp_fun(struct akl_state *s, struct akl_lisp_fun *uf)
+{
+    akl_init_vector(s, &uf->uf_args, 3, sizeof(struct akl_symbol *));
+    akl_init_vector(s, &uf->uf_body, 16, sizeof(struct akl_ir_instruction));
+    akl_init_vector(s, &uf->uf_consts, 8, sizeof(struct akl_value *));
+    akl_init_vector(s, &uf->uf_labels, 4, sizeof(struct akl_label));
+    uf->uf_info = NULL;
+}
+
 struct akl_io_device *
 akl_new_file_device(struct akl_state *s, const char *file_name, FILE *fp)
 {
@@ -420,6 +546,8 @@ akl_new_file_device(struct akl_state *s, const char *file_name, FILE *fp)
     dev->iod_source.file = fp;
     dev->iod_pos         = 0;
     dev->iod_line_count  = 1;
+    dev->iod_char_count  = 0;
+    dev->iod_column      = 0;
     dev->iod_name        = file_name;
     dev->iod_buffer      = NULL;
     dev->iod_buffer_size = 0;
@@ -439,6 +567,7 @@ akl_new_string_device(struct akl_state *s, const char *name, const char *str)
     dev->iod_pos         = 0;
     dev->iod_line_count  = 1;
     dev->iod_char_count  = 0;
+    dev->iod_column      = 0;
     dev->iod_name        = name;
     dev->iod_buffer      = NULL;
     dev->iod_buffer_size = 0;
@@ -507,16 +636,14 @@ akl_reset_file_interpreter(struct akl_state *in, const char *name, FILE *fp)
 bool_t akl_var_is_function(struct akl_variable *var)
 {
     struct akl_value *v = (var != NULL) ? var->vr_value: NULL;
-    return (v != NULL) && (v->va_type == AKL_VT_FUNCTION);
+    return AKL_CHECK_TYPE(v, AKL_VT_FUNCTION);
 }
 
 struct akl_function *
 akl_var_to_function(struct akl_variable *var)
 {
     struct akl_value *v = (var != NULL) ? var->vr_value: NULL;
-    if ((v != NULL) && (v->va_type == AKL_VT_FUNCTION))
-        return v->va_value.func;
-    return NULL;
+    return AKL_GET_FUNCTION_VALUE(v);
 }
 
 /* NOTE: These functions give back a NULL pointer, if the conversion
@@ -525,7 +652,7 @@ struct akl_value *akl_to_number(struct akl_state *in, struct akl_value *v)
 {
     char *str = NULL;
     if (v) {
-        switch (v->va_type) {
+        switch (AKL_TYPE(v)) {
             case AKL_VT_STRING:
             str = AKL_GET_STRING_VALUE(v);
             break;
@@ -561,8 +688,8 @@ char *akl_num_to_str(struct akl_state *s, double number)
     int strsize = 30;
     char *str = (char *)akl_alloc(s, strsize);
     while (snprintf(str, strsize, "%g", number) >= strsize) {
+        str = (char *)akl_realloc(s, str, strsize, strsize + strsize/2);
         strsize += strsize/2;
-        str = (char *)akl_realloc(s, str, strsize);
     }
     return str;
 }
@@ -571,7 +698,7 @@ struct akl_value *akl_to_string(struct akl_state *in, struct akl_value *v)
 {
     const char *str;
     if (v) {
-        switch (v->va_type) {
+        switch (AKL_TYPE(v)) {
             case AKL_VT_NUMBER:
             str = akl_num_to_str(in, AKL_GET_NUMBER_VALUE(v));
             break;
@@ -607,7 +734,7 @@ struct akl_value *akl_to_symbol(struct akl_state *in, struct akl_value *v)
     struct akl_value *val;
     char *name = NULL;
     if (v) {
-        switch (v->va_type) {
+        switch (AKL_TYPE(v)) {
             case AKL_VT_NUMBER:
             name = akl_num_to_str(in, AKL_GET_NUMBER_VALUE(v));
             break;
@@ -695,13 +822,16 @@ unsigned int akl_get_utype_value(struct akl_value *value)
 }
 
 unsigned int
-akl_register_type(struct akl_state *s, const char *name, akl_gc_destructor_t de_fun)
+akl_register_type(struct akl_state *s, const char *name
+                  , akl_gc_destructor_t de_fun, akl_gc_marker_t mark_fun)
 {
     struct akl_utype *type = (struct akl_utype *)akl_vector_reserve(&s->ai_utypes);
     type->ut_name = name;
-    type->ut_de_fun = de_fun;
+    type->ut_id   = akl_vector_count(&s->ai_utypes) - 1;
+    type->ut_de_fun   = de_fun;
+    type->ut_mark_fun = mark_fun;
 
-    return akl_vector_count(&s->ai_utypes);
+    return type->ut_id;
 }
 
 void akl_deregister_type(struct akl_state *s, unsigned int type)
@@ -25,20 +25,50 @@
 RB_GENERATE(SYM_TREE, akl_symbol, sb_entry, akl_rb_cmp_sym);
 RB_GENERATE(VAR_TREE, akl_variable, vr_entry, akl_rb_cmp_var);
 
+unsigned int akl_hash_name(const char *name)
+{
+    unsigned int h = AKL_HASH_INIT;
+    while (*name) {
+        h = AKL_HASH_STEP(h, *name);
+        name++;
+    }
+    return h;
+}
+
+/*
+ * Every symbol has a dense id, the global variables are stored in a
+ * slot array indexed by it. The array grows (NULL filled) on demand.
+*/
+static struct akl_variable **
+global_slot(struct akl_state *s, struct akl_symbol *sym)
+{
+    struct akl_vector *slots = &s->ai_global_slots;
+    struct akl_variable **slot;
+    while (akl_vector_count(slots) <= sym->sb_id) {
+        slot  = (struct akl_variable **)akl_vector_reserve(slots);
+        *slot = NULL;
+    }
+    return (struct akl_variable **)akl_vector_at(slots, sym->sb_id);
+}
+
 static struct akl_variable *
 set_global(struct akl_state *s, char *desc, bool_t is_cdesc
-           , struct akl_value *v, struct akl_variable *var)
+           , struct akl_value *v, struct akl_symbol *sym)
 {
-    struct akl_variable *ovar;
-    if (var == NULL) {
+    struct akl_variable **slot;
+    struct akl_variable *var;
+    if (sym == NULL) {
         return NULL;
     }
-    ovar = VAR_TREE_RB_FIND(&s->ai_global_vars, var);
-    if (ovar != NULL) {
-        var = ovar;
-    } else {
+    slot = global_slot(s, sym);
+    var  = *slot;
+    /* Only allocate on the first definition */
+    if (var == NULL) {
+        var = akl_new_var(s, sym);
+        *slot = var;
         VAR_TREE_RB_INSERT(&s->ai_global_vars, var);
     }
+    akl_gc_write_barrier(var);
     var->vr_value    = v;
     var->vr_desc     = desc;
     var->vr_is_cdesc = is_cdesc;
@@ -52,7 +82,7 @@ akl_set_global_var(struct akl_state *s, struct akl_symbol *sym
                         , struct akl_value *v)
 {
     AKL_ASSERT(s && sym && v, NULL);
-    return set_global(s, desc, is_cdesc, v, akl_new_var(s, sym));
+    return set_global(s, desc, is_cdesc, v, sym);
 }
 
 struct akl_variable *
@@ -64,7 +94,7 @@ akl_set_global_variable(struct akl_state *s
     AKL_ASSERT(s && v, NULL);
     struct akl_variable *var;
     var = set_global(s, desc, is_cdesc, v
-                      , akl_new_variable(s, name, is_cname));
+                      , akl_new_symbol(s, name, is_cname));
     return var;
 }
 
@@ -118,9 +148,10 @@ akl_add_global_sfun(struct akl_state *s, akl_sfun_t fn
 struct akl_variable *
 akl_get_global_var(struct akl_state *s, struct akl_symbol *sym)
 {
-    struct akl_variable var;
-    var.vr_symbol = sym;
-    return VAR_TREE_RB_FIND(&s->ai_global_vars, &var);
+    AKL_ASSERT(sym, NULL);
+    if (sym->sb_id >= akl_vector_count(&s->ai_global_slots))
+        return NULL;
+    return *(struct akl_variable **)akl_vector_at(&s->ai_global_slots, sym->sb_id);
 }
 
 /**
@@ -132,10 +163,10 @@ akl_get_global_var(struct akl_state *s, struct akl_symbol *sym)
 struct akl_variable *
 akl_get_global_variable(struct akl_state *s, char *name)
 {
-    struct akl_symbol sym;
+    struct akl_symbol *sym;
     AKL_ASSERT(name, NULL);
-    sym.sb_name = name;
-    return akl_get_global_var(s, &sym);
+    sym = akl_get_symbol(s, name);
+    return (sym != NULL) ? akl_get_global_var(s, sym) : NULL;
 }
 
 struct akl_value *
@@ -207,7 +238,8 @@ static const struct akl_feature {
     { "interactive", AKL_CFG_INTERACTIVE, "Enable interactive prompt" },
     { "use-gc",      AKL_CFG_USE_GC,      "Enable Garbage Collector"  },
     { "debug-instr", AKL_DEBUG_INSTR,     "Debug instructions"        },
-    { "debug-stack", AKL_DEBUG_STACK,     "Debug stack"               }
+    { "debug-stack", AKL_DEBUG_STACK,     "Debug stack"               },
+    { "gc-incremental", AKL_CFG_GC_INCREMENTAL, "Incremental major collections" }
 };
 
 #define FEATURE_COUNT sizeof(akl_features)/sizeof(akl_features[0])
@@ -239,6 +271,16 @@ void show_features(struct akl_state *s, const char *fname)
         printf("\nUsage:\n\tEnable: (%s :use-colors)\n"
                "\tDisable: (%s :no-use-colors)\n", fname, fname);
     }
+    printf("\nGC settings:\n"
+           "\t:%-10s\t%u%%\n\t:%-10s\t%lu bytes\n\t:%-10s\t%lu bytes\n"
+           "\t:%-10s\t%u%%\n\t:%-10s\t%lu usec\n\t:%-10s\t%u\n"
+           "\nUsage:\n\t(%s :gc-growth 150)\n"
+           "\t(%s :gc-pool-size :list-entry 1024)\n"
+           , "gc-growth", s->ai_gc_growth, "gc-min-heap", (unsigned long)s->ai_gc_min_heap
+           , "gc-nursery", (unsigned long)s->ai_gc_nursery
+           , "gc-mark-rate", s->ai_gc_mark_rate, "gc-max-pause", s->ai_gc_max_pause
+           , "gc-mark-threads", s->ai_gc_mark_threads
+           , fname, fname);
 }
 
 bool_t akl_set_feature_to(struct akl_state *s, const char *feature, bool_t to)
@@ -159,13 +159,14 @@ void *akl_vector_find(struct akl_vector *vec
 void akl_vector_grow(struct akl_vector *vec, unsigned int to)
 {
     assert(vec);
+    size_t osize = vec->av_size*vec->av_msize;
     if (to != 0 && to > vec->av_size)
         vec->av_size = to;
     else
         vec->av_size = vec->av_size + (vec->av_size/2);
 
     vec->av_vector = akl_realloc(vec->av_state, vec->av_vector
-                                    , vec->av_size*vec->av_msize);
+                                    , osize, vec->av_size*vec->av_msize);
 }
 
 void akl_vector_truncate_by(struct akl_vector *vec, unsigned int with)
@@ -198,7 +199,9 @@ akl_vector_at(struct akl_vector *vec, unsigned int ind)
 void *
 akl_vector_last(struct akl_vector *vec)
 {
-    return akl_vector_at(vec, vec->av_count);
+    if (vec->av_count == 0)
+        return NULL;
+    return akl_vector_at(vec, vec->av_count-1);
 }
 
 void *
@@ -223,7 +226,7 @@ akl_vector_count(struct akl_vector *vec)
 
 void akl_vector_destroy(struct akl_state *s, struct akl_vector *vec)
 {
-    akl_free(s, vec->av_vector, vec->av_size);
+    akl_free(s, vec->av_vector, vec->av_size*vec->av_msize);
 }
 
 void akl_vector_free(struct akl_state *s, struct akl_vector *vec)
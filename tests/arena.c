@@ -0,0 +1,153 @@
+#include <tester.h>
+
+/* Small blocks, so the interpreter already uses many of them */
+#define BLOCK_SIZE 4096
+
+struct akl_state state;
+struct akl_arena *arena = NULL;
+
+test_res_t arena_create(void)
+{
+    arena = akl_arena_new(BLOCK_SIZE);
+    if (arena == NULL)
+        return TEST_FAIL;
+    akl_init_state(&state, akl_arena_callbacks(arena));
+    return akl_arena_used(arena) > 0;
+}
+
+test_res_t arena_blocks(void)
+{
+    unsigned char *ptrs[100];
+    size_t used = akl_arena_used(arena);
+    int i, j;
+    /* They do not fit in one block */
+    for (i = 0; i < 100; i++) {
+        ptrs[i] = (unsigned char *)akl_alloc(&state, 96);
+        if (ptrs[i] == NULL)
+            return TEST_FAIL;
+        memset(ptrs[i], i, 96);
+    }
+    for (i = 0; i < 100; i++) {
+        for (j = 0; j < 96; j++) {
+            if (ptrs[i][j] != i)
+                return TEST_FAIL;
+        }
+    }
+    return akl_arena_used(arena) == used + 100 * 96;
+}
+
+test_res_t arena_big_alloc(void)
+{
+    /* It gets a block on its own */
+    unsigned char *p = (unsigned char *)akl_alloc(&state, 3 * BLOCK_SIZE);
+    if (p == NULL)
+        return TEST_FAIL;
+    memset(p, 0xaa, 3 * BLOCK_SIZE);
+    return p[0] == 0xaa && p[3 * BLOCK_SIZE - 1] == 0xaa;
+}
+
+test_res_t arena_realloc_last(void)
+{
+    char *p, *q;
+    size_t used;
+    /* After a big allocation the next one starts a new block */
+    akl_alloc(&state, 2 * BLOCK_SIZE);
+    p = (char *)akl_alloc(&state, 32);
+    strcpy(p, "last");
+    used = akl_arena_used(arena);
+    q = (char *)akl_realloc(&state, p, 32, 256);
+    if (q != p || strcmp(q, "last") != 0)
+        return TEST_FAIL;
+    if (akl_arena_used(arena) != used + 256 - 32)
+        return TEST_FAIL;
+    /* It can shrink too */
+    q = (char *)akl_realloc(&state, p, 256, 64);
+    return q == p && akl_arena_used(arena) == used + 64 - 32;
+}
+
+test_res_t arena_realloc_earlier(void)
+{
+    char *p, *q;
+    p = (char *)akl_alloc(&state, 32);
+    strcpy(p, "earlier");
+    akl_alloc(&state, 32);
+    /* It can only shrink in place, it is copied when it grows */
+    if (akl_realloc(&state, p, 32, 16) != p)
+        return TEST_FAIL;
+    q = (char *)akl_realloc(&state, p, 16, 64);
+    return q != NULL && q != p && strcmp(q, "earlier") == 0;
+}
+
+test_res_t arena_free_last(void)
+{
+    void *p, *q;
+    size_t used = akl_arena_used(arena);
+    p = akl_alloc(&state, 48);
+    q = akl_alloc(&state, 48);
+    /* An earlier allocation is not given back */
+    akl_free(&state, p, 48);
+    if (akl_arena_used(arena) != used + 2 * 48)
+        return TEST_FAIL;
+    akl_free(&state, q, 48);
+    if (akl_arena_used(arena) != used + 48)
+        return TEST_FAIL;
+    /* Its room is given out again */
+    return akl_alloc(&state, 48) == q;
+}
+
+test_res_t arena_reset(void)
+{
+    const struct akl_mem_callbacks *cbs = akl_arena_callbacks(arena);
+    void *first[20], *again[20];
+    int i;
+    akl_free_state(&state);
+    akl_arena_reset(arena);
+    if (akl_arena_used(arena) != 0)
+        return TEST_FAIL;
+    /* The kept blocks are given out in the same order */
+    for (i = 0; i < 20; i++)
+        first[i] = cbs->mc_malloc_fn(cbs->mc_context, 1000);
+    akl_arena_reset(arena);
+    for (i = 0; i < 20; i++)
+        again[i] = cbs->mc_malloc_fn(cbs->mc_context, 1000);
+    for (i = 0; i < 20; i++) {
+        if (first[i] != again[i])
+            return TEST_FAIL;
+    }
+    akl_arena_reset(arena);
+    return TEST_OK;
+}
+
+test_res_t arena_reuse(void)
+{
+    struct akl_list *l;
+    int i;
+    /* A new interpreter on the reset arena */
+    akl_init_state(&state, akl_arena_callbacks(arena));
+    l = akl_new_list(&state);
+    for (i = 0; i < 1000; i++)
+        akl_list_append_value(&state, l, akl_new_number_value(&state, i));
+    for (i = 0; i < 1000; i++) {
+        if (AKL_GET_NUMBER_VALUE(akl_list_index_value(l, i)) != i)
+            return TEST_FAIL;
+    }
+    akl_free_state(&state);
+    akl_arena_free(arena);
+    return TEST_OK;
+}
+
+int main()
+{
+    struct test atests[] = {
+        { arena_create, "An interpreter can use the arena" },
+        { arena_blocks, "The allocations are chained through the blocks" },
+        { arena_big_alloc, "A big allocation gets its own block" },
+        { arena_realloc_last, "The last allocation is resized in place" },
+        { arena_realloc_earlier, "An earlier allocation is copied, when it grows" },
+        { arena_free_last, "Only the last allocation can be freed" },
+        { arena_reset, "akl_arena_reset() rewinds to the first block" },
+        { arena_reuse, "The arena can be used again after the reset" },
+        { NULL, NULL }
+    };
+    return run_tests("Arena test", atests);
+}
@@ -0,0 +1,97 @@
+#include <tester.h>
+
+struct akl_state state;
+struct akl_fvector *fvec = NULL;
+/* Not a multiple of the SIMD width, so the tails are tested too */
+#define NR_NUMS 11
+
+test_res_t fvector_create(void)
+{
+    unsigned int i;
+    fvec = akl_new_fvector(&state, NR_NUMS);
+    if (fvec == NULL || AKL_FVECTOR_COUNT(fvec) != NR_NUMS)
+        return TEST_FAIL;
+    for (i = 0; i < NR_NUMS; i++)
+        AKL_FVECTOR_DATA(fvec)[i] = i + 1;
+    return TEST_OK;
+}
+
+test_res_t fvector_from_list(void)
+{
+    struct akl_list *l = akl_new_data_list(&state, 3);
+    struct akl_fvector *fv;
+    akl_list_append_value(&state, l, akl_new_number_value(&state, 4));
+    akl_list_append_value(&state, l, akl_new_number_value(&state, 5));
+    akl_list_append_value(&state, l, akl_new_number_value(&state, 6));
+    fv = akl_fvector_from(&state, akl_new_list_value(&state, l));
+    if (fv == NULL || AKL_FVECTOR_COUNT(fv) != 3 || AKL_FVECTOR_DATA(fv)[2] != 6)
+        return TEST_FAIL;
+    akl_list_append_value(&state, l, akl_new_string_value(&state, "x"));
+    return akl_fvector_from(&state, akl_new_list_value(&state, l)) == NULL;
+}
+
+test_res_t fvector_reduce(void)
+{
+    double min, max;
+    if (akl_fvector_sum(fvec) != 66 || akl_fvector_dot(fvec, fvec) != 506)
+        return TEST_FAIL;
+    if (!akl_fvector_min(fvec, &min) || !akl_fvector_max(fvec, &max))
+        return TEST_FAIL;
+    return min == 1 && max == NR_NUMS
+        && !akl_fvector_min(akl_new_fvector(&state, 0), &min);
+}
+
+test_res_t fvector_elementwise(void)
+{
+    struct akl_fvector *r = akl_new_fvector(&state, NR_NUMS);
+    unsigned int i;
+    akl_fvector_add(r, fvec, fvec);
+    for (i = 0; i < NR_NUMS; i++) {
+        if (AKL_FVECTOR_DATA(r)[i] != 2 * (i + 1))
+            return TEST_FAIL;
+    }
+    akl_fvector_mul(r, fvec, fvec);
+    akl_fvector_scale(r, r, 0.5);
+    for (i = 0; i < NR_NUMS; i++) {
+        if (AKL_FVECTOR_DATA(r)[i] != (i + 1) * (i + 1) * 0.5)
+            return TEST_FAIL;
+    }
+    return TEST_OK;
+}
+
+test_res_t fvector_prefix_sum(void)
+{
+    struct akl_fvector *r = akl_new_fvector(&state, NR_NUMS);
+    unsigned int i;
+    akl_fvector_prefix_sum(r, fvec);
+    for (i = 0; i < NR_NUMS; i++) {
+        if (AKL_FVECTOR_DATA(r)[i] != (i + 1) * (i + 2) / 2)
+            return TEST_FAIL;
+    }
+    return TEST_OK;
+}
+
+test_res_t fvector_masks(void)
+{
+    struct akl_fvector *r = akl_new_fvector(&state, NR_NUMS);
+    akl_fvector_less(r, fvec, 4);
+    if (akl_fvector_sum(r) != 3 || AKL_FVECTOR_DATA(r)[2] != 1.0)
+        return TEST_FAIL;
+    akl_fvector_greater(r, fvec, 4);
+    return akl_fvector_sum(r) == NR_NUMS - 4 && AKL_FVECTOR_DATA(r)[3] == 0.0;
+}
+
+int main()
+{
+    akl_init_state(&state, NULL);
+    struct test ftests[] = {
+        { fvector_create, "akl_new_fvector() can create a number vector" },
+        { fvector_from_list, "akl_fvector_from() takes only numbers from a list" },
+        { fvector_reduce, "Sum, dot product, minimum and maximum" },
+        { fvector_elementwise, "Element-wise add, multiply and scale" },
+        { fvector_prefix_sum, "akl_fvector_prefix_sum() gives the running sums" },
+        { fvector_masks, "Comparison masks are 1 or 0" },
+        { NULL, NULL }
+    };
+    return run_tests("Number vector test", ftests);
+}
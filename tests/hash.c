@@ -0,0 +1,139 @@
+#include <tester.h>
+
+struct akl_state state;
+struct akl_hash *hash = NULL;
+int nums[] = { -13, 22, 33, 11, 44, 122, 42, 112, 331, 23 };
+#define NR_NUMS (sizeof(nums)/sizeof(int))
+
+test_res_t hash_create(void)
+{
+    /* The table must grow */
+    hash = akl_new_hash(&state, 2);
+    return hash ? TEST_OK : TEST_FAIL;
+}
+
+test_res_t hash_set(void)
+{
+    int i;
+    for (i = 0; i < NR_NUMS; i++) {
+        akl_hash_set(&state, hash, akl_new_number_value(&state, nums[i])
+                     , akl_new_number_value(&state, i));
+    }
+    return akl_hash_count(hash) == NR_NUMS;
+}
+
+test_res_t hash_get(void)
+{
+    int i;
+    struct akl_value *v;
+    for (i = 0; i < NR_NUMS; i++) {
+        v = akl_hash_get(hash, akl_new_number_value(&state, nums[i]));
+        if (v == NULL || AKL_GET_NUMBER_VALUE(v) != i)
+            return TEST_FAIL;
+    }
+    return akl_hash_get(hash, akl_new_number_value(&state, 1000)) == NULL;
+}
+
+test_res_t hash_overwrite(void)
+{
+    struct akl_value *key = akl_new_number_value(&state, 42);
+    akl_hash_set(&state, hash, key, AKL_TRUE);
+    return akl_hash_count(hash) == NR_NUMS && akl_hash_get(hash, key) == AKL_TRUE;
+}
+
+test_res_t hash_string_keys(void)
+{
+    akl_hash_set(&state, hash, akl_new_string_value(&state, "key"), AKL_TRUE);
+    return akl_hash_get(hash, akl_new_string_value(&state, "key")) == AKL_TRUE;
+}
+
+test_res_t hash_del(void)
+{
+    int i;
+    /* Every second key, the others must be found after the removals */
+    for (i = 0; i < NR_NUMS; i += 2) {
+        if (!akl_hash_del(&state, hash, akl_new_number_value(&state, nums[i])))
+            return TEST_FAIL;
+    }
+    for (i = 1; i < NR_NUMS; i += 2) {
+        if (akl_hash_get(hash, akl_new_number_value(&state, nums[i])) == NULL)
+            return TEST_FAIL;
+    }
+    return !akl_hash_del(&state, hash, akl_new_number_value(&state, nums[0]));
+}
+
+test_res_t hash_next(void)
+{
+    unsigned int ind = 0, n = 0;
+    struct akl_value *key, *value;
+    while (akl_hash_next(hash, &ind, &key, &value)) {
+        if (akl_hash_get(hash, key) != value)
+            return TEST_FAIL;
+        n++;
+    }
+    return n == akl_hash_count(hash);
+}
+
+/* The table is old, the values stored into it are young: a minor
+  collection must find them through the write barrier */
+test_res_t hash_minor_gc(void)
+{
+    struct akl_context *ctx = akl_new_context(&state);
+    struct akl_hash *h = akl_new_hash(&state, 0);
+    struct akl_gc_stats st;
+    struct akl_gc_type_stats ts;
+    struct akl_value *v;
+    unsigned long minor, major;
+    char buf[32];
+    int i, round;
+    ctx->cx_stack = &state.ai_stack;
+    akl_stack_push(ctx, akl_new_hash_value(&state, h));
+    akl_gc_get_stats(&state, &st);
+    minor = st.gs_minor;
+    major = st.gs_major;
+    for (round = 0; round < 3; round++) {
+        for (i = 0; i < 1000; i++) {
+            snprintf(buf, sizeof(buf), "%d-%d", i, round);
+            akl_hash_set(&state, h, akl_new_number_value(&state, i)
+                         , akl_new_string_value(&state, strdup(buf)));
+        }
+        akl_gc_collect(ctx);
+        /* The values are marked (old) now */
+        akl_gc_get_type_stats(&state, AKL_GC_VALUE, &ts);
+        if (ts.ts_live < 1000)
+            return TEST_FAIL;
+        /* The slots of the dead values are reused */
+        for (i = 0; i < 10000; i++)
+            akl_new_string_value(&state, "garbage");
+    }
+    akl_gc_get_stats(&state, &st);
+    if (st.gs_minor != minor + 3 || st.gs_major != major)
+        return TEST_FAIL;
+
+    for (i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "%d-%d", i, round - 1);
+        v = akl_hash_get(h, akl_new_number_value(&state, i));
+        if (v == NULL || !AKL_CHECK_TYPE(v, AKL_VT_STRING)
+            || strcmp(v->va_value.string, buf) != 0)
+            return TEST_FAIL;
+    }
+    akl_stack_pop(ctx);
+    return TEST_OK;
+}
+
+int main()
+{
+    akl_init_state(&state, NULL);
+    struct test htests[] = {
+        { hash_create, "akl_new_hash() can create a hash table" },
+        { hash_set, "akl_hash_set() can add keys" },
+        { hash_get, "akl_hash_get() finds the keys" },
+        { hash_overwrite, "akl_hash_set() can change the value of a key" },
+        { hash_string_keys, "Strings are hashed by their contents" },
+        { hash_del, "akl_hash_del() can remove keys" },
+        { hash_next, "akl_hash_next() iterates through the pairs" },
+        { hash_minor_gc, "Young values in an old table survive the minor collections" },
+        { NULL, NULL }
+    };
+    return run_tests("Hash test", htests);
+}
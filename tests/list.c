@@ -127,9 +127,109 @@ test_res_t list_remove(void)
     return AKL_LIST_FIRST(list)->le_data == (void *)nums+0;
 }
 
+test_res_t list_packed(void)
+{
+    int i;
+    struct akl_list_entry *ent;
+    struct akl_list *dl = akl_new_data_list(&state, 2);
+    for (i = 0; i < NR_NUMS; i++)
+        akl_list_append_value(&state, dl, akl_new_number_value(&state, nums[i]));
+
+    if (!AKL_LIST_IS_PACKED(dl) || akl_list_count(dl) != NR_NUMS
+        || AKL_GET_NUMBER_VALUE(akl_list_index_value(dl, -1)) != nums[NR_NUMS-1])
+        return TEST_FAIL;
+    /* Walking the entries makes it a linked list */
+    i = 0;
+    AKL_LIST_FOREACH(ent, dl) {
+        if (AKL_GET_NUMBER_VALUE(AKL_ENTRY_VALUE(ent)) != nums[i++])
+            return TEST_FAIL;
+    }
+    return !AKL_LIST_IS_PACKED(dl) && i == NR_NUMS;
+}
+
+test_res_t list_to_cons(void)
+{
+    int i;
+    struct akl_value *c, *tail;
+    struct akl_list *dl = akl_new_data_list(&state, NR_NUMS);
+    for (i = 0; i < NR_NUMS; i++)
+        akl_list_append_value(&state, dl, akl_new_number_value(&state, nums[i]));
+
+    c = akl_list_to_cons(&state, dl);
+    tail = AKL_GET_CONS_VALUE(c)->cs_cdr;
+    return akl_cons_count(c) == NR_NUMS
+        && AKL_GET_NUMBER_VALUE(akl_cons_index(tail, 0)) == nums[1]
+        && AKL_GET_NUMBER_VALUE(akl_cons_index(c, -1)) == nums[NR_NUMS-1];
+}
+
+static bool_t num_less(void *data, struct akl_value *a, struct akl_value *b)
+{
+    return AKL_GET_NUMBER_VALUE(a) < AKL_GET_NUMBER_VALUE(b);
+}
+
+/* Sorted and the links (backwards too) are right */
+static bool_t list_is_sorted(struct akl_list *l, unsigned int count)
+{
+    struct akl_list_iter it;
+    struct akl_list_entry *ent, *prev = NULL;
+    struct akl_value *v, *last = NULL;
+    unsigned int n = 0;
+    akl_list_iter_init(&it, l);
+    while ((v = akl_list_iter_next(&it)) != NULL) {
+        if (last != NULL && num_less(NULL, v, last))
+            return FALSE;
+        last = v;
+        n++;
+    }
+    if (n != count)
+        return FALSE;
+    AKL_LIST_FOREACH(ent, l) {
+        if (ent->le_prev != prev)
+            return FALSE;
+        prev = ent;
+    }
+    return AKL_LIST_LAST(l) == prev;
+}
+
+test_res_t list_sort(void)
+{
+    int i;
+    /* Longer than the insertion sorted runs */
+    struct akl_list *pl = akl_new_data_list(&state, NR_NUMS * 5);
+    struct akl_list *ll = akl_new_list(&state);
+    for (i = 0; i < NR_NUMS * 5; i++) {
+        akl_list_append_value(&state, pl, akl_new_number_value(&state, nums[i % NR_NUMS] + i));
+        akl_list_append_value(&state, ll, akl_new_number_value(&state, nums[i % NR_NUMS] - i));
+    }
+    akl_list_sort(&state, pl, num_less, NULL);
+    if (!AKL_LIST_IS_PACKED(pl))
+        return TEST_FAIL;
+    akl_list_sort(&state, ll, num_less, NULL);
+    return list_is_sorted(pl, NR_NUMS * 5) && list_is_sorted(ll, NR_NUMS * 5);
+}
+
+/* The less function of sort! changes the list: an error, not a crash */
+test_res_t list_sort_changed(void)
+{
+    struct akl_context *ctx;
+    struct akl_value *v;
+    unsigned int errors;
+    ctx = akl_compile(&state, akl_new_string_device(&state, "sort"
+              , "(set! l (range 0 40))"
+                "(sort! l (lambda (a b) (> (length (append! 1 l)) (+ a b))))"
+                "(length l)"));
+    akl_execute(ctx);
+    v = akl_stack_pop(ctx);
+    errors = akl_list_count(state.ai_errors);
+    akl_clear_errors(&state);
+    return errors == 1 && AKL_CHECK_TYPE(v, AKL_VT_NUMBER)
+        && AKL_GET_NUMBER_VALUE(v) > 40;
+}
+
 int main()
 {
     akl_init_state(&state, NULL);
+    akl_init_library(&state, AKL_LIB_ALL);
     struct test vtests[] = {
         { list_create, "akl_new_list() can create a list" },
         { list_append, "akl_list_append() can add elements to a list" },
@@ -142,6 +242,10 @@ int main()
         { list_first, "AKL_LIST_FIRST() can get the first element" },
         { list_insert_head, "akl_insert_head() can insert a new first elemenet" },
         { list_remove, "akl_list_remove_entry() can remove arbitrary elements" },
+        { list_packed, "akl_new_data_list() creates a packed list, which can be linked" },
+        { list_to_cons, "akl_list_to_cons() creates a cons list with shared tails" },
+        { list_sort, "akl_list_sort() sorts packed and linked lists" },
+        { list_sort_changed, "sort! gives an error, when its function changes the list" },
         { NULL, NULL }
     };
     return run_tests("List test", vtests);